@@ -0,0 +1,947 @@
+/**
+ * @file batch.c
+ *
+ * @brief Command line modes, they run without display (and without
+ *        starting GTK+) and print machine readable results.
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* INCLUDES *****************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <glib.h>
+#include <glib/gi18n.h>
+
+#include "bencode.h"
+#include "torrent.h"
+#include "verify.h"
+#include "utilities.h"
+#include "sha1.h"
+#include "batch.h"
+
+/* TYPEDEF ******************************************************************/
+
+/**
+ * @brief Results of a batch check, filled by batch_piece_checked.
+ */
+typedef struct
+{
+  guint n_checked; /**< pieces checked.       */
+  guint n_valid;   /**< pieces that are right. */
+} BatchCheck;
+
+/**
+ * @brief The summary of a scanned torrent.
+ */
+typedef struct
+{
+  gchar   *filename;     /**< the .torrent file.                     */
+  gchar   *name;         /**< the name in info, or NULL.             */
+  gsize   name_length;   /**< the length of name (it can have NULs). */
+  gchar   *info_hash;    /**< the info hash in hex, or NULL.         */
+  gint64  size;          /**< sum of the files sizes.                */
+  guint   n_files;       /**< number of files.                       */
+  gint64  piece_length;  /**< size of the pieces.                    */
+  gchar   **trackers;    /**< announce and announce-list, or NULL.   */
+  gchar   *error;        /**< why it couldn't be readed, or NULL.    */
+} BatchTorrent;
+
+/**
+ * @brief The state of a scan, shared by the scan threads.
+ */
+typedef struct
+{
+  BatchTorrent *torrents;   /**< the torrents, sorted by file name.   */
+  guint    n_torrents;      /**< number of torrents.                  */
+  gint     next;            /**< next torrent to take (atomic).       */
+  GMutex   *mutex;          /**< lock of the times.                   */
+  gdouble  open_time;       /**< time in torrent_open, all threads.   */
+  gdouble  summary_time;    /**< time making summaries, all threads.  */
+} BatchScan;
+
+/* PRIVATE FUNCTIONS ********************************************************/
+
+static guint        batch_add_files(Verify *verify, BencNode *info, const gchar *path);
+static const gchar *batch_file_status(Verify *verify, guint file);
+static void         batch_escape(GString *out, const gchar *string, gssize length,
+                                 gboolean json);
+static void         batch_escape_bytes(GString *out, const gchar *bytes, gsize length,
+                                       gboolean json);
+static void         batch_print(Verify *verify, const gchar *torrent_file,
+                                const gchar *path, BatchFormat format,
+                                BatchCheck *check, gint64 bytes, gdouble seconds,
+                                gboolean ok);
+static void         batch_piece_checked(Verify *verify, guint piece, gboolean valid,
+                                        guint first_file, guint last_file,
+                                        gpointer data);
+static void         batch_scan_list(GPtrArray *files, const gchar *folder);
+static gint         batch_scan_compare(gconstpointer a, gconstpointer b);
+static gpointer     batch_scan_worker(gpointer data);
+static void         batch_scan_summary(BatchTorrent *summary, Torrent *torrent);
+static void         batch_scan_print(BatchScan *scan, const gchar *folder,
+                                     BatchFormat format);
+
+/* FUNCTIONS ****************************************************************/
+
+/**
+ * @brief Get an output format from its name ("tsv" or "json").
+ *
+ * @param name: the name of the format.
+ * @param format: where to put the format.
+ * @return TRUE if it's a known format.
+ */
+gboolean
+batch_parse_format(const gchar *name, BatchFormat *format)
+{
+  if(g_ascii_strcasecmp(name, "tsv") == 0)
+    *format = BATCH_FORMAT_TSV;
+  else if(g_ascii_strcasecmp(name, "json") == 0)
+    *format = BATCH_FORMAT_JSON;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * @brief Check the files of a torrent, as the Check button does, and
+ *        print the results of each file and of all the torrent.
+ *
+ * The check uses the checkpoint of the GUI, so a check that was
+ * interrupted is resumed by the next one.
+ *
+ * @param torrent_file: the .torrent file.
+ * @param path: the file (single file torrents) or the folder of the data.
+ * @param format: the output format.
+ * @param incremental: TRUE to only check the pieces of the files changed
+ *                     since the last check. @see verify_set_incremental
+ * @param n_workers: number of hashing threads (0 for one by processor).
+ * @return the exit status: BATCH_EXIT_OK if all is right,
+ *         BATCH_EXIT_MISMATCH if there are bad pieces or missing files,
+ *         BATCH_EXIT_ERROR if the torrent couldn't be checked.
+ */
+gint
+batch_verify(const gchar *torrent_file, const gchar *path,
+             BatchFormat format, gboolean incremental, guint n_workers)
+{
+  Torrent *torrent;
+  Verify *verify;
+  BatchCheck check;
+  BencNode *pieces, *length;
+  GError *err = NULL;
+  GTimer *timer;
+  gchar *filename;
+  gint64 piece_size, bytes;
+  guint n_pieces, n_files, i;
+  gdouble seconds;
+  gboolean ok;
+
+  if((torrent = torrent_open(torrent_file, &err)) == NULL)
+  {
+    if(err->domain == TORRENT_ERROR)
+      g_printerr(_("%s is not a bencoded torrent file or have corrupted data.\n"),
+                 torrent_file);
+    else
+      g_printerr("%s\n", err->message);
+    g_error_free(err);
+    return BATCH_EXIT_ERROR;
+  }
+
+  pieces = (torrent->info != NULL)? benc_dict_get(torrent->info, "pieces") : NULL;
+  length = (torrent->info != NULL)? benc_dict_get(torrent->info, "piece length") : NULL;
+  n_pieces = (pieces != NULL)? benc_node_length(pieces)/SHA_DIGEST_LENGTH : 0;
+  piece_size = (length != NULL)? benc_node_integer(length) : 0;
+
+  if(n_pieces == 0 || piece_size <= 0)
+  {
+    g_printerr(_("%s has no pieces to check.\n"), torrent_file);
+    torrent_free(torrent);
+    return BATCH_EXIT_ERROR;
+  }
+
+  if(piece_size > VERIFY_MAX_PIECE_SIZE)
+  {
+    g_printerr(_("%s has pieces too big to be checked.\n"), torrent_file);
+    torrent_free(torrent);
+    return BATCH_EXIT_ERROR;
+  }
+
+  verify = verify_new(benc_node_data(pieces), n_pieces, piece_size);
+  n_files = batch_add_files(verify, torrent->info, path);
+  if(n_files == 0)
+  {
+    g_printerr(_("%s has no files.\n"), torrent_file);
+    verify_free(verify);
+    torrent_free(torrent);
+    return BATCH_EXIT_ERROR;
+  }
+
+  filename = verify_checkpoint_filename(torrent->info_hash, path);
+  verify_set_checkpoint(verify, filename);
+  verify_set_incremental(verify, incremental, TRUE);
+  verify_set_workers(verify, n_workers);
+  g_free(filename);
+
+  check.n_checked = 0;
+  check.n_valid = 0;
+
+  timer = g_timer_new();
+  if(!verify_run(verify, batch_piece_checked, &check))
+  {
+    g_printerr(_("%s couldn't be checked, there isn't memory for the pieces or the threads couldn't be created.\n"),
+               torrent_file);
+    g_timer_destroy(timer);
+    verify_free(verify);
+    torrent_free(torrent);
+    return BATCH_EXIT_ERROR;
+  }
+  seconds = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+
+  /* the pieces taken from the checkpoint were not readed */
+  bytes = 0;
+  for(i = 0; i < n_files; i++)
+    bytes += verify_file_size(verify, i);
+  bytes = (gint64)((gdouble)bytes * (n_pieces - verify_get_n_resumed(verify)) / n_pieces);
+
+  ok = (check.n_valid == n_pieces);
+  for(i = 0; ok && i < n_files; i++)
+    ok = (verify_file_error(verify, i) == 0);
+
+  batch_print(verify, torrent_file, path, format, &check, bytes, seconds, ok);
+
+  verify_free(verify);
+  torrent_free(torrent);
+  return ok? BATCH_EXIT_OK : BATCH_EXIT_MISMATCH;
+}
+
+/**
+ * @brief Read all the .torrent files in a folder (and its subfolders) and
+ *        print a summary of each one: name, info hash, size, number of
+ *        files, piece length and trackers.
+ *
+ * The torrents are readed by a pool of threads, each one takes
+ * BATCH_SCAN_CHUNK torrents at once. The results are printed sorted by
+ * file name, and the time of each stage in the stderr.
+ *
+ * @param folder: the folder.
+ * @param format: the output format.
+ * @param n_workers: number of threads (0 for one by processor).
+ * @return the exit status: BATCH_EXIT_OK if all the torrents were readed,
+ *         BATCH_EXIT_MISMATCH if some weren't, BATCH_EXIT_ERROR if
+ *         there are no torrents.
+ */
+gint
+batch_scan(const gchar *folder, BatchFormat format, guint n_workers)
+{
+  BatchScan scan;
+  GPtrArray *files;
+  GThread **workers;
+  GTimer *timer;
+  gdouble list_time, parse_time, print_time;
+  guint i, n_started, n_errors;
+
+  if(!g_file_test(folder, G_FILE_TEST_IS_DIR))
+  {
+    g_printerr(_("%s is not a folder.\n"), folder);
+    return BATCH_EXIT_ERROR;
+  }
+
+  /* list */
+  timer = g_timer_new();
+  files = g_ptr_array_new();
+  batch_scan_list(files, folder);
+  g_ptr_array_sort(files, batch_scan_compare);
+  list_time = g_timer_elapsed(timer, NULL);
+
+  if(files->len == 0)
+  {
+    g_printerr(_("There are no torrent files in %s.\n"), folder);
+    g_ptr_array_free(files, TRUE);
+    g_timer_destroy(timer);
+    return BATCH_EXIT_ERROR;
+  }
+
+  scan.n_torrents = files->len;
+  scan.torrents = g_new0(BatchTorrent, scan.n_torrents);
+  for(i = 0; i < scan.n_torrents; i++)
+    scan.torrents[i].filename = (gchar*)g_ptr_array_index(files, i);
+  g_ptr_array_free(files, TRUE); /* the names are in the torrents now */
+
+  scan.next = 0;
+  scan.mutex = g_mutex_new();
+  scan.open_time = 0;
+  scan.summary_time = 0;
+
+  /* parse */
+  if(n_workers == 0)
+    n_workers = g_get_num_processors();
+  n_workers = CLAMP(n_workers, 1, MIN(BATCH_MAX_WORKERS,
+                    (scan.n_torrents + BATCH_SCAN_CHUNK - 1)/BATCH_SCAN_CHUNK));
+
+  g_timer_start(timer);
+  workers = g_new0(GThread*, n_workers);
+  for(n_started = 0; n_started < n_workers; n_started++)
+  {
+    workers[n_started] = g_thread_create(batch_scan_worker, &scan, TRUE, NULL);
+    if(workers[n_started] == NULL)
+      break;
+  }
+
+  /* without threads this one does all the work */
+  if(n_started == 0)
+    batch_scan_worker(&scan);
+
+  for(i = 0; i < n_started; i++)
+    g_thread_join(workers[i]);
+  parse_time = g_timer_elapsed(timer, NULL);
+
+  /* output */
+  g_timer_start(timer);
+  batch_scan_print(&scan, folder, format);
+  print_time = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+
+  n_errors = 0;
+  for(i = 0; i < scan.n_torrents; i++)
+  {
+    if(scan.torrents[i].error != NULL)
+      n_errors++;
+
+    g_free(scan.torrents[i].filename);
+    g_free(scan.torrents[i].name);
+    g_free(scan.torrents[i].info_hash);
+    g_strfreev(scan.torrents[i].trackers);
+    g_free(scan.torrents[i].error);
+  }
+
+  g_printerr(_("%u torrents (%u with errors) in %.3f s: list %.3f s, "
+               "parse %.3f s (%u threads, open %.3f s and summary %.3f s "
+               "between them), output %.3f s. %.0f torrents/s.\n"),
+             scan.n_torrents, n_errors, list_time + parse_time + print_time,
+             list_time, parse_time, MAX(n_started, 1), scan.open_time,
+             scan.summary_time, print_time,
+             (parse_time > 0)? scan.n_torrents/parse_time : 0);
+
+  g_free(scan.torrents);
+  g_free(workers);
+  g_mutex_free(scan.mutex);
+  return (n_errors == 0)? BATCH_EXIT_OK : BATCH_EXIT_MISMATCH;
+}
+
+/**
+ * @brief Add the files of a torrent to the engine, in the same way that
+ *        the files list of the main window. DON'T USE DIRECTLY.
+ *
+ * @param verify: the Verify.
+ * @param info: the info dictionary of the torrent.
+ * @param path: the file or folder of the data.
+ * @return the number of files.
+ */
+static guint
+batch_add_files(Verify *verify, BencNode *info, const gchar *path)
+{
+  BencNode *node, *value, **files;
+  gchar *string, *filename;
+  gint64 size;
+  guint n_files, i;
+
+  node = benc_dict_get(info, "files");
+  if(node == NULL) /* single file mode */
+  {
+    if(benc_dict_get(info, "name") == NULL)
+      return 0;
+
+    value = benc_dict_get(info, "length");
+    size = value? benc_node_integer(value) : ((gint64)G_MAXUINT);
+    verify_add_file(verify, path, size);
+    return 1;
+  }
+
+  /* multi file mode */
+  files = benc_node_children(node);
+  n_files = (files != NULL)? benc_node_n_children(node) : 0;
+  for(i = 0; i < n_files; i++)
+  {
+    value = benc_dict_get(files[i], "path");
+    string = (value != NULL)? util_convert_node_to_string(value, G_DIR_SEPARATOR_S) : NULL;
+    filename = g_strdup_printf("%s" G_DIR_SEPARATOR_S "%s", path, string?string:"");
+
+    value = benc_dict_get(files[i], "length");
+    size = (value != NULL)? benc_node_integer(value) : 0;
+    verify_add_file(verify, filename, size);
+
+    g_free(filename);
+    g_free(string);
+  }
+
+  return n_files;
+}
+
+/**
+ * @brief The state of a checked file: "ok", "bad" (it has bad pieces),
+ *        "missing", "short" or "error" (it couldn't be readed).
+ *        DON'T USE DIRECTLY.
+ *
+ * @param verify: the Verify.
+ * @param file: the file index.
+ * @return the state name.
+ */
+static const gchar *
+batch_file_status(Verify *verify, guint file)
+{
+  gint error;
+
+  error = verify_file_error(verify, file);
+  if(error == VERIFY_FILE_SHORT)
+    return "short";
+  else if(error == ENOENT)
+    return "missing";
+  else if(error != 0)
+    return "error";
+  else if(verify_file_remain(verify, file) > 0)
+    return "bad";
+
+  return "ok";
+}
+
+/**
+ * @brief Append a string escaped for JSON, or for a TSV field (where
+ *        tabs, new lines, backslashes and NULs are escaped). DON'T USE
+ *        DIRECTLY.
+ *
+ * The torrents strings aren't always UTF-8 (names in GBK or Shift-JIS
+ * are common): in JSON each byte that isn't part of valid UTF-8 is
+ * replaced by U+FFFD, in TSV the bytes are written as they are.
+ *
+ * @param out: where to append it.
+ * @param string: the string.
+ * @param length: the length of string, or -1 if it's NUL terminated.
+ * @param json: TRUE for JSON, FALSE for TSV.
+ */
+static void
+batch_escape(GString *out, const gchar *string, gssize length, gboolean json)
+{
+  const gchar *end, *valid;
+
+  if(length < 0)
+    length = strlen(string);
+  end = string + length;
+
+  if(!json)
+  {
+    batch_escape_bytes(out, string, length, FALSE);
+    return;
+  }
+
+  while(string < end)
+  {
+    /* it stops at a NUL too */
+    g_utf8_validate(string, end - string, &valid);
+    batch_escape_bytes(out, string, valid - string, TRUE);
+    if(valid == end)
+      break;
+
+    if(*valid == '\0')
+      g_string_append(out, "\\u0000");
+    else
+      g_string_append(out, "\\ufffd");
+    string = valid + 1;
+  }
+
+  return;
+}
+
+/**
+ * @brief Append some bytes escaped, see batch_escape. DON'T USE DIRECTLY.
+ *
+ * @param out: where to append them.
+ * @param bytes: the bytes (valid UTF-8 without NULs for JSON).
+ * @param length: the number of bytes.
+ * @param json: TRUE for JSON, FALSE for TSV.
+ */
+static void
+batch_escape_bytes(GString *out, const gchar *bytes, gsize length, gboolean json)
+{
+  const guchar *c, *end;
+
+  end = (const guchar*)bytes + length;
+  for(c = (const guchar*)bytes; c < end; c++)
+  {
+    switch(*c)
+    {
+    case '\\':
+      g_string_append(out, "\\\\");
+      break;
+    case '\0':
+      g_string_append(out, "\\0");
+      break;
+    case '\t':
+      g_string_append(out, "\\t");
+      break;
+    case '\n':
+      g_string_append(out, "\\n");
+      break;
+    case '\r':
+      g_string_append(out, "\\r");
+      break;
+    case '"':
+      g_string_append(out, json? "\\\"" : "\"");
+      break;
+    default:
+      if(json && *c < 0x20)
+        g_string_append_printf(out, "\\u%04x", *c);
+      else
+        g_string_append_c(out, *c);
+      break;
+    }
+  }
+
+  return;
+}
+
+/**
+ * @brief Print the results of a check in the stdout. DON'T USE DIRECTLY.
+ *
+ * TSV: a "file" line for each file (name, size, bytes not valid, state
+ * and error message) and a "total" line (files, pieces, valid pieces,
+ * pieces taken from the checkpoint, readed bytes, seconds, MiB/s, and
+ * "ok" or "mismatch"). The lines starting with '#' are the columns names.
+ *
+ * JSON: an object with the same values, and the files in "files".
+ *
+ * @param verify: the Verify.
+ * @param torrent_file: the .torrent file.
+ * @param path: the data path.
+ * @param format: the output format.
+ * @param check: the counters of the check.
+ * @param bytes: the bytes readed.
+ * @param seconds: the time of the check.
+ * @param ok: TRUE if all is right.
+ */
+static void
+batch_print(Verify *verify, const gchar *torrent_file, const gchar *path,
+            BatchFormat format, BatchCheck *check, gint64 bytes,
+            gdouble seconds, gboolean ok)
+{
+  GString *out;
+  gdouble speed;
+  gint error;
+  guint i, n_files;
+  gchar number[G_ASCII_DTOSTR_BUF_SIZE];
+
+  n_files = verify_get_n_files(verify);
+  speed = (seconds > 0)? bytes/seconds/(1024*1024) : 0;
+  out = g_string_new(NULL);
+
+  if(format == BATCH_FORMAT_JSON)
+  {
+    g_string_append(out, "{\"torrent\": \"");
+    batch_escape(out, torrent_file, -1, TRUE);
+    g_string_append(out, "\", \"path\": \"");
+    batch_escape(out, path, -1, TRUE);
+    g_string_append(out, "\", \"files\": [");
+  }
+  else
+    g_string_append(out, "#file\tname\tsize\tremain\tstatus\terror\n");
+
+  for(i = 0; i < n_files; i++)
+  {
+    error = verify_file_error(verify, i);
+
+    if(format == BATCH_FORMAT_JSON)
+    {
+      g_string_append(out, (i == 0)? "\n  {\"name\": \"" : ",\n  {\"name\": \"");
+      batch_escape(out, verify_file_name(verify, i), -1, TRUE);
+      g_string_append_printf(out, "\", \"size\": %" G_GINT64_FORMAT
+                             ", \"remain\": %" G_GINT64_FORMAT
+                             ", \"status\": \"%s\", \"error\": \"",
+                             verify_file_size(verify, i),
+                             verify_file_remain(verify, i),
+                             batch_file_status(verify, i));
+      if(error > 0)
+        batch_escape(out, g_strerror(error), -1, TRUE);
+      g_string_append(out, "\"}");
+    }
+    else
+    {
+      g_string_append(out, "file\t");
+      batch_escape(out, verify_file_name(verify, i), -1, FALSE);
+      g_string_append_printf(out, "\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%s\t",
+                             verify_file_size(verify, i),
+                             verify_file_remain(verify, i),
+                             batch_file_status(verify, i));
+      if(error > 0)
+        batch_escape(out, g_strerror(error), -1, FALSE);
+      g_string_append_c(out, '\n');
+    }
+  }
+
+  /* seconds and speed never with the locale decimal point */
+  if(format == BATCH_FORMAT_JSON)
+  {
+    g_string_append_printf(out, "],\n \"n_files\": %u, \"pieces\": %u, \"valid\": %u"
+                           ", \"resumed\": %u, \"bytes\": %" G_GINT64_FORMAT,
+                           n_files, check->n_checked, check->n_valid,
+                           verify_get_n_resumed(verify), bytes);
+    g_string_append_printf(out, ", \"seconds\": %s",
+                           g_ascii_formatd(number, sizeof(number), "%.3f", seconds));
+    g_string_append_printf(out, ", \"mib_per_second\": %s",
+                           g_ascii_formatd(number, sizeof(number), "%.1f", speed));
+    g_string_append_printf(out, ", \"sha1\": \"%s\", \"status\": \"%s\"}\n",
+                           sha1_backend(), ok? "ok" : "mismatch");
+  }
+  else
+  {
+    g_string_append(out, "#total\tfiles\tpieces\tvalid\tresumed\tbytes\tseconds"
+                         "\tmib_per_second\tstatus\n");
+    g_string_append_printf(out, "total\t%u\t%u\t%u\t%u\t%" G_GINT64_FORMAT,
+                           n_files, check->n_checked, check->n_valid,
+                           verify_get_n_resumed(verify), bytes);
+    g_string_append_printf(out, "\t%s",
+                           g_ascii_formatd(number, sizeof(number), "%.3f", seconds));
+    g_string_append_printf(out, "\t%s\t%s\n",
+                           g_ascii_formatd(number, sizeof(number), "%.1f", speed),
+                           ok? "ok" : "mismatch");
+  }
+
+  fputs(out->str, stdout);
+  fflush(stdout);
+  g_string_free(out, TRUE);
+  return;
+}
+
+/**
+ * @brief Called by the Verify engine for each checked piece.
+ *        DON'T USE DIRECTLY.
+ *
+ * @param verify: the Verify.
+ * @param piece: the piece index.
+ * @param valid: TRUE if the piece is right.
+ * @param first_file: the first file of the piece.
+ * @param last_file: the last file of the piece.
+ * @param data: the BatchCheck.
+ */
+static void
+batch_piece_checked(Verify *verify, guint piece, gboolean valid,
+                    guint first_file, guint last_file, gpointer data)
+{
+  BatchCheck *check = (BatchCheck*)data;
+
+  /* the engine never calls it twice at the same time */
+  check->n_checked++;
+  if(valid)
+    check->n_valid++;
+
+  return;
+}
+
+/**
+ * @brief Add the .torrent files of a folder and its subfolders to an
+ *        array. The links to folders are not followed (no loops).
+ *        DON'T USE DIRECTLY.
+ *
+ * @param files: where to add the file names (new allocated).
+ * @param folder: the folder.
+ */
+static void
+batch_scan_list(GPtrArray *files, const gchar *folder)
+{
+  GDir *dir;
+  const gchar *entry;
+  gchar *filename;
+  gsize length;
+
+  if((dir = g_dir_open(folder, 0, NULL)) == NULL)
+    return;
+
+  while((entry = g_dir_read_name(dir)) != NULL)
+  {
+    filename = g_build_filename(folder, entry, NULL);
+    length = strlen(entry);
+
+    if(length > 8 && g_ascii_strcasecmp(entry + length - 8, ".torrent") == 0 &&
+       !g_file_test(filename, G_FILE_TEST_IS_DIR))
+    {
+      g_ptr_array_add(files, filename);
+      continue;
+    }
+
+    if(!g_file_test(filename, G_FILE_TEST_IS_SYMLINK) &&
+       g_file_test(filename, G_FILE_TEST_IS_DIR))
+      batch_scan_list(files, filename);
+
+    g_free(filename);
+  }
+
+  g_dir_close(dir);
+  return;
+}
+
+/**
+ * @brief GCompareFunc of the file names array. DON'T USE DIRECTLY.
+ */
+static gint
+batch_scan_compare(gconstpointer a, gconstpointer b)
+{
+  return strcmp(*(const gchar**)a, *(const gchar**)b);
+}
+
+/**
+ * @brief A scan thread, it reads torrents until there are no more.
+ *        DON'T USE DIRECTLY.
+ *
+ * @param data: the BatchScan.
+ * @return NULL.
+ */
+static gpointer
+batch_scan_worker(gpointer data)
+{
+  BatchScan *scan = (BatchScan*)data;
+  BatchTorrent *summary;
+  Torrent *torrent;
+  GError *err;
+  GTimer *timer;
+  gdouble open_time, summary_time;
+  guint first, i;
+
+  timer = g_timer_new();
+  open_time = 0;
+  summary_time = 0;
+
+  /* one atomic add for each chunk, the torrents are all different */
+  while((first = (guint)g_atomic_int_add(&scan->next, BATCH_SCAN_CHUNK)) < scan->n_torrents)
+  {
+    for(i = first; i < MIN(first + BATCH_SCAN_CHUNK, scan->n_torrents); i++)
+    {
+      summary = &scan->torrents[i];
+      err = NULL;
+
+      g_timer_start(timer);
+      torrent = torrent_open(summary->filename, &err);
+      open_time += g_timer_elapsed(timer, NULL);
+
+      if(torrent == NULL)
+      {
+        summary->error = g_strdup(err->message);
+        g_error_free(err);
+        continue;
+      }
+
+      g_timer_start(timer);
+      batch_scan_summary(summary, torrent);
+      torrent_free(torrent);
+      summary_time += g_timer_elapsed(timer, NULL);
+    }
+  }
+
+  g_timer_destroy(timer);
+
+  g_mutex_lock(scan->mutex);
+  scan->open_time += open_time;
+  scan->summary_time += summary_time;
+  g_mutex_unlock(scan->mutex);
+
+  return NULL;
+}
+
+/**
+ * @brief Fill the summary of a torrent. DON'T USE DIRECTLY.
+ *
+ * @param summary: the BatchTorrent.
+ * @param torrent: the loaded Torrent.
+ */
+static void
+batch_scan_summary(BatchTorrent *summary, Torrent *torrent)
+{
+  BencNode *node, *tier, *value;
+  GPtrArray *trackers;
+
+  /* the trackers, as the main window tracker list */
+  trackers = g_ptr_array_new();
+  node = benc_dict_get(torrent->metainfo, "announce");
+  if(node != NULL && benc_node_type(node) == BENC_TYPE_STRING)
+    g_ptr_array_add(trackers, g_strndup(benc_node_data(node), benc_node_length(node)));
+
+  node = benc_dict_get(torrent->metainfo, "announce-list");
+  if(node != NULL) /* multi-tracker support */
+  {
+    for(tier = benc_node_first_child(node); tier != NULL;
+        tier = benc_node_next_sibling(tier))
+    {
+      for(value = benc_node_first_child(tier); value != NULL;
+          value = benc_node_next_sibling(value))
+      {
+        if(benc_node_type(value) == BENC_TYPE_STRING)
+          g_ptr_array_add(trackers, g_strndup(benc_node_data(value), benc_node_length(value)));
+      }
+    }
+  }
+  g_ptr_array_add(trackers, NULL);
+  summary->trackers = (gchar**)g_ptr_array_free(trackers, FALSE);
+
+  if(torrent->info == NULL)
+  {
+    summary->error = g_strdup(_("There is no info dictionary."));
+    return;
+  }
+
+  summary->info_hash = util_convert_to_hex((gchar*)torrent->info_hash,
+                                           SHA_DIGEST_LENGTH, NULL);
+
+  node = benc_dict_get(torrent->info, "name");
+  if(node != NULL && benc_node_type(node) == BENC_TYPE_STRING)
+  {
+    /* not g_strndup, it would stop at a NUL in the name */
+    summary->name_length = benc_node_length(node);
+    summary->name = g_malloc(summary->name_length + 1);
+    memcpy(summary->name, benc_node_data(node), summary->name_length);
+    summary->name[summary->name_length] = '\0';
+  }
+
+  node = benc_dict_get(torrent->info, "piece length");
+  summary->piece_length = (node != NULL)? benc_node_integer(node) : 0;
+
+  node = benc_dict_get(torrent->info, "files");
+  if(node == NULL) /* single file mode */
+  {
+    node = benc_dict_get(torrent->info, "length");
+    summary->size = (node != NULL)? benc_node_integer(node) : 0;
+    summary->n_files = 1;
+  }
+  else /* multi file mode */
+  {
+    for(node = benc_node_first_child(node); node != NULL;
+        node = benc_node_next_sibling(node))
+    {
+      value = benc_dict_get(node, "length");
+      summary->size += (value != NULL)? benc_node_integer(value) : 0;
+      summary->n_files++;
+    }
+  }
+
+  return;
+}
+
+/**
+ * @brief Print the summaries of a scan in the stdout. DON'T USE DIRECTLY.
+ *
+ * TSV: a line for each torrent (file, name, info hash, size, files, piece
+ * length, trackers separated by spaces, and "ok" or the error message).
+ * The line starting with '#' is the columns names.
+ *
+ * JSON: an object with the folder and an array of torrents with the
+ * same values ("trackers" is an array, "error" is only there if any).
+ *
+ * @param scan: the BatchScan.
+ * @param folder: the scanned folder.
+ * @param format: the output format.
+ */
+static void
+batch_scan_print(BatchScan *scan, const gchar *folder, BatchFormat format)
+{
+  BatchTorrent *summary;
+  GString *out;
+  guint i, j;
+
+  out = g_string_sized_new(4096);
+
+  if(format == BATCH_FORMAT_JSON)
+  {
+    g_string_append(out, "{\"folder\": \"");
+    batch_escape(out, folder, -1, TRUE);
+    g_string_append(out, "\", \"torrents\": [");
+  }
+  else
+    g_string_append(out, "#torrent\tname\tinfo_hash\tsize\tfiles\tpiece_length"
+                         "\ttrackers\tstatus\n");
+
+  for(i = 0; i < scan->n_torrents; i++)
+  {
+    summary = &scan->torrents[i];
+
+    if(format == BATCH_FORMAT_JSON)
+    {
+      g_string_append(out, (i == 0)? "\n  {\"torrent\": \"" : ",\n  {\"torrent\": \"");
+      batch_escape(out, summary->filename, -1, TRUE);
+      g_string_append(out, "\", \"name\": \"");
+      batch_escape(out, summary->name? summary->name : "", summary->name_length, TRUE);
+      g_string_append_printf(out, "\", \"info_hash\": \"%s\", \"size\": %"
+                             G_GINT64_FORMAT ", \"files\": %u, \"piece_length\": %"
+                             G_GINT64_FORMAT ", \"trackers\": [",
+                             summary->info_hash? summary->info_hash : "",
+                             summary->size, summary->n_files, summary->piece_length);
+      for(j = 0; summary->trackers != NULL && summary->trackers[j] != NULL; j++)
+      {
+        g_string_append(out, (j == 0)? "\"" : ", \"");
+        batch_escape(out, summary->trackers[j], -1, TRUE);
+        g_string_append_c(out, '"');
+      }
+      g_string_append_c(out, ']');
+      if(summary->error != NULL)
+      {
+        g_string_append(out, ", \"error\": \"");
+        batch_escape(out, summary->error, -1, TRUE);
+        g_string_append_c(out, '"');
+      }
+      g_string_append_c(out, '}');
+    }
+    else
+    {
+      batch_escape(out, summary->filename, -1, FALSE);
+      g_string_append_c(out, '\t');
+      batch_escape(out, summary->name? summary->name : "", summary->name_length, FALSE);
+      g_string_append_printf(out, "\t%s\t%" G_GINT64_FORMAT "\t%u\t%" G_GINT64_FORMAT "\t",
+                             summary->info_hash? summary->info_hash : "",
+                             summary->size, summary->n_files, summary->piece_length);
+      for(j = 0; summary->trackers != NULL && summary->trackers[j] != NULL; j++)
+      {
+        if(j > 0)
+          g_string_append_c(out, ' ');
+        batch_escape(out, summary->trackers[j], -1, FALSE);
+      }
+      g_string_append_c(out, '\t');
+      batch_escape(out, summary->error? summary->error : "ok", -1, FALSE);
+      g_string_append_c(out, '\n');
+    }
+
+    /* don't hold all the output of a big archive */
+    if(out->len > 65536)
+    {
+      fputs(out->str, stdout);
+      g_string_truncate(out, 0);
+    }
+  }
+
+  if(format == BATCH_FORMAT_JSON)
+    g_string_append_printf(out, "],\n \"n_torrents\": %u}\n", scan->n_torrents);
+
+  fputs(out->str, stdout);
+  fflush(stdout);
+  g_string_free(out, TRUE);
+  return;
+}
+
+/* END **********************************************************************/
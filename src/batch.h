@@ -0,0 +1,46 @@
+/**
+ * @file batch.h
+ *
+ * @brief header file for the command line (no display) modes.
+ */
+
+#ifndef _BATCH_H
+#define _BATCH_H
+
+/* INCLUDES *****************************************************************/
+
+#include <glib.h>
+
+/* DEFINES ******************************************************************/
+
+#define BATCH_EXIT_OK        0 /* all the pieces (or torrents) are right */
+#define BATCH_EXIT_MISMATCH  1 /* bad pieces, missing files or torrents  */
+#define BATCH_EXIT_ERROR     2 /* nothing could be checked               */
+
+#define BATCH_MAX_WORKERS   64 /* max number of scan threads             */
+#define BATCH_SCAN_CHUNK    32 /* torrents taken at once by a scan thread */
+
+/* TYPEDEF ******************************************************************/
+
+/**
+ * @brief Output formats of the batch mode results.
+ */
+typedef enum
+{
+  BATCH_FORMAT_TSV,  /**< tab separated lines, one per file and a total */
+  BATCH_FORMAT_JSON  /**< one JSON object                              */
+} BatchFormat;
+
+/* PROTOTYPES ***************************************************************/
+
+G_BEGIN_DECLS
+
+gboolean batch_parse_format(const gchar *name, BatchFormat *format);
+gint     batch_verify(const gchar *torrent_file, const gchar *path,
+                      BatchFormat format, gboolean incremental,
+                      guint n_workers);
+gint     batch_scan(const gchar *folder, BatchFormat format, guint n_workers);
+
+G_END_DECLS
+
+#endif /* _BATCH_H */
@@ -34,29 +34,98 @@
 
 #include "bencode.h"
 
+/* TYPE DEFS ****************************************************************/
+
+/**
+ * @brief A chunk of memory of a BencArena.
+ */
+typedef struct _BencArenaChunk
+{
+  struct _BencArenaChunk *next; /**< the previously allocated chunk. */
+} BencArenaChunk;
+
+/**
+ * @brief A BencArena (bump allocator). @see benc_arena_new
+ */
+struct _BencArena
+{
+  BencArenaChunk *chunks; /**< list of chunks, the newest first.  */
+  char   *pos;            /**< first free byte of the newest chunk. */
+  char   *end;            /**< end of the newest chunk.             */
+  UINT32 chunk_size;      /**< default size of new chunks.          */
+};
+
+/**
+ * @brief An open list or dictionary in the decoder's parse stack.
+ */
+typedef struct
+{
+  BencNode *node;   /**< the list or dictionary node.                 */
+  BencNode *key;    /**< dictionary key that is waiting for a value.  */
+} BencDecodeFrame;
+
+/**
+ * @brief A BencDictIndex: open addressing hash table of the key nodes.
+ */
+struct _BencDictIndex
+{
+  UINT32   mask;       /**< number of slots - 1 (a power of 2 - 1). */
+  BencNode *slots[1];  /**< the key nodes, NULL if the slot is free. */
+};
+
+/**
+ * @brief State of benc_encode_stream.
+ */
+typedef struct
+{
+  BencWriteFunc func;      /**< the function that receives the data. */
+  void   *user_data;       /**< data passed to func.                 */
+  UINT32 fill;             /**< bytes waiting in the buffer.         */
+  UINT32 bytes;            /**< bytes passed to func.                */
+  char   buffer[BENC_STREAM_CHUNK]; /**< the buffer of small writes. */
+} BencStream;
+
+/* MACROS *******************************************************************/
+
+#define ARENA_ALIGN(n) (((n) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+
+#define DECODE_FILE_CHUNK 65536 /* bytes readed at once by benc_decode_file */
+
 /* PRIVATE FUNCTIONS ********************************************************/
 
 static BencNode* _benc_node_copy_sibling (BencNode* node, BencNode* parent);
 
-static BencNode* _benc_decode_buf_string (char* data, UINT32 length, UINT32 *bytes);
-static BencNode* _benc_decode_buf_int (char* data, UINT32 length, UINT32 *bytes);
-static BencNode* _benc_decode_buf_list (char* data, UINT32 length, UINT32 *bytes);
-static BencNode* _benc_decode_buf_dictionary (char *data, UINT32 length, UINT32 *bytes);
+static void*     _benc_arena_alloc (BencArena* arena, UINT32 size);
+static BencNode* _benc_node_alloc (BencArena* arena, BencType type, UINT32 length, char* data);
+static int       _benc_parse_integer (const char* data, UINT32 length, INT64* value);
+
+static BencNode* _benc_decode_buf_string (BencArena* arena, char* data, UINT32 length, UINT32 *bytes);
+static BencNode* _benc_decode_buf_int (BencArena* arena, char* data, UINT32 length, UINT32 *bytes);
+static void      _benc_decode_attach (BencDecodeFrame* frame, BencNode* node);
+
+static UINT32    _benc_dict_hash (const char* key, UINT32 length);
+static void      _benc_dict_index_build (BencArena* arena, BencNode* dict, UINT32 number);
+static void      _benc_node_array_build (BencArena* arena, BencNode* node);
+static void      _benc_node_drop_caches (BencNode* node);
+static void      _benc_node_renumber (BencNode* node, UINT32 position);
+static void      _benc_node_free_tree (BencNode* node);
 
-static BencNode* _benc_decode_file_string (FILE *fp);
-static BencNode* _benc_decode_file_int (FILE *fp);
-static BencNode* _benc_decode_file_list (FILE *fp);
-static BencNode* _benc_decode_file_dictionary (FILE *fp);
+static char*     _benc_encode_write (BencNode* tree, char* p);
+static UINT32    _benc_digits (UINT32 number);
+
+static void      _benc_encode_stream_node (BencStream* stream, BencNode* tree);
+static void      _benc_stream_write (BencStream* stream, const char* data, UINT32 length);
+static void      _benc_stream_flush (BencStream* stream);
 
 /* FUNCTIONS ****************************************************************/
 
 /**
  * @brief Decode bencode data from buffer to a Tree (BencNode)
  *
- * numbers are saved as string, no like numbers, so convertion is 
- * necesary when you need the data. The data field of list and
- * dictionary types are the number of childrens saved as string like
- * everything else.
+ * integers are validated and parsed once (@see benc_node_integer), the
+ * data keeps their text. Lists and dictionaries have no data, the number
+ * of children is benc_node_n_children. Lists and dictionaries can be
+ * nested up to BENC_MAX_DEPTH levels. @see benc_decode_buf_full
  *
  * @param data: bencode data.
  * @param length: the length of the bencode data
@@ -66,33 +135,227 @@ static BencNode* _benc_decode_file_dictionary (FILE *fp);
 BencNode*
 benc_decode_buf (char* data, UINT32 length, UINT32 *bytes)
 {
-  UINT32 bytes_counter;
-  BencNode *tree = NULL;
+  return benc_decode_buf_full (NULL, data, length, bytes, BENC_MAX_DEPTH);
+}
+
+/**
+ * @brief Decode bencode data from buffer to a Tree (BencNode) allocated
+ *        inside of a BencArena.
+ *
+ * Like benc_decode_buf, but the nodes are carved from the arena and the
+ * data of strings, keys and integers is NOT copied: it points directly
+ * inside of the data buffer and it is NOT NULL terminated, so use
+ * benc_node_length (or benc_node_integer). The buffer must live as long
+ * as the tree. The tree is read only and it is freed with
+ * benc_arena_destroy, all the nodes at once.
+ *
+ * @param arena: the BencArena where the nodes are allocated.
+ * @param data: bencode data.
+ * @param length: the length of the bencode data
+ * @param bytes: return the number of bytes readed from buffer (can be NULL)
+ * @return a pointer to the BencNode tree, or NULL if the data is invalid.
+ */
+BencNode*
+benc_decode_buf_arena (BencArena* arena, char* data, UINT32 length, UINT32 *bytes)
+{
+  if(arena == NULL)
+    return NULL;
+
+  return benc_decode_buf_full (arena, data, length, bytes, BENC_MAX_DEPTH);
+}
+
+/**
+ * @brief Decode bencode data from buffer with a limit of nested levels.
+ *
+ * The decoder is not recursive, it is a stack machine with a parse stack
+ * of max_depth levels allocated at once, so hostile data can't overflow
+ * the thread's stack and it is rejected in linear time. Every node
+ * records the range of data it was decoded from (@see benc_node_span).
+ *
+ * @param arena: the BencArena for the nodes, or NULL to use malloc
+ *               (@see benc_decode_buf_arena).
+ * @param data: bencode data.
+ * @param length: the length of the bencode data
+ * @param bytes: return the number of bytes readed from buffer (can be NULL)
+ * @param max_depth: max number of nested lists and dictionaries.
+ * @return a pointer to the BencNode tree, or NULL if the data is invalid
+ *         or too deep.
+ */
+BencNode*
+benc_decode_buf_full (BencArena* arena, char* data, UINT32 length, UINT32 *bytes,
+                      UINT32 max_depth)
+{
+  BencDecodeFrame *stack, *frame;
+  BencNode *root, *node;
+  UINT32 pos, depth, bytes_counter;
+  BencType type;
+  int done;
+
+  if(bytes != NULL)
+    *bytes = 0;
 
   if(data == NULL || length == 0) 
     return NULL;
 
+  stack = NULL;
+  if(max_depth > 0)
+  {
+    stack = (BencDecodeFrame *)malloc(sizeof(BencDecodeFrame)*max_depth);
+    if(stack == NULL)
+      return NULL;
+  }
+
+  root = NULL;
+  frame = NULL;
+  done = 0;
+
   /* this do all the job */
-  switch (data[0])
+  for(pos = 0, depth = 0; pos < length; )
   {
-    case 'd':			/* dictionary */
-      tree = _benc_decode_buf_dictionary (data, length, &bytes_counter);
-      break;
-    case 'l':			/* list */
-      tree = _benc_decode_buf_list (data, length, &bytes_counter);
+    if(frame != NULL && data[pos] == 'e')  /* end of list or dictionary */
+    {
+      if(frame->key != NULL)               /* a key without value */
+        break;
+
+      if(benc_node_type(frame->node) == BENC_TYPE_DICTIONARY
+         && benc_node_n_children(frame->node) >= BENC_DICT_INDEX_MIN)
+        _benc_dict_index_build (arena, frame->node, benc_node_n_children(frame->node));
+      if(arena != NULL && benc_node_n_children(frame->node) > 1)
+        _benc_node_array_build (arena, frame->node);
+      pos++;
+      frame->node->span = pos - benc_node_offset(frame->node);
+
+      if(--depth == 0)
+      {
+        done = 1;
+        break;
+      }
+
+      frame = &stack[depth-1];
+      continue;
+    }
+
+    node = NULL;
+    bytes_counter = 0;
+
+    if(frame != NULL && benc_node_type(frame->node) == BENC_TYPE_DICTIONARY
+       && frame->key == NULL)
+    {
+      if(data[pos] == 'i')
+        node = _benc_decode_buf_int (arena, data+pos, length-pos, &bytes_counter);
+      else if(isdigit((unsigned char)data[pos]))
+        node = _benc_decode_buf_string (arena, data+pos, length-pos, &bytes_counter);
+
+      if(node == NULL)
+        break;
+
+      node->type = BENC_TYPE_KEY;
+      node->offset = pos;
+      node->span = bytes_counter;
+      _benc_decode_attach (frame, node);
+      pos += bytes_counter;
+      continue;
+    }
+
+    switch (data[pos])
+    {
+      case 'd':			/* dictionary */
+      case 'l':			/* list */
+        if(depth >= max_depth)
+          break;
+
+        type = (data[pos] == 'd')? BENC_TYPE_DICTIONARY : BENC_TYPE_LIST;
+        node = _benc_node_alloc (arena, type, 0, NULL);
+        bytes_counter = 1;
+        break;
+      case 'i':			/* integer */
+        node = _benc_decode_buf_int (arena, data+pos, length-pos, &bytes_counter);
+        break;
+      default:      /* string? */
+        if(isdigit((unsigned char)data[pos]))
+          node = _benc_decode_buf_string (arena, data+pos, length-pos, &bytes_counter);
+    }
+
+    if(node == NULL)
       break;
-    case 'i':			/* integer */
-      tree = _benc_decode_buf_int (data, length, &bytes_counter);
+
+    node->offset = pos;
+    node->span = bytes_counter;  /* lists and dictionaries: set at the 'e' */
+
+    if(frame == NULL)
+      root = node;
+    else
+      _benc_decode_attach (frame, node);
+
+    pos += bytes_counter;
+
+    if(benc_node_type(node) == BENC_TYPE_LIST 
+       || benc_node_type(node) == BENC_TYPE_DICTIONARY)
+    {
+      frame = &stack[depth++];
+      frame->node = node;
+      frame->key = NULL;
+    }
+    else if(frame == NULL)  /* just a integer or string */
+    {
+      done = 1;
       break;
-    default:      /* string? */
-      if(isdigit(data[0]))
-        tree = _benc_decode_buf_string (data, length, &bytes_counter);
+    }
+  }
+
+  free(stack);
+
+  /* error: the data is invalid, truncated or too deep */
+  if(!done)
+  {
+    if(arena == NULL)
+      benc_node_destroy(root);
+    return NULL;
   }
 
   if(bytes != NULL)
-    *bytes = bytes_counter;
+    *bytes = pos;
   
-  return tree;
+  return root;
+}
+
+/**
+ * @brief Append a decoded node to the open list or dictionary.
+ *
+ * DON'T USE DIRECTLY. In a dictionary, keys are appended as children 
+ * and values as the child of the key waiting for it.
+ *
+ * @param frame: the open list or dictionary.
+ * @param node: the decoded node.
+ */
+static void
+_benc_decode_attach (BencDecodeFrame* frame, BencNode* node)
+{
+  if(frame->key != NULL)
+  {
+    node->parent = frame->key;
+    node->position = 0;
+    frame->key->children = node;
+    frame->key->last = node;
+    frame->key->count = 1;
+    frame->key = NULL;
+    return;
+  }
+
+  /* append after the last one, don't walk the siblings each time */
+  node->parent = frame->node;
+  node->position = frame->node->count;
+  if(frame->node->last == NULL)
+    frame->node->children = node;
+  else
+    frame->node->last->next = node;
+  frame->node->last = node;
+  frame->node->count++;
+
+  if(benc_node_type(node) == BENC_TYPE_KEY)
+    frame->key = node;
+
+  return;
 }
 
 /**
@@ -100,30 +363,29 @@ benc_decode_buf (char* data, UINT32 length, UINT32 *bytes)
  *
  * DON'T USE DIRECTLY. use benc_decode_buf instead.
  *
+ * @param arena: the BencArena for the node, or NULL to use malloc.
  * @param data: the bencode string.
  * @param length: the length of the data
  * @param bytes: return the bytes readed from the data buffer.
  * @return a pointer to a new allocated BencNode with the string.
  */
 static BencNode*
-_benc_decode_buf_string (char* data, UINT32 length, UINT32 *bytes)
+_benc_decode_buf_string (BencArena* arena, char* data, UINT32 length, UINT32 *bytes)
 {
-  BencNode *new;
-  char *begin;
-  UINT32 l;
+  UINT32 l, i;
 
-  l = strtol(data, &begin, 10); 
-  
-  if(*begin != ':' || l >= (length - (int)(begin-data)))
+  for(i = 0, l = 0; i < length && isdigit((unsigned char)data[i]); i++)
   {
-    *bytes = 0;
-    return NULL;
+    if(l > (length - (unsigned)(data[i]-'0'))/10) /* it can't be so long */
+      return NULL;
+    l = l*10 + (data[i]-'0');
   }
   
-  new = benc_node_new(BENC_TYPE_STRING, l, begin+1);
-  *bytes = l + (int)(begin-data) + 1;
+  if(i == 0 || i >= length || data[i] != ':' || l > length - i - 1)
+    return NULL;
   
-  return new;  
+  *bytes = l + i + 1;
+  return _benc_node_alloc(arena, BENC_TYPE_STRING, l, data+i+1);
 }
 
 /**
@@ -131,139 +393,227 @@ _benc_decode_buf_string (char* data, UINT32 length, UINT32 *bytes)
  *
  * DON'T USE DIRECTLY. use benc_decode_buf instead.
  *
+ * @param arena: the BencArena for the node, or NULL to use malloc.
  * @param data: the bencode integer.
  * @param length: the length of the data
  * @param bytes: return the bytes readed from the data buffer.
- * @return a pointer to a new allocated BencNode with the number as string.
+ * @return a pointer to a new allocated BencNode with the number, NULL if
+ *         it is invalid or it doesn't fit in 64 bits.
  */
 static BencNode*
-_benc_decode_buf_int (char* data, UINT32 length, UINT32 *bytes)
+_benc_decode_buf_int (BencArena* arena, char* data, UINT32 length, UINT32 *bytes)
 {
-  BencNode *new;
-  char *end;
-  UINT32  l;
+  BencNode *node;
+  INT64 value;
+  UINT32 i;
 
-  end = memchr(data, 'e', length);  
+  i = (length > 1 && data[1] == '-')? 2 : 1;
+  for( ; i < length && isdigit((unsigned char)data[i]); i++);
   
-  if((l = end-data-1) < 1)
+  if(i >= length || data[i] != 'e')
+    return NULL;
+
+  if(!_benc_parse_integer(data+1, i-1, &value))
     return NULL;
   
-  new = benc_node_new(BENC_TYPE_INTEGER, l, data+1);
-  
-  *bytes = l + 2;
-  return new;
+  node = _benc_node_alloc(arena, BENC_TYPE_INTEGER, i-1, data+1);
+  if(node == NULL)
+    return NULL;
+
+  node->integer = value;
+  *bytes = i + 1;
+  return node;
 }
 
 /**
- * @brief decode a bencoded list 
+ * @brief parse the text of an integer.
  *
- * DON'T USE DIRECTLY. use benc_decode_buf instead.
+ * DON'T USE DIRECTLY.
  *
- * @param data: the bencode list.
- * @param length: the length of the data
- * @param bytes: return the bytes readed from the data buffer.
- * @return a pointer to a new allocated BencNode tree of the list.
+ * @param data: the digits, with an optional '-' before them.
+ * @param length: the length of data.
+ * @param value: return the number (not changed if fail).
+ * @return 1 if it is a valid number that fits in a INT64, 0 otherwise.
+ */
+static int
+_benc_parse_integer (const char* data, UINT32 length, INT64* value)
+{
+  unsigned long long number, limit;
+  UINT32 i, negative;
+
+  negative = (length > 0 && data[0] == '-');
+  limit = (unsigned long long)LLONG_MAX + negative;
+
+  for(i = negative, number = 0; i < length && isdigit((unsigned char)data[i]); i++)
+  {
+    if(number > (limit - (unsigned)(data[i]-'0'))/10) /* overflow */
+      return 0;
+    number = number*10 + (data[i]-'0');
+  }
+
+  if(i == negative || i != length)
+    return 0;
+
+  if(negative && number > 0)
+    *value = -(INT64)(number-1) - 1;
+  else
+    *value = (INT64)number;
+
+  return 1;
+}
+
+/**
+ * @brief Allocate a node for the decoders.
+ *
+ * DON'T USE DIRECTLY. Without arena it is the same as benc_node_new. With
+ * arena strings, keys and integers point to data (no copy), lists and
+ * dictionaries have an empty data.
+ *
+ * @param arena: the BencArena, or NULL to use malloc.
+ * @param type: the node's type.
+ * @param length: the data's length.
+ * @param data: the data.
+ * @return a pointer to the node.
  */
 static BencNode*
-_benc_decode_buf_list (char *data, UINT32 length, UINT32 *bytes)
+_benc_node_alloc (BencArena* arena, BencType type, UINT32 length, char* data)
 {
-  BencNode *root, *node;
-  UINT32 counter, bytes_counter, number;
-  char new_data[MAXDIGIT+1];
+  BencNode *node;
 
-  root = benc_node_new (BENC_TYPE_LIST, 1, "0");
-  
-  for(counter = 1, number = 0; data[counter] != 'e' && counter < length;
-      counter += bytes_counter, number++)
+  if(arena == NULL)
+    return benc_node_new(type, length, data);
+
+  if(type == BENC_TYPE_LIST || type == BENC_TYPE_DICTIONARY)
   {
-    node = benc_decode_buf(data+counter, length-counter, &bytes_counter);
-        
-    if(node == NULL || bytes_counter == 0)
-    {
-      *bytes = 0;
-      benc_node_destroy(root);
+    node = _benc_arena_alloc(arena, sizeof(BencNode)+1);
+    if(node == NULL)
       return NULL;
-    }
-    
-    benc_node_append(root, node); 
+    node->data = (char *)(node+1);
+    node->data[0] = '\0';
+    length = 0;
+  }
+  else
+  {
+    node = _benc_arena_alloc(arena, sizeof(BencNode));
+    if(node == NULL)
+      return NULL;
+    node->data = data;
   }
 
-  *bytes = counter+1;
-  sprintf(new_data, "%i", number);
-  root = benc_node_change (&root, benc_node_type(root), strlen(new_data), new_data);  
-  
-  return root;  
+  node->type = type;
+  node->length = length;
+  node->flags = BENC_NODE_ARENA;
+  node->integer = 0;
+  node->offset = 0;
+  node->span = 0;
+  node->position = 0;
+  node->index = NULL;
+  node->parent = NULL;  
+  node->next = NULL;
+  node->children = NULL;
+  node->last = NULL;
+  node->array = NULL;
+  node->count = 0;
+
+  return node;
 }
 
 /**
- * @brief decode a bencoded dictionary
+ * @brief Create a new BencArena.
  *
- * DON'T USE DIRECTLY. use benc_decode_buf instead.
- *
- * @param data: the bencode  dictionary.
- * @param length: the length of the data
- * @param bytes: return the bytes readed from the data buffer.
- * @return a pointer to a new allocated BencNode tree of the dictionary.
+ * @param chunk_size: the size of each chunk of memory, use 0 for
+ *                    the default (BENC_ARENA_DEFAULT_CHUNK). Using about
+ *                    the size of the bencode data saves allocations.
+ * @return a pointer to a new BencArena. @see benc_arena_destroy
  */
+BencArena*
+benc_arena_new (UINT32 chunk_size)
+{
+  BencArena *arena;
 
-static BencNode*
-_benc_decode_buf_dictionary (char *data, UINT32 length, UINT32 *bytes)
+  arena = (BencArena *)malloc(sizeof(BencArena));
+  if(arena == NULL)
+    return NULL;
+
+  arena->chunks = NULL;
+  arena->pos = NULL;
+  arena->end = NULL;
+  arena->chunk_size = (chunk_size != 0)? chunk_size : BENC_ARENA_DEFAULT_CHUNK;
+
+  return arena;
+}
+
+/**
+ * @brief Free a BencArena and all the nodes allocated in it at once.
+ *
+ * @param arena: the BencArena to destroy (can be NULL).
+ */
+void
+benc_arena_destroy (BencArena* arena)
 {
-  BencNode *root, *key, *node;
-  UINT32 counter, bytes_counter, number;
-  char new_data[MAXDIGIT+1];
+  BencArenaChunk *chunk, *next;
 
-  root = benc_node_new (BENC_TYPE_DICTIONARY, 1, "0");
-  
-  for(counter = 1, number = 0; data[counter] != 'e' && counter < length;
-      counter += bytes_counter, number++)
+  if(arena == NULL)
+    return;
+
+  for(chunk = arena->chunks; chunk != NULL; chunk = next)
   {
-    key = NULL;
+    next = chunk->next;
+    free(chunk);
+  }
 
-    if(data[counter] == 'i')
-    {
-      key = _benc_decode_buf_int (data+counter,
-                            length-counter, &bytes_counter);
-    }
-    else if(isdigit(data[counter]))
-    {
-      key = _benc_decode_buf_string (data+counter,
-                            length-counter, &bytes_counter);
-    }
+  free(arena);
+  return;
+}
 
-    if(key != NULL)
-    {        
-      key->type = BENC_TYPE_KEY;
-      counter += bytes_counter;
-        
-      node = benc_decode_buf(data+counter, length-counter, &bytes_counter);
-    }
+/**
+ * @brief Get memory from a BencArena.
+ *
+ * DON'T USE DIRECTLY. The memory is aligned to the pointer size. If 
+ * the newest chunk is exhausted a new one is allocated.
+ *
+ * @param arena: the BencArena.
+ * @param size: the number of bytes.
+ * @return a pointer to the memory, or NULL if out of memory.
+ */
+static void*
+_benc_arena_alloc (BencArena* arena, UINT32 size)
+{
+  BencArenaChunk *chunk;
+  size_t chunk_size;
+  void *mem;
 
-    if(key == NULL || node == NULL)
-    {
-      *bytes = 0;
-      benc_node_destroy(root);
+  if((UINT32)ARENA_ALIGN(size) < size) /* too big to be aligned */
+    return NULL;
+
+  size = ARENA_ALIGN(size);
+
+  if(arena->pos == NULL || (size_t)(arena->end - arena->pos) < size)
+  {
+    chunk_size = (size > arena->chunk_size)? size : arena->chunk_size;
+    chunk = (BencArenaChunk *)malloc(ARENA_ALIGN(sizeof(BencArenaChunk)) + chunk_size);
+    if(chunk == NULL)
       return NULL;
-    }
-    
-    benc_node_append(key, node);
-    benc_node_append(root, key); 
+
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->pos = (char *)chunk + ARENA_ALIGN(sizeof(BencArenaChunk));
+    arena->end = arena->pos + chunk_size;
   }
 
-  *bytes = counter+1;
-  sprintf(new_data, "%i", number);
-  root = benc_node_change(&root, benc_node_type(root), strlen(new_data), new_data);  
-  
-  return root;  
+  mem = arena->pos;
+  arena->pos += size;
+
+  return mem;
 }
   
 /**
  * @brief Decode bencode data from file to a Tree (BencNode)
  *
- * numbers are saved as string, no like numbers, so convertion is 
- * necesary when you need the data. The data field of list and
- * dictionary types are the number of childrens saved as string like
- * everything else.
+ * integers are parsed once (@see benc_node_integer), lists and
+ * dictionaries have no data. The rest of the file is readed and decoded with 
+ * benc_decode_buf, the bytes after the bencoded data are given back
+ * to the stream when it is seekable.
  *
  * @param fp: FILE pointer.
  * @return a pointer to a new allocated BencNode tree.
@@ -271,338 +621,385 @@ _benc_decode_buf_dictionary (char *data, UINT32 length, UINT32 *bytes)
 BencNode*
 benc_decode_file (FILE* fp)
 {
-  BencNode *tree = NULL;
-  char c;
+  BencNode *tree;
+  char *buff, *tmp;
+  size_t length, size, readed;
+  UINT32 bytes;
   
   if(fp == NULL || feof(fp)) 
     return NULL;
 
-  /* this do all the job */
-  c = fgetc(fp);
-  switch (c)
+  buff = NULL;
+  length = 0;
+  size = 0;
+
+  do
   {
-    case 'd':			/* dictionary */
-      tree = _benc_decode_file_dictionary (fp);
-      break;
-    case 'l':			/* list */
-      tree = _benc_decode_file_list (fp);
-      break;
-    case 'i':			/* integer */
-      tree = _benc_decode_file_int (fp);
-      break;
-    default:      /* string? */
-      ungetc (c, fp);    
-      if(isdigit(c))
-        tree = _benc_decode_file_string (fp);
-  }
+    if(size - length < DECODE_FILE_CHUNK)
+    {
+      size = (size == 0)? DECODE_FILE_CHUNK : size*2;
+      if(size > 0xFFFFFFFFu || (tmp = realloc(buff, size)) == NULL)
+      {
+        free(buff);
+        return NULL;
+      }
+      buff = tmp;
+    }
+
+    readed = fread(buff+length, sizeof(char), size-length, fp);
+    length += readed;
+  } while(readed > 0);
+
+  tree = benc_decode_buf(buff, (UINT32)length, &bytes);
+
+  if(tree != NULL && bytes < length)
+    fseek(fp, -(long)(length-bytes), SEEK_CUR);
 
+  free(buff);
   return tree;
 }
 
+
 /**
- * @brief decode a bencoded string from a file
- *
- * DON'T USE DIRECTLY. use benc_decode_file instead.
+ * @brief Encode a tree (BencNode) to a bencode meta file.
  *
- * @param fp: the FILE to read.
- * @return a pointer to a new allocated BencNode with the string.
+ * @param fp: the to write.
+ * @param tree: the tree to encode.
+ * @return the number of wrote bytes.
  */
-static BencNode*
-_benc_decode_file_string (FILE *fp)
+UINT32
+benc_encode_file (BencNode* tree, FILE* fp)
 {
-  BencNode *new;
-  char *buff;
-  char len[MAXDIGIT+1];  /* 10 is the max number of digit of a UINT32 */
-  UINT32 l;
-  unsigned short ok;
-  
-  for(l = 0, ok = 0; l < MAXDIGIT+1 && !feof(fp); l++)
+  BencNode *child;
+  UINT32 bytes;
+
+  if(tree == NULL)
+    return 0;
+
+  switch(benc_node_type(tree))
   {
-    len[l] = fgetc(fp);
-    if(len[l] == ':')
-    {
-      ok = 1;
+   case BENC_TYPE_INTEGER:
+      /* the data isn't NUL terminated (it's in the arena or the source) */
+      bytes = fprintf (fp, "i%.*se", (int)benc_node_length (tree), benc_node_data (tree));
       break;
-    }
-  }
-  
-  if(!ok)
-    return NULL;
-  
-  len[l] = '\0';
-  l = strtol(len, (char **)NULL, 10);
-
-  buff = malloc(l+1);
-  fread(buff, l, 1, fp);
-  
-  new = benc_node_new(BENC_TYPE_STRING, l, buff);
+   case BENC_TYPE_STRING:
+      bytes  = fprintf (fp, "%i:", benc_node_length (tree));   
+      bytes += fwrite (benc_node_data (tree), sizeof(char), benc_node_length (tree), fp);
+      break;
+   case BENC_TYPE_KEY:
+      bytes  = fprintf (fp, "%i:", benc_node_length (tree));   
+      bytes += fwrite(benc_node_data (tree), sizeof(char), benc_node_length (tree), fp);
+      bytes += benc_encode_file (benc_node_first_child(tree), fp);
+      break;
+   case BENC_TYPE_LIST:
+   case BENC_TYPE_DICTIONARY:
+      bytes = fprintf(fp, "%c", (benc_node_type (tree) == BENC_TYPE_LIST)? 'l' : 'd');
+      for(child = benc_node_first_child (tree); child != NULL;
+          child = benc_node_next_sibling (child))
+      {
+        bytes += benc_encode_file (child, fp);
+      } 
+      bytes += fprintf(fp, "%c", 'e');
+      break;
+   case BENC_TYPE_ALL:
+   default:
+      bytes = 0;      
+  }    
 
-  free(buff);   
-  return new;  
+  return bytes;
 }
 
 /**
- * @brief decode a bencoded integer from a file
+ * @brief Encode a tree (BencNode) to a bencode buffer.
  *
- * DON'T USE DIRECTLY. use benc_decode_file instead.
+ * The encoded size is computed first (@see benc_encode_size) so the 
+ * data is wrote in just one allocation, in linear time.
  *
- * @param fp: the FILE to read.
- * @return a pointer to a new allocated BencNode with the number as string.
+ * @param tree: the tree to encode.
+ * @param bytes: return the length of the buffer.
+ * @return a pointer to a new allocated buffer.
  */
-static BencNode*
-_benc_decode_file_int (FILE *fp)
+char*
+benc_encode_buf (BencNode *tree, UINT32 *bytes)
 {
-  BencNode *new;
-  char number[MAXDIGIT+1];
-  unsigned short l, ok;
+  char *string;
+  UINT32 size;
 
-  for(l = 0, ok = 0; l < MAXDIGIT+1 && !feof(fp); l++)
-  {
-    number[l] = fgetc(fp);
-    if(number[l] == 'e')
-    {
-      ok = 1;
-      break;
-    }
-  }
+  *bytes = 0;
   
-  if(!ok)
+  if(tree == NULL || (size = benc_encode_size (tree)) == 0)
     return NULL;
-  
-  new = benc_node_new(BENC_TYPE_INTEGER, l, number);
-  
-  return new;
+
+  /* one more byte, like benc_node_new the data is NULL terminated */
+  string = malloc (size + 1);
+  if(string == NULL)
+    return NULL;
+
+  *bytes = benc_encode_to_buf (tree, string, size);
+  string[size] = '\0';
+
+  return string;
 }
 
 /**
- * @brief decode a bencoded list from a file
- *
- * DON'T USE DIRECTLY. use benc_decode_file instead.
+ * @brief Compute the length of a tree (BencNode) encoded in bencode.
  *
- * @param fp: the FILE to read.
- * @return a pointer to a new allocated BencNode tree of the list.
+ * @param tree: the tree to encode.
+ * @return the number of bytes needed by benc_encode_to_buf.
  */
-static BencNode*
-_benc_decode_file_list (FILE *fp)
+UINT32
+benc_encode_size (BencNode *tree)
 {
-  BencNode *root, *node;
-  UINT32 number;
-  char new_data[MAXDIGIT+1], c;
+  BencNode *child;
+  UINT32 size;
 
-  if(feof(fp))
-    return NULL;
-  
-  root = benc_node_new (BENC_TYPE_LIST, 1, "0");
-  
-  for(c = fgetc(fp), number = 0; c != 'e' && !feof(fp); c = fgetc(fp), number++)
+  if(tree == NULL)
+    return 0;
+
+  switch(benc_node_type(tree))
   {
-    ungetc(c, fp);
-    
-    node = benc_decode_file(fp);
-        
-    if(node == NULL)
-    {
-      benc_node_destroy(root);
-      return NULL;
-    }
-    
-    benc_node_append(root, node); 
-  }
+   case BENC_TYPE_INTEGER:
+      size = benc_node_length (tree) + 2;
+      break;
+   case BENC_TYPE_STRING:
+      size = _benc_digits (benc_node_length (tree)) + 1 + benc_node_length (tree);
+      break;
+   case BENC_TYPE_KEY:
+      size  = _benc_digits (benc_node_length (tree)) + 1 + benc_node_length (tree);
+      size += benc_encode_size (benc_node_first_child (tree));
+      break;
+   case BENC_TYPE_LIST:
+   case BENC_TYPE_DICTIONARY:
+      size = 2;
+      for(child = benc_node_first_child (tree); child != NULL;
+          child = benc_node_next_sibling (child))
+      {
+        size += benc_encode_size (child);
+      } 
+      break;
+   case BENC_TYPE_ALL:
+   default:
+      size = 0;      
+  }    
 
-  sprintf(new_data, "%i", number);
-  root = benc_node_change (&root, benc_node_type(root), strlen(new_data), new_data);  
-  
-  return root;  
+  return size;
 }
 
 /**
- * @brief decode a bencoded dictionary from a file
- *
- * DON'T USE DIRECTLY. use benc_decode_file instead.
+ * @brief Encode a tree (BencNode) to a caller supplied buffer.
  *
- * @param fp: the FILE to read.
- * @return a pointer to a new allocated BencNode tree of the dictionary.
+ * @param tree: the tree to encode.
+ * @param buf: the buffer.
+ * @param size: the size of the buffer.
+ * @return the number of wrote bytes, 0 if the buffer is too small.
+ *         The data is not NULL terminated.
  */
-static BencNode*
-_benc_decode_file_dictionary (FILE *fp)
+UINT32
+benc_encode_to_buf (BencNode *tree, char *buf, UINT32 size)
 {
-  BencNode *root, *node, *key;
-  UINT32 number;
-  char new_data[MAXDIGIT+1], c;
-
-  if(feof(fp))
-    return NULL;
-  
-  root = benc_node_new (BENC_TYPE_DICTIONARY, 1, "0");
-  
-  for(c = fgetc(fp), number = 0; c != 'e' && !feof(fp); c = fgetc(fp), number++)
-  {
-    key = NULL;
-
-    if(c == 'i')
-      key = _benc_decode_file_int (fp);
-    else if(isdigit(c))
-    {
-      ungetc(c, fp);
-      key = _benc_decode_file_string (fp);
-    }
-
-    if(key != NULL)
-    {        
-      key->type = BENC_TYPE_KEY;
-        
-      node = benc_decode_file(fp);
-    }
-        
-    if(key == NULL || node == NULL)
-    {
-      benc_node_destroy(root);
-      return NULL;
-    }
-    
-    benc_node_append(key, node);
-    benc_node_append(root, key); 
-  }
+  if(tree == NULL || buf == NULL || benc_encode_size (tree) > size)
+    return 0;
 
-  sprintf(new_data, "%i", number);
-  root = benc_node_change (&root, benc_node_type(root), strlen(new_data), new_data);  
-  
-  return root;  
+  return (UINT32)(_benc_encode_write (tree, buf) - buf);
 }
 
-
 /**
- * @brief Encode a tree (BencNode) to a bencode meta file.
+ * @brief Write a tree (BencNode) encoded in bencode.
+ *
+ * DON'T USE DIRECTLY. The buffer must have room for benc_encode_size 
+ * bytes.
  *
- * @param fp: the to write.
  * @param tree: the tree to encode.
- * @return the number of wrote bytes.
+ * @param p: where to write.
+ * @return a pointer to the byte after the last one wrote.
  */
-UINT32
-benc_encode_file (BencNode* tree, FILE* fp)
+static char*
+_benc_encode_write (BencNode *tree, char *p)
 {
   BencNode *child;
-  UINT32 bytes;
-
-  if(tree == NULL)
-    return 0;
 
   switch(benc_node_type(tree))
   {
    case BENC_TYPE_INTEGER:
-      bytes = fprintf (fp, "i%se", benc_node_data (tree));
+      *(p++) = 'i';
+      memmove (p, benc_node_data (tree), benc_node_length (tree));
+      p += benc_node_length (tree);
+      *(p++) = 'e';
       break;
    case BENC_TYPE_STRING:
-      bytes  = fprintf (fp, "%i:", benc_node_length (tree));   
-      bytes += fwrite (benc_node_data (tree), sizeof(char), benc_node_length (tree), fp);
-      break;
    case BENC_TYPE_KEY:
-      bytes  = fprintf (fp, "%i:", benc_node_length (tree));   
-      bytes += fwrite(benc_node_data (tree), sizeof(char), benc_node_length (tree), fp);
-      bytes += benc_encode_file (benc_node_first_child(tree), fp);
+      p += sprintf (p, "%u:", benc_node_length (tree));   
+      memmove (p, benc_node_data (tree), benc_node_length (tree));
+      p += benc_node_length (tree);
+
+      if(benc_node_type(tree) == BENC_TYPE_KEY && benc_node_first_child (tree) != NULL)
+        p = _benc_encode_write (benc_node_first_child (tree), p);
       break;
    case BENC_TYPE_LIST:
    case BENC_TYPE_DICTIONARY:
-      bytes = fprintf(fp, "%c", (benc_node_type (tree) == BENC_TYPE_LIST)? 'l' : 'd');
+      *(p++) = (benc_node_type (tree) == BENC_TYPE_LIST)? 'l' : 'd';
       for(child = benc_node_first_child (tree); child != NULL;
           child = benc_node_next_sibling (child))
       {
-        bytes += benc_encode_file (child, fp);
+        p = _benc_encode_write (child, p);
       } 
-      bytes += fprintf(fp, "%c", 'e');
+      *(p++) = 'e';
       break;
    case BENC_TYPE_ALL:
    default:
-      bytes = 0;      
+      break;
   }    
 
-  return bytes;
+  return p;
 }
 
 /**
- * @brief Encode a tree (BencNode) to a bencode buffer.
+ * @brief Encode a tree (BencNode) as a stream of chunks.
+ *
+ * The encoded data is passed to func in pieces of at most 
+ * BENC_STREAM_CHUNK bytes through a fixed buffer, long strings are
+ * passed directly without copy. No buffer of the full size is allocated
+ * at any time (useful to hash big trees).
  *
  * @param tree: the tree to encode.
- * @param bytes: return the length of the buffer.
- * @return a pointer to a new allocated buffer.
+ * @param func: the function that receives the encoded data.
+ * @param user_data: data passed to func.
+ * @return the number of encoded bytes.
  */
-char*
-benc_encode_buf (BencNode *tree, UINT32 *bytes)
+UINT32
+benc_encode_stream (BencNode *tree, BencWriteFunc func, void *user_data)
 {
-  BencNode *child;
-  char *string, *tmp, *tmp2;
-  UINT32 counter, counter2;
+  BencStream stream;
 
-  string = NULL;
-  
-  if(tree == NULL)
-    return NULL;
+  if(tree == NULL || func == NULL)
+    return 0;
+
+  stream.func = func;
+  stream.user_data = user_data;
+  stream.fill = 0;
+  stream.bytes = 0;
+
+  _benc_encode_stream_node (&stream, tree);
+  _benc_stream_flush (&stream);
+
+  return stream.bytes;
+}
+
+/**
+ * @brief Stream a tree (BencNode) encoded in bencode.
+ *
+ * DON'T USE DIRECTLY. use benc_encode_stream instead.
+ *
+ * @param stream: the BencStream.
+ * @param tree: the tree to encode.
+ */
+static void
+_benc_encode_stream_node (BencStream *stream, BencNode *tree)
+{
+  BencNode *child;
+  char prefix[MAXDIGIT+2];
 
   switch(benc_node_type(tree))
   {
    case BENC_TYPE_INTEGER:
-      string = malloc (benc_node_length(tree)+3);
-      *bytes = snprintf (string, benc_node_length(tree)+3, 
-                         "i%se", benc_node_data (tree));
+      _benc_stream_write (stream, "i", 1);
+      _benc_stream_write (stream, benc_node_data (tree), benc_node_length (tree));
+      _benc_stream_write (stream, "e", 1);
       break;
    case BENC_TYPE_STRING:
-      string = malloc (MAXDIGIT + 1 + benc_node_length (tree));
-      counter = sprintf (string, "%i:", benc_node_length (tree));   
-      memmove (string+counter, benc_node_data (tree), benc_node_length (tree));
-      *bytes = counter + benc_node_length (tree);
-      break;
    case BENC_TYPE_KEY:
-      tmp = malloc(MAXDIGIT+1+benc_node_length (tree));
-      counter = sprintf (tmp, "%i:", benc_node_length (tree));   
-   
-      memmove (tmp+counter, benc_node_data (tree), benc_node_length (tree));
-      counter += benc_node_length (tree);
-    
-      tmp2 = benc_encode_buf (benc_node_first_child(tree), &counter2);
-
-      if( tmp2 != NULL)
-      {        
-        string = malloc(counter + counter2);
-        memmove (string, tmp, counter);
-        memmove (string+counter, tmp2, counter2);
-        free (tmp2);
+      _benc_stream_write (stream, prefix, sprintf (prefix, "%u:", benc_node_length (tree)));
+      _benc_stream_write (stream, benc_node_data (tree), benc_node_length (tree));
 
-        *bytes = counter + counter2;
-      }
-   
-      free(tmp);
+      if(benc_node_type(tree) == BENC_TYPE_KEY && benc_node_first_child (tree) != NULL)
+        _benc_encode_stream_node (stream, benc_node_first_child (tree));
       break;
    case BENC_TYPE_LIST:
    case BENC_TYPE_DICTIONARY:
-      string = malloc(2);
-      string[0] = (benc_node_type (tree) == BENC_TYPE_LIST)? 'l' : 'd';
-      counter = 1;
-    
+      _benc_stream_write (stream, (benc_node_type (tree) == BENC_TYPE_LIST)? "l" : "d", 1);
       for(child = benc_node_first_child (tree); child != NULL;
           child = benc_node_next_sibling (child))
       {
-        tmp2 = benc_encode_buf (child, &counter2);
-        
-        tmp = malloc (counter + counter2 + 1);
-        memmove (tmp, string, counter);
-        memmove (tmp + counter, tmp2, counter2);
-        counter += counter2;
-        
-        free(tmp2);
-        free(string);
-        
-        string = tmp;
+        _benc_encode_stream_node (stream, child);
       } 
-      string[counter] = 'e';
-
-      *bytes = counter + 1;
+      _benc_stream_write (stream, "e", 1);
       break;
    case BENC_TYPE_ALL:
    default:
-       *bytes = 0;      
+      break;
   }    
 
-  return string;
+  return;
+}
+
+/**
+ * @brief Append data to a BencStream.
+ *
+ * DON'T USE DIRECTLY. Data that doesn't fit in the stream buffer is
+ * passed directly to the stream function.
+ *
+ * @param stream: the BencStream.
+ * @param data: the data.
+ * @param length: the length of the data.
+ */
+static void
+_benc_stream_write (BencStream *stream, const char *data, UINT32 length)
+{
+  if(stream->fill + length > BENC_STREAM_CHUNK)
+  {
+    _benc_stream_flush (stream);
+
+    if(length >= BENC_STREAM_CHUNK)
+    {
+      stream->func (data, length, stream->user_data);
+      stream->bytes += length;
+      return;
+    }
+  }
+
+  memmove (stream->buffer + stream->fill, data, length);
+  stream->fill += length;
+
+  return;
+}
+
+/**
+ * @brief Pass the buffered data of a BencStream to the stream function.
+ *
+ * DON'T USE DIRECTLY.
+ *
+ * @param stream: the BencStream.
+ */
+static void
+_benc_stream_flush (BencStream *stream)
+{
+  if(stream->fill > 0)
+  {
+    stream->func (stream->buffer, stream->fill, stream->user_data);
+    stream->bytes += stream->fill;
+    stream->fill = 0;
+  }
+
+  return;
+}
+
+/**
+ * @brief Count the decimal digits of a number.
+ *
+ * DON'T USE DIRECTLY.
+ *
+ * @param number: the number.
+ * @return the number of digits.
+ */
+static UINT32
+_benc_digits (UINT32 number)
+{
+  UINT32 digits;
+
+  for(digits = 1; number >= 10; number /= 10)
+    digits++;
+
+  return digits;
 }
 
 /**
@@ -623,17 +1020,33 @@ benc_node_new (BencType type, UINT32 length, char* data)
   BencNode *root;
 
   root = (BencNode *)malloc(sizeof(BencNode)+length+1);
+  if(root == NULL)
+    return NULL;
 
   root->type = type;
   root->length = length;
+  root->flags = 0;
+  root->offset = 0;
+  root->span = 0;
+  root->position = 0;
+  root->index = NULL;
   root->data = (char *)(root+1);  
   
-  memmove(root->data, data, length);
+  if(length > 0)
+    memmove(root->data, data, length);
   root->data[length] = '\0'; /* append a extra 0x0 to the end */
 
+  /* if the text is not a valid number the value is 0 */
+  root->integer = 0;
+  if(type == BENC_TYPE_INTEGER)
+    _benc_parse_integer(root->data, length, &root->integer);
+
   root->parent = NULL;  
   root->next = NULL;
   root->children = NULL;
+  root->last = NULL;
+  root->array = NULL;
+  root->count = 0;
   
   return root;
 }
@@ -643,13 +1056,13 @@ benc_node_new (BencType type, UINT32 length, char* data)
  *
  * Change the type and/or the data of a node. If length is 0
  * and data is NULL then is changed just the type. Node may change 
- * of memory address.
+ * of memory address. Nodes owned by a BencArena are read only.
  *
  * @param node: a pointer to the BencNode to change
  * @param type: the new type of the nodePop
  * @param length: the new data's length.
  * @param data: pointer to the new data.
- * @return a pointer to the node. 
+ * @return a pointer to the node. NULL if fail
  */
 BencNode*
 benc_node_change (BencNode** node, BencType type, UINT32 length, 
@@ -657,21 +1070,34 @@ benc_node_change (BencNode** node, BencType type, UINT32 length,
 {
   BencNode *new, *first;
 
+  if(benc_node_is_arena(*node))
+    return NULL;
+
+  /* the key may change or move, and the node may be no more a dictionary */
+  if((*node)->parent != NULL)
+    _benc_node_drop_caches ((*node)->parent);
+  _benc_node_drop_caches (*node);
+
   if(length > (*node)->length)
   {
     new = benc_node_new(type, length, data);
     new->parent = (*node)->parent;
     new->next = (*node)->next;
     new->children = (*node)->children;
+    new->last = (*node)->last;
+    new->count = (*node)->count;
+    new->offset = (*node)->offset;
+    new->position = (*node)->position;
 
-    for(first = benc_node_first_sibling(*node);
-        first->next != NULL && first->next != new->next; first = first->next)
+    if(new->parent != NULL)
     {
-      if(first->next == *node)
-      {
-        first->next = new;
-        break;
-      }
+      if(new->parent->children == *node)
+        new->parent->children = new;
+      else
+        benc_node_prev_sibling(*node)->next = new;
+
+      if(new->parent->last == *node)
+        new->parent->last = new;
     }
 
     for(first = benc_node_first_child(*node); first != NULL;
@@ -686,13 +1112,19 @@ benc_node_change (BencNode** node, BencType type, UINT32 length,
   else if(length == 0)
   {
     (*node)->type = type;
+    (*node)->span = 0;  /* it doesn't match the source anymore */
   }
   else
   {
     (*node)->type = type;
     (*node)->length = length;
+    (*node)->span = 0;
     memmove((*node)->data, data, length);
   }
+
+  (*node)->integer = 0;
+  if(type == BENC_TYPE_INTEGER)
+    _benc_parse_integer((*node)->data, (*node)->length, &(*node)->integer);
   
   return *node;  
 }
@@ -706,23 +1138,26 @@ benc_node_change (BencNode** node, BencType type, UINT32 length,
 BencNode*
 benc_node_copy (BencNode* node)
 {
-  BencNode *root;
+  BencNode *root, *child;
 
-  root = (BencNode *)malloc (sizeof(BencNode)+node->length);
+  /* benc_node_new, the data could be outside of the node (arena) */
+  root = benc_node_new (node->type, node->length, node->data);
 
   if(root == NULL) 
     return NULL;
   
-  memmove (root, node, sizeof(BencNode)+node->length);
-
-  root->parent = NULL;  
-  root->next = NULL;
-  
   if(node->children != NULL)
     root->children = _benc_node_copy_sibling (node->children, root);   
   else
     root->children = NULL;
 
+  for(child = root->children; child != NULL; child = child->next)
+  {
+    child->position = root->count;
+    root->last = child;
+    root->count++;
+  }
+
   return root;
 }
 
@@ -740,14 +1175,12 @@ benc_node_copy (BencNode* node)
 static BencNode*
 _benc_node_copy_sibling (BencNode* node, BencNode* parent)
 {
-  BencNode *first;
+  BencNode *first, *child;
 
   /* i was thinking recall 'first' -> 'this', but it's used by C++ */
-  first = (BencNode *)malloc (sizeof(BencNode)+node->length);
+  first = benc_node_new (node->type, node->length, node->data);
   if(first == NULL) 
     return NULL;
-  
-  memmove (first, node, sizeof(BencNode)+node->length);
 
   first->parent = parent;  
   
@@ -755,6 +1188,13 @@ _benc_node_copy_sibling (BencNode* node, BencNode* parent)
     first->children = _benc_node_copy_sibling (node->children, first);
   else
     first->children = NULL;
+
+  for(child = first->children; child != NULL; child = child->next)
+  {
+    child->position = first->count;
+    first->last = child;
+    first->count++;
+  }
   
   if(node->next != NULL)
     first->next = _benc_node_copy_sibling (node->next, parent);
@@ -780,10 +1220,11 @@ BencNode*
 benc_node_insert (BencNode* parent, int position, BencNode* node)
 {
   BencNode *children;
+  UINT32 index;
 
   if(parent == NULL || node == NULL || parent == node) 
     return NULL;
- 
+
   if(parent->children != NULL)
   {
     if(position < 0)
@@ -799,14 +1240,22 @@ benc_node_insert (BencNode* parent, int position, BencNode* node)
 
     node->next = children->next;
     children->next = node;
+    index = children->position + 1;
   }
   else
   {
     node->next = NULL;
     parent->children = node;
+    index = 0;
   }
 
+  if(node->next == NULL)
+    parent->last = node;
+
   node->parent = parent;
+  parent->count++;
+  _benc_node_renumber (node, index);
+  _benc_node_drop_caches (parent);
   
   return node;
 }
@@ -939,6 +1388,218 @@ BencNode* benc_node_find_key (BencNode* node, char* key)
   return (key_node->children);
 }
 
+/**
+ * @brief Get the value of a key of a dictionary.
+ *
+ * Unlike benc_node_find_key, just the keys of dict are searched, not
+ * the whole sub-tree. @see benc_dict_lookup
+ *
+ * @param dict: the BencNode dictionary (can be NULL).
+ * @param key: a NULL terminated KEY string.
+ * @return a pointer to the value node. NULL if no match.
+ */
+BencNode*
+benc_dict_get (BencNode* dict, const char* key)
+{
+  return benc_dict_lookup (dict, key, strlen(key));
+}
+
+/**
+ * @brief Get the value of a key (not NULL terminated) of a dictionary.
+ *
+ * Dictionaries with BENC_DICT_INDEX_MIN keys or more are indexed, at
+ * decode time or at the first lookup, so the search is O(1). The index
+ * is dropped when the dictionary is changed and rebuilt later.
+ *
+ * @param dict: the BencNode dictionary (can be NULL).
+ * @param key: the KEY data.
+ * @param length: the length of the key.
+ * @return a pointer to the value node. NULL if no match.
+ */
+BencNode*
+benc_dict_lookup (BencNode* dict, const char* key, UINT32 length)
+{
+  BencNode *node;
+  UINT32 i, number;
+
+  if(dict == NULL || benc_node_type(dict) != BENC_TYPE_DICTIONARY)
+    return NULL;
+
+  if(dict->index != NULL)
+  {
+    for(i = _benc_dict_hash(key, length) & dict->index->mask;
+        (node = dict->index->slots[i]) != NULL; i = (i+1) & dict->index->mask)
+    {
+      if(benc_node_length(node) == length
+         && memcmp(benc_node_data(node), key, length) == 0)
+        return node->children;
+    }
+
+    return NULL;
+  }
+
+  for(node = benc_node_first_child(dict), number = 0; node != NULL;
+      node = benc_node_next_sibling(node), number++)
+  {
+    if(benc_node_type(node) == BENC_TYPE_KEY && benc_node_length(node) == length
+       && memcmp(benc_node_data(node), key, length) == 0)
+      return node->children;
+  }
+
+  /* not found in a big dictionary, index it for the next time */
+  if(number >= BENC_DICT_INDEX_MIN && !benc_node_is_arena(dict))
+    _benc_dict_index_build (NULL, dict, number);
+
+  return NULL;
+}
+
+/**
+ * @brief hash function of the dictionaries keys (FNV-1a).
+ *
+ * DON'T USE DIRECTLY.
+ *
+ * @param key: the key data.
+ * @param length: the length of the key.
+ * @return the hash.
+ */
+static UINT32
+_benc_dict_hash (const char* key, UINT32 length)
+{
+  UINT32 hash, i;
+
+  for(i = 0, hash = 2166136261u; i < length; i++)
+    hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+
+  return hash;
+}
+
+/**
+ * @brief Build the keys index of a dictionary.
+ *
+ * DON'T USE DIRECTLY. If a key is repeated, the first one is indexed 
+ * (the same that a linear search finds). If there is no memory the
+ * dictionary is just not indexed.
+ *
+ * @param arena: the BencArena of dict, or NULL to use malloc.
+ * @param dict: the dictionary.
+ * @param number: the number of children of dict.
+ */
+static void
+_benc_dict_index_build (BencArena* arena, BencNode* dict, UINT32 number)
+{
+  BencDictIndex *index;
+  BencNode *node, *slot;
+  UINT32 size, i;
+  size_t bytes;
+
+  for(size = 2; size < number*2; size <<= 1);
+  bytes = sizeof(BencDictIndex) + (size-1)*sizeof(BencNode*);
+
+  if(arena != NULL)
+    index = (BencDictIndex*)_benc_arena_alloc(arena, bytes);
+  else
+    index = (BencDictIndex*)malloc(bytes);
+
+  if(index == NULL)
+    return;
+
+  index->mask = size - 1;
+  memset(index->slots, 0, size*sizeof(BencNode*));
+
+  for(node = benc_node_first_child(dict); node != NULL;
+      node = benc_node_next_sibling(node))
+  {
+    if(benc_node_type(node) != BENC_TYPE_KEY)
+      continue;
+
+    for(i = _benc_dict_hash(benc_node_data(node), benc_node_length(node)) & index->mask;
+        (slot = index->slots[i]) != NULL; i = (i+1) & index->mask)
+    {
+      if(benc_node_length(slot) == benc_node_length(node)
+         && memcmp(benc_node_data(slot), benc_node_data(node), benc_node_length(node)) == 0)
+        break;
+    }
+
+    if(slot == NULL)
+      index->slots[i] = node;
+  }
+
+  dict->index = index;
+  return;
+}
+
+/**
+ * @brief Build the children array of a node.
+ *
+ * DON'T USE DIRECTLY. @see benc_node_children. If there is no memory
+ * the node just has no array.
+ *
+ * @param arena: the BencArena of node, or NULL to use malloc.
+ * @param node: the BencNode.
+ */
+static void
+_benc_node_array_build (BencArena* arena, BencNode* node)
+{
+  BencNode **array, *child;
+  UINT32 i;
+
+  if(arena != NULL)
+    array = (BencNode**)_benc_arena_alloc(arena, node->count*sizeof(BencNode*));
+  else
+    array = (BencNode**)malloc(node->count*sizeof(BencNode*));
+
+  if(array == NULL)
+    return;
+
+  for(child = node->children, i = 0; child != NULL && i < node->count;
+      child = child->next, i++)
+    array[i] = child;
+
+  node->array = array;
+  return;
+}
+
+/**
+ * @brief Remove the keys index and the children array of a node 
+ *        (if it has them).
+ *
+ * DON'T USE DIRECTLY. It must be called when the children change.
+ *
+ * @param node: the BencNode.
+ */
+static void
+_benc_node_drop_caches (BencNode* node)
+{
+  /* the memory of arena nodes is freed by benc_arena_destroy */
+  if(!benc_node_is_arena(node))
+  {
+    free(node->index);
+    free(node->array);
+  }
+
+  node->index = NULL;
+  node->array = NULL;
+  return;
+}
+
+/**
+ * @brief Set the positions of a node and the siblings after it.
+ *
+ * DON'T USE DIRECTLY. It must be called when a child is inserted or
+ * removed, the siblings before it don't move.
+ *
+ * @param node: the first BencNode to number (can be NULL).
+ * @param position: the position of node.
+ */
+static void
+_benc_node_renumber (BencNode* node, UINT32 position)
+{
+  for(; node != NULL; node = node->next)
+    node->position = position++;
+
+  return;
+}
+
 /**
  * @brief Gets the last child of a BencNode.
  *
@@ -949,14 +1610,7 @@ BencNode* benc_node_find_key (BencNode* node, char* key)
 BencNode* 
 benc_node_last_child (BencNode* node)
 {
-  BencNode *child;
-  
-  if(node->children == NULL)
-    return NULL;
-  
-  for(child = node->children; child->next != NULL; child = child->next);
-  
-  return child;
+  return node->last;
 }
 
 /**
@@ -971,18 +1625,48 @@ benc_node_last_child (BencNode* node)
 BencNode* 
 benc_node_nth_child (BencNode* node, unsigned int n)
 {
-  BencNode *child;
+  BencNode *child, **array;
   unsigned int i;
 
-  if(node->children == NULL)
+  if(n >= benc_node_n_children(node))
     return NULL;
 
+  array = benc_node_children(node);
+  if(array != NULL)
+    return array[n];
+
   child = benc_node_first_child(node);
   for(i=0; i<n && child != NULL; i++, child = child->next);
 
   return child;
 }
 
+/**
+ * @brief Gets the children of a BencNode as an array.
+ *
+ * The array has benc_node_n_children(node) elements, it gives O(1) 
+ * access to any child. It belongs to the node (don't change or free it)
+ * and it is valid until the children of node change. Decoders with arena
+ * build it for every list and dictionary, for other nodes it is built
+ * at the first call.
+ *
+ * @param node: a BencNode (must not be NULL)
+ * @return the array of children. NULL if there is no memory, or if the
+ *         children of a node inside of an arena were changed.
+ */ 
+BencNode**
+benc_node_children (BencNode* node)
+{
+  /* one child or none: the children pointer is the array */
+  if(node->count <= 1)
+    return &node->children;
+
+  if(node->array == NULL && !benc_node_is_arena(node))
+    _benc_node_array_build (NULL, node);
+
+  return node->array;
+}
+
 /**
  * @brief Gets the first sibling of a BencNode. This could 
  *        possibly be the node itself.
@@ -1011,6 +1695,9 @@ benc_node_last_sibling (BencNode* node)
 {
   BencNode *last;
 
+  if(node->parent != NULL)
+    return benc_node_last_child(node->parent);
+
   for(last = node; last->next != NULL; last = last->next);
     
   return last;
@@ -1071,6 +1758,7 @@ benc_node_unlink (BencNode* node)
 
   if(!benc_node_is_root (node))
   {
+    prev = NULL;
     if(node != benc_node_first_sibling(node))
     {
       prev = benc_node_prev_sibling (node);
@@ -1079,8 +1767,15 @@ benc_node_unlink (BencNode* node)
     else
       (node->parent)->children = node->next;
 
+    if((node->parent)->last == node)
+      (node->parent)->last = prev;
+    (node->parent)->count--;
+    _benc_node_renumber (node->next, node->position);
+    _benc_node_drop_caches (node->parent);
+
     node->next = NULL;
     node->parent = NULL;
+    node->position = 0;
   }
 
   return node;
@@ -1100,10 +1795,35 @@ benc_node_destroy (BencNode* root)
     
   benc_node_unlink (root);
 
-  while (!benc_node_is_leaf (root))
-    benc_node_destroy (benc_node_first_child (root));
-  
-  free (root);
+  /* the memory belongs to the arena, see benc_arena_destroy */
+  if(benc_node_is_arena (root))
+    return;
+
+  _benc_node_free_tree (root);
+  return;
+}
+
+/**
+ * @brief Free a BencNode and its children, without unlinking them one
+ *        by one (that renumbers the siblings left each time).
+ *
+ * DON'T USE DIRECTLY. The node must be unlinked, @see benc_node_destroy.
+ *
+ * @param node: the root of the malloc'd tree to free.
+ */
+static void
+_benc_node_free_tree (BencNode* node)
+{
+  BencNode *child, *next;
+
+  for(child = node->children; child != NULL; child = next)
+  {
+    next = child->next;
+    _benc_node_free_tree (child);
+  }
+
+  _benc_node_drop_caches (node);
+  free (node);
   return;
 }
 
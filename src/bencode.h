@@ -17,10 +17,20 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 
 /* TYPE DEFS ****************************************************************/
 
 typedef unsigned int UINT32;
+typedef long long INT64;
+
+/**
+ * @brief Flags of a BencNode.
+ */
+typedef enum
+{
+  BENC_NODE_ARENA = 1 << 0  /**< node memory belongs to a BencArena */
+} BencNodeFlags;
 
 /**
  * @brief Enumeration of the posible BencNode types.
@@ -38,6 +48,11 @@ typedef enum
   BENC_TYPE_ALL          /**< all types (for search functions) */
 } BencType;
 
+/**
+ * @brief Hash index of the keys of a dictionary. @see benc_dict_lookup
+ */
+typedef struct _BencDictIndex BencDictIndex;
+
 /**
  * @brief Structure that define a node for decoded Bencode.
  *
@@ -50,13 +65,47 @@ typedef struct _BencNode
 {
   BencType     type;           /**< The node's type. @see BencType   */
   UINT32       length;         /**< The data's length.               */
+  UINT32       flags;          /**< BencNodeFlags.                   */
+  UINT32       offset;         /**< Source offset of the encoded node. */
+  UINT32       span;           /**< Source length of the encoded node. */
+  UINT32       position;       /**< Index among the parent's children. */
   char         *data;          /**< The data (not necesary a string) */
+  INT64        integer;        /**< The value of integer nodes.      */
+  BencDictIndex *index;        /**< Keys index (dictionaries) or NULL. */
 
   struct _BencNode *next;     /**< pointer to the next sibling.     */
   struct _BencNode *parent;   /**< pointer to the parent.           */
   struct _BencNode *children; /**< pointer to the first child.      */
+  struct _BencNode *last;     /**< pointer to the last child.       */
+  struct _BencNode **array;   /**< the children as array, or NULL.  */
+  UINT32           count;     /**< number of children.              */
 } BencNode;
 
+/**
+ * @brief Bump allocator holding the nodes of a tree decoded with
+ *        benc_decode_buf_arena.
+ *
+ * Nodes are carved from big chunks and released all together with
+ * benc_arena_destroy. DON'T USE benc_node_destroy to free them.
+ */
+typedef struct _BencArena BencArena;
+
+/**
+ * @brief Function that receives the data encoded by benc_encode_stream.
+ *
+ * @param data: a chunk of encoded data (valid just inside the call).
+ * @param length: the length of the chunk.
+ * @param user_data: the user data given to benc_encode_stream.
+ */
+typedef void (*BencWriteFunc) (const char* data, UINT32 length, void* user_data);
+
+/* DEFINES ******************************************************************/
+
+#define BENC_ARENA_DEFAULT_CHUNK  65536 /* default size of a BencArena chunk */
+#define BENC_MAX_DEPTH             256 /* default max nested lists/dictionaries */
+#define BENC_STREAM_CHUNK         4096 /* buffer size of benc_encode_stream */
+#define BENC_DICT_INDEX_MIN          8 /* dictionaries with less keys aren't indexed */
+
 /* MACROS *******************************************************************/
 
 /**
@@ -86,6 +135,48 @@ typedef struct _BencNode
  */ 
 #define benc_node_data(node)    ((const char*)((node)->data))
 
+/**
+ * @brief the offset of a decoded BencNode inside the decoded data.
+ *
+ * @param  node: a BencNode.
+ * @return the offset (UINT32). Meaningful just if benc_node_span isn't 0.
+ */ 
+#define benc_node_offset(node)  ((node)->offset)
+
+/**
+ * @brief the length of the original encoding of a decoded BencNode.
+ *
+ * The bytes [offset, offset+span) of the decoded data are exactly the
+ * node as it was read (even if it was not canonical). Nodes not created
+ * by a decoder or changed after decode have span 0.
+ *
+ * @param  node: a BencNode.
+ * @return the source length (UINT32), 0 if unknown.
+ */ 
+#define benc_node_span(node)    ((node)->span)
+
+/**
+ * @brief the position of a BencNode among the children of its parent.
+ *
+ * It's kept when the children are inserted or removed, so a node finds
+ * its index without walking its siblings.
+ *
+ * @param  node: a BencNode.
+ * @return the index (UINT32), 0 for the root.
+ */ 
+#define benc_node_position(node) ((node)->position)
+
+/**
+ * @brief the value of an integer BencNode.
+ *
+ * The number is parsed once, when the node is decoded or created, the
+ * data keeps its text.
+ *
+ * @param  node: a BencNode.
+ * @return the value (INT64), 0 if it isn't a BENC_TYPE_INTEGER node.
+ */ 
+#define benc_node_integer(node) ((node)->integer)
+
 /**
  * @brief Return TRUE if the node is the root of the tree
  *
@@ -102,6 +193,14 @@ typedef struct _BencNode
  */
 #define benc_node_is_leaf(node) ((node)->children==NULL)
 
+/**
+ * @brief Return TRUE if the node lives inside of a BencArena
+ *
+ * @param node a BencNode
+ * @return TRUE if it's owned by an arena, FALSE otherwise. 
+ */
+#define benc_node_is_arena(node) (((node)->flags & BENC_NODE_ARENA) != 0)
+
 /**
  * @brief Append a BencNode as the last children of parent
  *
@@ -133,6 +232,14 @@ typedef struct _BencNode
  */ 
 #define benc_node_first_child(node) ((node)->children)
 
+/**
+ * @brief Determine the number of children of a node
+ *
+ * @param  node: a BencNode parent.
+ * @return the number of children (UINT32).
+ */ 
+#define benc_node_n_children(node) ((node)->count)
+
 /**
  * @brief Gets the next sibling of a BencNode. 
  *
@@ -155,6 +262,16 @@ BencNode* benc_decode_file (FILE* fp);
 BencNode* benc_decode_buf (char* data, UINT32 length, UINT32* bytes);
 UINT32    benc_encode_file (BencNode* tree, FILE* fp);
 char*     benc_encode_buf (BencNode* tree, UINT32* bytes);
+UINT32    benc_encode_size (BencNode* tree);
+UINT32    benc_encode_to_buf (BencNode* tree, char* buf, UINT32 size);
+UINT32    benc_encode_stream (BencNode* tree, BencWriteFunc func, void* user_data);
+
+BencArena* benc_arena_new (UINT32 chunk_size);
+void       benc_arena_destroy (BencArena* arena);
+BencNode*  benc_decode_buf_arena (BencArena* arena, char* data, UINT32 length,
+                                  UINT32* bytes);
+BencNode*  benc_decode_buf_full (BencArena* arena, char* data, UINT32 length,
+                                 UINT32* bytes, UINT32 max_depth);
 
 BencNode* benc_node_new (BencType type, UINT32 length, char* data);
 BencNode* benc_node_copy (BencNode* node);
@@ -171,9 +288,13 @@ BencNode* benc_node_find_child (BencNode* parent, BencType type, UINT32 length,
                                 char* data);
 BencNode* benc_node_find_key (BencNode* node, char* key);
 
+BencNode* benc_dict_get (BencNode* dict, const char* key);
+BencNode* benc_dict_lookup (BencNode* dict, const char* key, UINT32 length);
+
 BencNode* benc_node_get_root (BencNode* node);
 BencNode* benc_node_last_child (BencNode* node);
 BencNode* benc_node_nth_child (BencNode* node, unsigned int n);
+BencNode** benc_node_children (BencNode* node);
 BencNode* benc_node_first_sibling (BencNode* node);
 BencNode* benc_node_last_sibling (BencNode* node);
 BencNode* benc_node_prev_sibling (BencNode* node);
@@ -0,0 +1,185 @@
+/**
+ * @file eventqueue.c
+ *
+ * @brief Queue of events from the threads to the main loop, so the
+ *        threads never touch the widgets nor wait for the GUI.
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* INCLUDES *****************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <glib.h>
+
+#include "eventqueue.h"
+
+/* TYPEDEF ******************************************************************/
+
+/**
+ * @brief The queue is a GSource. The threads push the events on a stack
+ *        (compare and exchange of head), the source takes the whole stack
+ *        at once and dispatches it in the pushed order.
+ */
+struct _EventQueue
+{
+  GSource        source;     /**< the parent.                      */
+  EventQueueItem *head;      /**< the last pushed event, or NULL.  */
+  EventQueueFunc func;       /**< called for each event.           */
+  gpointer       user_data;  /**< data passed to func.             */
+};
+
+/* PRIVATE FUNCTIONS ********************************************************/
+
+static gboolean event_queue_prepare(GSource *source, gint *timeout);
+static gboolean event_queue_check(GSource *source);
+static gboolean event_queue_dispatch(GSource *source, GSourceFunc callback,
+                                     gpointer user_data);
+
+/* GLOBALS ******************************************************************/
+
+static GSourceFuncs event_queue_funcs =
+{
+  event_queue_prepare,
+  event_queue_check,
+  event_queue_dispatch,
+  NULL
+};
+
+/* FUNCTIONS ****************************************************************/
+
+/**
+ * @brief Create an EventQueue, it must be attached to a main context to
+ *        dispatch the events (they can be pushed before).
+ *
+ * @param func: function called for each event in the main loop.
+ * @param user_data: data passed to func.
+ * @return the new EventQueue, it lives as long as it's attached.
+ */
+EventQueue *
+event_queue_new(EventQueueFunc func, gpointer user_data)
+{
+  EventQueue *queue;
+
+  queue = (EventQueue*)g_source_new(&event_queue_funcs, sizeof(EventQueue));
+  queue->head = NULL;
+  queue->func = func;
+  queue->user_data = user_data;
+
+  return queue;
+}
+
+/**
+ * @brief Attach an EventQueue to the main context that dispatches its
+ *        events, the context keeps the queue.
+ *
+ * @param queue: the EventQueue.
+ * @param context: a GMainContext (NULL for the default one).
+ * @return the source id.
+ */
+guint
+event_queue_attach(EventQueue *queue, GMainContext *context)
+{
+  guint id;
+
+  id = g_source_attach(&queue->source, context);
+  g_source_unref(&queue->source);
+
+  return id;
+}
+
+/**
+ * @brief Push an event, from any thread. It never blocks.
+ *
+ * @param queue: the EventQueue.
+ * @param item: the event (its first member), owned by the queue from now.
+ */
+void
+event_queue_push(EventQueue *queue, EventQueueItem *item)
+{
+  EventQueueItem *head;
+
+  do
+  {
+    head = (EventQueueItem*)g_atomic_pointer_get(&queue->head);
+    item->next = head;
+  } while(!g_atomic_pointer_compare_and_exchange((gpointer*)&queue->head,
+                                                 head, item));
+
+  /* an empty queue could be sleeping in the poll */
+  if(head == NULL && g_source_get_context(&queue->source) != NULL)
+    g_main_context_wakeup(g_source_get_context(&queue->source));
+
+  return;
+}
+
+/**
+ * @brief ready if there are events, else wait for a wakeup.
+ */
+static gboolean
+event_queue_prepare(GSource *source, gint *timeout)
+{
+  *timeout = -1;
+  return g_atomic_pointer_get(&((EventQueue*)source)->head) != NULL;
+}
+
+/**
+ * @brief ready if there are events.
+ */
+static gboolean
+event_queue_check(GSource *source)
+{
+  return g_atomic_pointer_get(&((EventQueue*)source)->head) != NULL;
+}
+
+/**
+ * @brief Take all the pushed events and call the queue function for
+ *        each one, the oldest first.
+ */
+static gboolean
+event_queue_dispatch(GSource *source, GSourceFunc callback, gpointer user_data)
+{
+  EventQueue *queue = (EventQueue*)source;
+  EventQueueItem *head, *item, *next;
+
+  do
+    head = (EventQueueItem*)g_atomic_pointer_get(&queue->head);
+  while(head != NULL &&
+        !g_atomic_pointer_compare_and_exchange((gpointer*)&queue->head,
+                                               head, NULL));
+
+  /* the stack has the newest first */
+  for(item = NULL; head != NULL; head = next)
+  {
+    next = head->next;
+    head->next = item;
+    item = head;
+  }
+
+  for(; item != NULL; item = next)
+  {
+    next = item->next;
+    queue->func(item, queue->user_data);
+  }
+
+  return TRUE;
+}
+
+/* END **********************************************************************/
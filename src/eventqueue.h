@@ -0,0 +1,48 @@
+/**
+ * @file eventqueue.h
+ *
+ * @brief header file for the queue of events from the threads to the
+ *        main loop.
+ */
+
+#ifndef _EVENTQUEUE_H
+#define _EVENTQUEUE_H
+
+/* INCLUDES *****************************************************************/
+
+#include <glib.h>
+
+/* TYPEDEF ******************************************************************/
+
+/**
+ * @brief The link of an event in an EventQueue, it must be the first
+ *        member of the events structures.
+ */
+typedef struct _EventQueueItem
+{
+  struct _EventQueueItem *next; /**< the next event (private). */
+} EventQueueItem;
+
+/**
+ * @brief Function called in the main loop for each event, in the order
+ *        they were pushed. It owns the event.
+ */
+typedef void (*EventQueueFunc)(EventQueueItem *item, gpointer user_data);
+
+/**
+ * @brief A lock free queue of events from any number of threads to a
+ *        main loop (a GSource that dispatches them).
+ */
+typedef struct _EventQueue EventQueue;
+
+/* PROTOTYPES ***************************************************************/
+
+G_BEGIN_DECLS
+
+EventQueue *event_queue_new(EventQueueFunc func, gpointer user_data);
+guint       event_queue_attach(EventQueue *queue, GMainContext *context);
+void        event_queue_push(EventQueue *queue, EventQueueItem *item);
+
+G_END_DECLS
+
+#endif /* _EVENTQUEUE_H */
@@ -0,0 +1,605 @@
+/**
+ * @file gtkbenctreemodel.c
+ *
+ * @brief GtkTreeModel of a BencNode tree, the rows are made on demand.
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* INCLUDES *****************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtk/gtk.h>
+
+#include "bencode.h"
+#include "utilities.h"
+#include "gtkbenctreemodel.h"
+
+/* PRIVATE FUNCTIONS PROTOTYPES *********************************************/
+
+static void gtk_benc_tree_model_init(GtkBencTreeModel *model);
+static void gtk_benc_tree_model_class_init(GtkBencTreeModelClass *klass);
+static void gtk_benc_tree_model_tree_model_init(GtkTreeModelIface *iface);
+static void gtk_benc_tree_model_finalize(GObject *object);
+
+static GtkTreeModelFlags gtk_benc_tree_model_get_flags(GtkTreeModel *tree_model);
+static gint gtk_benc_tree_model_get_n_columns(GtkTreeModel *tree_model);
+static GType gtk_benc_tree_model_get_column_type(GtkTreeModel *tree_model, gint index);
+static gboolean gtk_benc_tree_model_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path);
+static GtkTreePath *gtk_benc_tree_model_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter);
+static void gtk_benc_tree_model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value);
+static gboolean gtk_benc_tree_model_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter);
+static gboolean gtk_benc_tree_model_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent);
+static gboolean gtk_benc_tree_model_iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter);
+static gint gtk_benc_tree_model_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter);
+static gboolean gtk_benc_tree_model_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent, gint n);
+static gboolean gtk_benc_tree_model_iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child);
+
+static gboolean gtk_benc_tree_model_set_iter(GtkBencTreeModel *model, GtkTreeIter *iter, BencNode *node, guint index);
+static BencNode *gtk_benc_tree_model_element(BencNode *node);
+static BencNode *gtk_benc_tree_model_nth_row(BencNode *container, guint n);
+static gboolean gtk_benc_tree_model_is_container(BencNode *node);
+static guint gtk_benc_tree_model_row_index(GtkBencTreeModel *model, BencNode *node);
+static gchar *gtk_benc_tree_model_node_data(BencNode *node);
+static gchar *gtk_benc_tree_model_row_text(GtkBencTreeModel *model, BencNode *node);
+
+/* GLOBALS ******************************************************************/
+
+static gpointer parent_class;
+
+/* FUNCTIONS ****************************************************************/
+
+/**
+ * @brief here register the bencode tree model type with the GObject
+ *        type system if it hasn't done so yet.
+ */
+GType
+gtk_benc_tree_model_get_type(void)
+{
+  static GType gtk_benc_tree_model_type = 0;
+
+  if (!gtk_benc_tree_model_type)
+  {
+    static const GTypeInfo gtk_benc_tree_model_info =
+    {
+      sizeof(GtkBencTreeModelClass),
+      NULL, /* base_init */
+      NULL, /* base_finalize */
+      (GClassInitFunc) gtk_benc_tree_model_class_init,
+      NULL, /* class_finalize */
+      NULL, /* class_data */
+      sizeof(GtkBencTreeModel),
+      0,    /* n_preallocs */
+      (GInstanceInitFunc) gtk_benc_tree_model_init,
+      NULL
+    };
+
+    static const GInterfaceInfo tree_model_info =
+    {
+      (GInterfaceInitFunc) gtk_benc_tree_model_tree_model_init,
+      NULL, /* interface_finalize */
+      NULL  /* interface_data */
+    };
+
+    gtk_benc_tree_model_type = g_type_register_static(G_TYPE_OBJECT,
+                                                      "GtkBencTreeModel",
+                                                      &gtk_benc_tree_model_info, 0);
+    g_type_add_interface_static(gtk_benc_tree_model_type, GTK_TYPE_TREE_MODEL,
+                                &tree_model_info);
+  }
+
+  return gtk_benc_tree_model_type;
+}
+
+/**
+ * @brief Create a model of a BencNode tree.
+ *
+ * The tree must not change while the model exists. The model keeps it
+ * alive with owner, it calls destroy(owner) when it's finalized.
+ *
+ * @param root: the tree.
+ * @param icons: the icons of each BencType (they must live as the model).
+ * @param owner: what keeps the tree alive (can be NULL).
+ * @param destroy: function to release owner (can be NULL).
+ * @return the new model.
+ */
+GtkBencTreeModel *
+gtk_benc_tree_model_new(BencNode *root, GdkPixbuf **icons,
+                        gpointer owner, GDestroyNotify destroy)
+{
+  GtkBencTreeModel *model;
+
+  model = GTK_BENC_TREE_MODEL(g_object_new(GTK_TYPE_BENC_TREE_MODEL, NULL));
+  model->root = root;
+  model->icons = icons;
+  model->owner = owner;
+  model->destroy = destroy;
+
+  return model;
+}
+
+/**
+ * @brief set the defaults of a new model.
+ *
+ * @param model: the GtkBencTreeModel.
+ */
+static void
+gtk_benc_tree_model_init(GtkBencTreeModel *model)
+{
+  model->stamp = (gint)g_random_int();
+  model->root = NULL;
+  model->icons = NULL;
+  model->owner = NULL;
+  model->destroy = NULL;
+
+  return;
+}
+
+/**
+ * @brief set the GObject functions of the class.
+ *
+ * @param klass: the GtkBencTreeModelClass.
+ */
+static void
+gtk_benc_tree_model_class_init(GtkBencTreeModelClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+  parent_class = g_type_class_peek_parent(klass);
+  object_class->finalize = gtk_benc_tree_model_finalize;
+
+  return;
+}
+
+/**
+ * @brief set the GtkTreeModel functions.
+ *
+ * @param iface: the GtkTreeModelIface.
+ */
+static void
+gtk_benc_tree_model_tree_model_init(GtkTreeModelIface *iface)
+{
+  iface->get_flags       = gtk_benc_tree_model_get_flags;
+  iface->get_n_columns   = gtk_benc_tree_model_get_n_columns;
+  iface->get_column_type = gtk_benc_tree_model_get_column_type;
+  iface->get_iter        = gtk_benc_tree_model_get_iter;
+  iface->get_path        = gtk_benc_tree_model_get_path;
+  iface->get_value       = gtk_benc_tree_model_get_value;
+  iface->iter_next       = gtk_benc_tree_model_iter_next;
+  iface->iter_children   = gtk_benc_tree_model_iter_children;
+  iface->iter_has_child  = gtk_benc_tree_model_iter_has_child;
+  iface->iter_n_children = gtk_benc_tree_model_iter_n_children;
+  iface->iter_nth_child  = gtk_benc_tree_model_iter_nth_child;
+  iface->iter_parent     = gtk_benc_tree_model_iter_parent;
+
+  return;
+}
+
+/**
+ * @brief release the tree.
+ *
+ * @param object: the GtkBencTreeModel.
+ */
+static void
+gtk_benc_tree_model_finalize(GObject *object)
+{
+  GtkBencTreeModel *model = GTK_BENC_TREE_MODEL(object);
+
+  if(model->destroy != NULL)
+    model->destroy(model->owner);
+
+  (*G_OBJECT_CLASS(parent_class)->finalize)(object);
+  return;
+}
+
+/**
+ * @brief the nodes don't move, so the iters are always valid.
+ */
+static GtkTreeModelFlags
+gtk_benc_tree_model_get_flags(GtkTreeModel *tree_model)
+{
+  return GTK_TREE_MODEL_ITERS_PERSIST;
+}
+
+/**
+ * @brief the number of columns, BENC_TREE_N_COLS.
+ */
+static gint
+gtk_benc_tree_model_get_n_columns(GtkTreeModel *tree_model)
+{
+  return BENC_TREE_N_COLS;
+}
+
+/**
+ * @brief the type of a column.
+ */
+static GType
+gtk_benc_tree_model_get_column_type(GtkTreeModel *tree_model, gint index)
+{
+  return (index == BENC_TREE_COL_ICON)? GDK_TYPE_PIXBUF : G_TYPE_STRING;
+}
+
+/**
+ * @brief the iter of a path, it walks down from the root.
+ */
+static gboolean
+gtk_benc_tree_model_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                             GtkTreePath *path)
+{
+  GtkBencTreeModel *model = GTK_BENC_TREE_MODEL(tree_model);
+  BencNode *node;
+  gint *indices, depth, i;
+
+  indices = gtk_tree_path_get_indices(path);
+  depth = gtk_tree_path_get_depth(path);
+
+  /* the root is the only top level row */
+  if(depth < 1 || indices[0] != 0 || model->root == NULL)
+    return FALSE;
+
+  node = model->root;
+  for(i = 1; i < depth && node != NULL; i++)
+    node = gtk_benc_tree_model_nth_row(node, (guint)indices[i]);
+
+  return gtk_benc_tree_model_set_iter(model, iter, node, (depth > 1)? (guint)indices[depth-1] : 0);
+}
+
+/**
+ * @brief the path of an iter, it walks up to the root.
+ */
+static GtkTreePath *
+gtk_benc_tree_model_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  GtkBencTreeModel *model = GTK_BENC_TREE_MODEL(tree_model);
+  GtkTreePath *path;
+  BencNode *node;
+
+  g_return_val_if_fail(iter->stamp == model->stamp, NULL);
+
+  path = gtk_tree_path_new();
+  node = (BencNode*)iter->user_data;
+
+  if(node != model->root)
+  {
+    gtk_tree_path_prepend_index(path, GPOINTER_TO_INT(iter->user_data2));
+    node = gtk_benc_tree_model_element(node)->parent;
+  }
+
+  for(; node != model->root; node = gtk_benc_tree_model_element(node)->parent)
+    gtk_tree_path_prepend_index(path, gtk_benc_tree_model_row_index(model, node));
+
+  gtk_tree_path_prepend_index(path, 0);
+  return path;
+}
+
+/**
+ * @brief the icon or the text of a row, the text is made here.
+ */
+static void
+gtk_benc_tree_model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                              gint column, GValue *value)
+{
+  GtkBencTreeModel *model = GTK_BENC_TREE_MODEL(tree_model);
+  BencNode *node;
+
+  g_return_if_fail(iter->stamp == model->stamp);
+
+  node = (BencNode*)iter->user_data;
+
+  if(column == BENC_TREE_COL_ICON)
+  {
+    g_value_init(value, GDK_TYPE_PIXBUF);
+    g_value_set_object(value, model->icons[benc_node_type(node)]);
+  }
+  else
+  {
+    g_value_init(value, G_TYPE_STRING);
+    g_value_take_string(value, gtk_benc_tree_model_row_text(model, node));
+  }
+
+  return;
+}
+
+/**
+ * @brief the next row at the same level.
+ */
+static gboolean
+gtk_benc_tree_model_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  GtkBencTreeModel *model = GTK_BENC_TREE_MODEL(tree_model);
+  BencNode *node, *next;
+
+  g_return_val_if_fail(iter->stamp == model->stamp, FALSE);
+
+  node = (BencNode*)iter->user_data;
+  if(node == model->root)
+    return FALSE;
+
+  next = benc_node_next_sibling(gtk_benc_tree_model_element(node));
+  if(next != NULL && benc_node_type(next) == BENC_TYPE_KEY)
+    next = benc_node_first_child(next);
+
+  if(next == NULL)
+  {
+    iter->stamp = 0;
+    return FALSE;
+  }
+
+  iter->user_data = next;
+  iter->user_data2 = GINT_TO_POINTER(GPOINTER_TO_INT(iter->user_data2) + 1);
+  return TRUE;
+}
+
+/**
+ * @brief the first child of a row (the root if parent is NULL).
+ */
+static gboolean
+gtk_benc_tree_model_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                                  GtkTreeIter *parent)
+{
+  return gtk_benc_tree_model_iter_nth_child(tree_model, iter, parent, 0);
+}
+
+/**
+ * @brief if a row is a list or a dictionary with elements.
+ */
+static gboolean
+gtk_benc_tree_model_iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  BencNode *node = (BencNode*)iter->user_data;
+
+  return gtk_benc_tree_model_is_container(node) && benc_node_n_children(node) > 0;
+}
+
+/**
+ * @brief the number of children of a row (1 for the top level).
+ */
+static gint
+gtk_benc_tree_model_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  GtkBencTreeModel *model = GTK_BENC_TREE_MODEL(tree_model);
+  BencNode *node;
+
+  if(iter == NULL)
+    return (model->root != NULL)? 1 : 0;
+
+  node = (BencNode*)iter->user_data;
+  return gtk_benc_tree_model_is_container(node)? (gint)benc_node_n_children(node) : 0;
+}
+
+/**
+ * @brief the nth child of a row (of the top level if parent is NULL).
+ */
+static gboolean
+gtk_benc_tree_model_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                                   GtkTreeIter *parent, gint n)
+{
+  GtkBencTreeModel *model = GTK_BENC_TREE_MODEL(tree_model);
+
+  if(parent == NULL)
+    return gtk_benc_tree_model_set_iter(model, iter, (n == 0)? model->root : NULL, 0);
+
+  g_return_val_if_fail(parent->stamp == model->stamp, FALSE);
+
+  return gtk_benc_tree_model_set_iter(model, iter,
+           gtk_benc_tree_model_nth_row((BencNode*)parent->user_data, (guint)n), (guint)n);
+}
+
+/**
+ * @brief the parent of a row.
+ */
+static gboolean
+gtk_benc_tree_model_iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                                GtkTreeIter *child)
+{
+  GtkBencTreeModel *model = GTK_BENC_TREE_MODEL(tree_model);
+  BencNode *node;
+
+  g_return_val_if_fail(child->stamp == model->stamp, FALSE);
+
+  node = (BencNode*)child->user_data;
+  if(node == model->root)
+    return gtk_benc_tree_model_set_iter(model, iter, NULL, 0);
+
+  node = gtk_benc_tree_model_element(node)->parent;
+  return gtk_benc_tree_model_set_iter(model, iter, node,
+                                      gtk_benc_tree_model_row_index(model, node));
+}
+
+/**
+ * @brief Set an iter to a row. DON'T USE DIRECTLY.
+ *
+ * @param model: the GtkBencTreeModel.
+ * @param iter: the iter.
+ * @param node: the node of the row (NULL for none).
+ * @param index: the position of the row in its parent.
+ * @return FALSE if node is NULL (the iter is invalid then).
+ */
+static gboolean
+gtk_benc_tree_model_set_iter(GtkBencTreeModel *model, GtkTreeIter *iter,
+                             BencNode *node, guint index)
+{
+  if(node == NULL)
+  {
+    iter->stamp = 0;
+    return FALSE;
+  }
+
+  iter->stamp = model->stamp;
+  iter->user_data = node;
+  iter->user_data2 = GUINT_TO_POINTER(index);
+  iter->user_data3 = NULL;
+  return TRUE;
+}
+
+/**
+ * @brief The child of a list or dictionary that holds a row: its key for
+ *        the values of a dictionary, else the node itself.
+ *        DON'T USE DIRECTLY.
+ *
+ * @param node: the node of the row.
+ * @return the element.
+ */
+static BencNode *
+gtk_benc_tree_model_element(BencNode *node)
+{
+  if(node->parent != NULL && benc_node_type(node->parent) == BENC_TYPE_KEY)
+    return node->parent;
+
+  return node;
+}
+
+/**
+ * @brief The nth row under a list or dictionary. DON'T USE DIRECTLY.
+ *
+ * @param container: the list or dictionary.
+ * @param n: the row index.
+ * @return the node of the row, or NULL.
+ */
+static BencNode *
+gtk_benc_tree_model_nth_row(BencNode *container, guint n)
+{
+  BencNode *element;
+
+  if(!gtk_benc_tree_model_is_container(container) ||
+     n >= benc_node_n_children(container))
+    return NULL;
+
+  element = benc_node_nth_child(container, n);
+  if(element != NULL && benc_node_type(element) == BENC_TYPE_KEY)
+    element = benc_node_first_child(element);
+
+  return element;
+}
+
+/**
+ * @brief if a node has rows under it. DON'T USE DIRECTLY.
+ */
+static gboolean
+gtk_benc_tree_model_is_container(BencNode *node)
+{
+  return benc_node_type(node) == BENC_TYPE_DICTIONARY ||
+         benc_node_type(node) == BENC_TYPE_LIST;
+}
+
+/**
+ * @brief The position of a row in its parent, only needed to make the
+ *        paths of the rows above an iter. The element keeps it, so a
+ *        path costs its depth. DON'T USE DIRECTLY.
+ *
+ * @param model: the GtkBencTreeModel.
+ * @param node: the node of the row.
+ * @return the index.
+ */
+static guint
+gtk_benc_tree_model_row_index(GtkBencTreeModel *model, BencNode *node)
+{
+  if(node == model->root)
+    return 0;
+
+  return benc_node_position(gtk_benc_tree_model_element(node));
+}
+
+/**
+ * @brief The data of a node as text, the UTF-8 strings are cut to
+ *        MAX_TREE_STRING_LEN bytes, other data is showed as hex.
+ *        DON'T USE DIRECTLY.
+ *
+ * @param node: the node.
+ * @return a new allocated string.
+ */
+static gchar *
+gtk_benc_tree_model_node_data(BencNode *node)
+{
+  const gchar *end;
+  gchar *string, *node_data;
+
+  if(!g_utf8_validate(benc_node_data(node), benc_node_length(node), NULL))
+  {
+    string = util_convert_to_hex(benc_node_data(node),
+                MIN(benc_node_length(node), MAX_HEX_TO_SHOW_TREEVIEW), NULL);
+
+    if(benc_node_length(node) > MAX_HEX_TO_SHOW_TREEVIEW)
+    {
+      node_data = g_strdup_printf("\"%s...\"", string);
+      g_free(string);
+    }
+    else
+      node_data = string;
+
+    return node_data;
+  }
+
+  /* don't cut a character */
+  g_utf8_validate(benc_node_data(node),
+                  MIN(benc_node_length(node), MAX_TREE_STRING_LEN), &end);
+  return g_strndup(benc_node_data(node), end - benc_node_data(node));
+}
+
+/**
+ * @brief The text of a row: the key (or "root"), the length of the
+ *        strings, the value or the number of elements. DON'T USE DIRECTLY.
+ *
+ * @param model: the GtkBencTreeModel.
+ * @param node: the node of the row.
+ * @return a new allocated string.
+ */
+static gchar *
+gtk_benc_tree_model_row_text(GtkBencTreeModel *model, BencNode *node)
+{
+  BencNode *element;
+  gchar *prefix, *node_data, *string;
+
+  element = gtk_benc_tree_model_element(node);
+  if(element != node)
+    prefix = gtk_benc_tree_model_node_data(element);
+  else if(node == model->root && gtk_benc_tree_model_is_container(node))
+    prefix = g_strdup("root");
+  else
+    prefix = NULL;
+
+  switch(benc_node_type(node))
+  {
+    case BENC_TYPE_INTEGER:
+      node_data = gtk_benc_tree_model_node_data(node);
+      string = g_strdup_printf("%s%s%s", prefix?prefix:"", prefix?" = ":"",
+                               node_data);
+      g_free(node_data);
+      break;
+    case BENC_TYPE_STRING:
+      node_data = gtk_benc_tree_model_node_data(node);
+      string = g_strdup_printf("%s (%i)%s%s", prefix?prefix:"",
+                 benc_node_length(node), prefix?" = ":" ", node_data);
+      g_free(node_data);
+      break;
+    case BENC_TYPE_DICTIONARY:
+      string = g_strdup_printf("%s%s{%u}", prefix?prefix:"", prefix?" ":"",
+                               benc_node_n_children(node));
+      break;
+    default: /* BENC_TYPE_LIST */
+      string = g_strdup_printf("%s%s[%u]", prefix?prefix:"", prefix?" ":"",
+                               benc_node_n_children(node));
+  }
+
+  g_free(prefix);
+  return string;
+}
+
+/* END **********************************************************************/
@@ -0,0 +1,81 @@
+/**
+ * @file gtkbenctreemodel.h
+ *
+ * @brief header file for the GtkTreeModel of a BencNode tree.
+ */
+
+#ifndef _GTKBENCTREEMODEL_H
+#define _GTKBENCTREEMODEL_H
+
+#include <gtk/gtk.h>
+#include "bencode.h"
+
+G_BEGIN_DECLS
+
+/* DEFINES ******************************************************************/
+
+#define MAX_HEX_TO_SHOW_TREEVIEW  30 /*if invalid utf8 show just 30 hex nums*/
+#define MAX_TREE_STRING_LEN      200 /*max lenght of a row in the a treeview*/
+
+/* MACROS *******************************************************************/
+
+#define GTK_TYPE_BENC_TREE_MODEL            (gtk_benc_tree_model_get_type())
+#define GTK_BENC_TREE_MODEL(obj)            (G_TYPE_CHECK_INSTANCE_CAST((obj), GTK_TYPE_BENC_TREE_MODEL, GtkBencTreeModel))
+#define GTK_BENC_TREE_MODEL_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST((klass), GTK_TYPE_BENC_TREE_MODEL, GtkBencTreeModelClass))
+#define GTK_IS_BENC_TREE_MODEL(obj)         (G_TYPE_CHECK_INSTANCE_TYPE((obj), GTK_TYPE_BENC_TREE_MODEL))
+#define GTK_IS_BENC_TREE_MODEL_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), GTK_TYPE_BENC_TREE_MODEL))
+#define GTK_BENC_TREE_MODEL_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS((obj), GTK_TYPE_BENC_TREE_MODEL, GtkBencTreeModelClass))
+
+/* TYPEDEF ******************************************************************/
+
+/**
+ * @brief The columns of a GtkBencTreeModel.
+ */
+enum
+{
+  BENC_TREE_COL_ICON = 0, /**< GdkPixbuf, the icon of the node type */
+  BENC_TREE_COL_TEXT,     /**< gchararray, the key and the value    */
+  BENC_TREE_N_COLS
+};
+
+typedef struct _GtkBencTreeModel GtkBencTreeModel;
+typedef struct _GtkBencTreeModelClass GtkBencTreeModelClass;
+
+/**
+ * @brief A read only GtkTreeModel over a BencNode tree.
+ *
+ * There is a row for each value of the tree (the keys of a dictionary
+ * are the prefix of the text of their values). The rows aren't stored,
+ * the iters point to the nodes and the text is made when it's asked, so
+ * a tree of any size is showed at once and only the expanded nodes are
+ * walked.
+ */
+struct _GtkBencTreeModel
+{
+  GObject parent;
+
+  /* private */
+  gint           stamp;    /**< the stamp of the valid iters.          */
+  BencNode       *root;    /**< the tree.                              */
+  GdkPixbuf      **icons;  /**< the icons of the types (BencType).     */
+  gpointer       owner;    /**< what keeps the tree alive.             */
+  GDestroyNotify destroy;  /**< called with owner at the finalization. */
+};
+
+/**
+ * @brief GtkBencTreeModel Class structure
+ */
+struct _GtkBencTreeModelClass
+{
+  GObjectClass parent_class;
+};
+
+/* PROTOTYPES ***************************************************************/
+
+GType gtk_benc_tree_model_get_type(void);
+GtkBencTreeModel *gtk_benc_tree_model_new(BencNode *root, GdkPixbuf **icons,
+                                          gpointer owner, GDestroyNotify destroy);
+
+G_END_DECLS
+
+#endif /* _GTKBENCTREEMODEL_H */
@@ -0,0 +1,571 @@
+/**
+ * @file gtkfilelistmodel.c
+ *
+ * @brief GtkTreeModel of the files list, a table with an array per column.
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* INCLUDES *****************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "gbitarray.h"
+#include "gtkfilelistmodel.h"
+
+/* PRIVATE FUNCTIONS PROTOTYPES *********************************************/
+
+static void gtk_file_list_model_init(GtkFileListModel *model);
+static void gtk_file_list_model_class_init(GtkFileListModelClass *klass);
+static void gtk_file_list_model_tree_model_init(GtkTreeModelIface *iface);
+static void gtk_file_list_model_finalize(GObject *object);
+
+static GtkTreeModelFlags gtk_file_list_model_get_flags(GtkTreeModel *tree_model);
+static gint gtk_file_list_model_get_n_columns(GtkTreeModel *tree_model);
+static GType gtk_file_list_model_get_column_type(GtkTreeModel *tree_model, gint index);
+static gboolean gtk_file_list_model_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path);
+static GtkTreePath *gtk_file_list_model_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter);
+static void gtk_file_list_model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value);
+static gboolean gtk_file_list_model_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter);
+static gboolean gtk_file_list_model_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent);
+static gboolean gtk_file_list_model_iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter);
+static gint gtk_file_list_model_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter);
+static gboolean gtk_file_list_model_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent, gint n);
+static gboolean gtk_file_list_model_iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child);
+
+static gboolean gtk_file_list_model_set_iter(GtkFileListModel *model, GtkTreeIter *iter, gint file);
+static void gtk_file_list_model_row_changed(GtkFileListModel *model, guint file);
+
+/* GLOBALS ******************************************************************/
+
+static gpointer parent_class;
+
+static GType column_types[NUM_FILE_COLS];
+
+/* FUNCTIONS ****************************************************************/
+
+/**
+ * @brief here register the files list model type with the GObject
+ *        type system if it hasn't done so yet.
+ */
+GType
+gtk_file_list_model_get_type(void)
+{
+  static GType gtk_file_list_model_type = 0;
+
+  if (!gtk_file_list_model_type)
+  {
+    static const GTypeInfo gtk_file_list_model_info =
+    {
+      sizeof(GtkFileListModelClass),
+      NULL, /* base_init */
+      NULL, /* base_finalize */
+      (GClassInitFunc) gtk_file_list_model_class_init,
+      NULL, /* class_finalize */
+      NULL, /* class_data */
+      sizeof(GtkFileListModel),
+      0,    /* n_preallocs */
+      (GInstanceInitFunc) gtk_file_list_model_init,
+      NULL
+    };
+
+    static const GInterfaceInfo tree_model_info =
+    {
+      (GInterfaceInitFunc) gtk_file_list_model_tree_model_init,
+      NULL, /* interface_finalize */
+      NULL  /* interface_data */
+    };
+
+    gtk_file_list_model_type = g_type_register_static(G_TYPE_OBJECT,
+                                                      "GtkFileListModel",
+                                                      &gtk_file_list_model_info, 0);
+    g_type_add_interface_static(gtk_file_list_model_type, GTK_TYPE_TREE_MODEL,
+                                &tree_model_info);
+  }
+
+  return gtk_file_list_model_type;
+}
+
+/**
+ * @brief Create a files list of n_files rows.
+ *
+ * The rows are empty, fill them with gtk_file_list_model_set_file
+ * before the model is showed. Their remains are unknown (-1) and their
+ * state is FILE_STATE_UNKNOWN.
+ *
+ * @param n_files: the number of files.
+ * @param pieces: the complete pieces of the torrent (can be NULL),
+ *                the model keeps a reference.
+ * @param icons: the icons of the states, NUM_FILE_STATES (they must live
+ *               as the model).
+ * @return the new model.
+ */
+GtkFileListModel *
+gtk_file_list_model_new(guint n_files, GBitArray *pieces, GdkPixbuf **icons)
+{
+  GtkFileListModel *model;
+  guint i;
+
+  model = GTK_FILE_LIST_MODEL(g_object_new(GTK_TYPE_FILE_LIST_MODEL, NULL));
+  model->n_files = n_files;
+  model->names = g_string_sized_new(n_files*16);
+  model->name_offsets = g_new0(guint, n_files);
+  model->sizes = g_new0(gint64, n_files);
+  model->first_pieces = g_new0(guint, n_files);
+  model->n_pieces = g_new0(guint, n_files);
+  model->remains = g_new(gint64, n_files);
+  model->states = g_new(guint8, n_files);
+  model->icons = icons;
+  model->pieces = (pieces != NULL)? G_BITARRAY(g_object_ref(G_OBJECT(pieces))) : NULL;
+
+  for(i = 0; i < n_files; i++)
+  {
+    model->remains[i] = -1;
+    model->states[i] = FILE_STATE_UNKNOWN;
+  }
+
+  /* the empty name */
+  g_string_append_c(model->names, '\0');
+
+  return model;
+}
+
+/**
+ * @brief Set a row of the files list. It doesn't notify the change, it's
+ *        to fill the model before it is showed.
+ *
+ * @param model: the GtkFileListModel.
+ * @param file: the row.
+ * @param name: the file name (copied).
+ * @param size: the file size.
+ * @param first_piece: the first piece of the file.
+ * @param n_pieces: the number of pieces of the file.
+ */
+void
+gtk_file_list_model_set_file(GtkFileListModel *model, guint file,
+                             const gchar *name, gint64 size,
+                             guint first_piece, guint n_pieces)
+{
+  g_return_if_fail(file < model->n_files);
+
+  model->name_offsets[file] = model->names->len;
+  g_string_append_len(model->names, name, strlen(name) + 1);
+  model->sizes[file] = size;
+  model->first_pieces[file] = first_piece;
+  model->n_pieces[file] = n_pieces;
+
+  return;
+}
+
+/**
+ * @brief Set the bytes to check of a file, the row is notified if it
+ *        changed.
+ *
+ * @param model: the GtkFileListModel.
+ * @param file: the row.
+ * @param remains: the bytes (-1 unknown).
+ */
+void
+gtk_file_list_model_set_remains(GtkFileListModel *model, guint file,
+                                gint64 remains)
+{
+  g_return_if_fail(file < model->n_files);
+
+  if(model->remains[file] != remains)
+  {
+    model->remains[file] = remains;
+    gtk_file_list_model_row_changed(model, file);
+  }
+
+  return;
+}
+
+/**
+ * @brief Set the state of a file (its icon), the row is notified if it
+ *        changed.
+ *
+ * @param model: the GtkFileListModel.
+ * @param file: the row.
+ * @param state: FILE_STATE_OK, FILE_STATE_BAD or FILE_STATE_UNKNOWN.
+ */
+void
+gtk_file_list_model_set_state(GtkFileListModel *model, guint file, guint state)
+{
+  g_return_if_fail(file < model->n_files && state < NUM_FILE_STATES);
+
+  if(model->states[file] != state)
+  {
+    model->states[file] = (guint8)state;
+    gtk_file_list_model_row_changed(model, file);
+  }
+
+  return;
+}
+
+/**
+ * @brief the number of files (rows).
+ */
+guint
+gtk_file_list_model_get_n_files(GtkFileListModel *model)
+{
+  return model->n_files;
+}
+
+/**
+ * @brief the name of a file, it belongs to the model.
+ */
+const gchar *
+gtk_file_list_model_get_name(GtkFileListModel *model, guint file)
+{
+  g_return_val_if_fail(file < model->n_files, NULL);
+
+  return model->names->str + model->name_offsets[file];
+}
+
+/**
+ * @brief the size of a file.
+ */
+gint64
+gtk_file_list_model_get_size(GtkFileListModel *model, guint file)
+{
+  g_return_val_if_fail(file < model->n_files, 0);
+
+  return model->sizes[file];
+}
+
+/**
+ * @brief the complete pieces of the torrent, it belongs to the model.
+ */
+GBitArray *
+gtk_file_list_model_get_pieces(GtkFileListModel *model)
+{
+  return model->pieces;
+}
+
+/**
+ * @brief set the defaults of a new model.
+ *
+ * @param model: the GtkFileListModel.
+ */
+static void
+gtk_file_list_model_init(GtkFileListModel *model)
+{
+  model->stamp = (gint)g_random_int();
+  model->n_files = 0;
+  model->names = NULL;
+  model->name_offsets = NULL;
+  model->sizes = NULL;
+  model->first_pieces = NULL;
+  model->n_pieces = NULL;
+  model->remains = NULL;
+  model->states = NULL;
+  model->icons = NULL;
+  model->pieces = NULL;
+
+  return;
+}
+
+/**
+ * @brief set the GObject functions of the class and the column types.
+ *
+ * @param klass: the GtkFileListModelClass.
+ */
+static void
+gtk_file_list_model_class_init(GtkFileListModelClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+  parent_class = g_type_class_peek_parent(klass);
+  object_class->finalize = gtk_file_list_model_finalize;
+
+  column_types[COL_FILE_ICON] = GDK_TYPE_PIXBUF;
+  column_types[COL_FILE_NAME] = G_TYPE_STRING;
+  column_types[COL_FILE_SIZE] = G_TYPE_INT64;
+  column_types[COL_FILE_FIRST_PIECE] = G_TYPE_UINT;
+  column_types[COL_FILE_N_PIECES] = G_TYPE_UINT;
+  column_types[COL_FILE_REMAINS] = G_TYPE_INT64;
+  column_types[COL_FILE_PIECESBITARRAY] = G_TYPE_OBJECT;
+
+  return;
+}
+
+/**
+ * @brief set the GtkTreeModel functions.
+ *
+ * @param iface: the GtkTreeModelIface.
+ */
+static void
+gtk_file_list_model_tree_model_init(GtkTreeModelIface *iface)
+{
+  iface->get_flags       = gtk_file_list_model_get_flags;
+  iface->get_n_columns   = gtk_file_list_model_get_n_columns;
+  iface->get_column_type = gtk_file_list_model_get_column_type;
+  iface->get_iter        = gtk_file_list_model_get_iter;
+  iface->get_path        = gtk_file_list_model_get_path;
+  iface->get_value       = gtk_file_list_model_get_value;
+  iface->iter_next       = gtk_file_list_model_iter_next;
+  iface->iter_children   = gtk_file_list_model_iter_children;
+  iface->iter_has_child  = gtk_file_list_model_iter_has_child;
+  iface->iter_n_children = gtk_file_list_model_iter_n_children;
+  iface->iter_nth_child  = gtk_file_list_model_iter_nth_child;
+  iface->iter_parent     = gtk_file_list_model_iter_parent;
+
+  return;
+}
+
+/**
+ * @brief free the columns.
+ *
+ * @param object: the GtkFileListModel.
+ */
+static void
+gtk_file_list_model_finalize(GObject *object)
+{
+  GtkFileListModel *model = GTK_FILE_LIST_MODEL(object);
+
+  if(model->names != NULL)
+    g_string_free(model->names, TRUE);
+  g_free(model->name_offsets);
+  g_free(model->sizes);
+  g_free(model->first_pieces);
+  g_free(model->n_pieces);
+  g_free(model->remains);
+  g_free(model->states);
+
+  if(model->pieces != NULL)
+    g_object_unref(G_OBJECT(model->pieces));
+
+  (*G_OBJECT_CLASS(parent_class)->finalize)(object);
+  return;
+}
+
+/**
+ * @brief the rows don't move and it's a list.
+ */
+static GtkTreeModelFlags
+gtk_file_list_model_get_flags(GtkTreeModel *tree_model)
+{
+  return GTK_TREE_MODEL_ITERS_PERSIST | GTK_TREE_MODEL_LIST_ONLY;
+}
+
+/**
+ * @brief the number of columns, NUM_FILE_COLS.
+ */
+static gint
+gtk_file_list_model_get_n_columns(GtkTreeModel *tree_model)
+{
+  return NUM_FILE_COLS;
+}
+
+/**
+ * @brief the type of a column.
+ */
+static GType
+gtk_file_list_model_get_column_type(GtkTreeModel *tree_model, gint index)
+{
+  g_return_val_if_fail(index >= 0 && index < NUM_FILE_COLS, G_TYPE_INVALID);
+
+  return column_types[index];
+}
+
+/**
+ * @brief the iter of a path, the index is the file.
+ */
+static gboolean
+gtk_file_list_model_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                             GtkTreePath *path)
+{
+  if(gtk_tree_path_get_depth(path) != 1)
+    return FALSE;
+
+  return gtk_file_list_model_set_iter(GTK_FILE_LIST_MODEL(tree_model), iter,
+                                      gtk_tree_path_get_indices(path)[0]);
+}
+
+/**
+ * @brief the path of an iter.
+ */
+static GtkTreePath *
+gtk_file_list_model_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  GtkTreePath *path;
+
+  g_return_val_if_fail(iter->stamp == GTK_FILE_LIST_MODEL(tree_model)->stamp, NULL);
+
+  path = gtk_tree_path_new();
+  gtk_tree_path_append_index(path, GPOINTER_TO_INT(iter->user_data));
+  return path;
+}
+
+/**
+ * @brief the value of a cell, straight from the column arrays.
+ */
+static void
+gtk_file_list_model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                              gint column, GValue *value)
+{
+  GtkFileListModel *model = GTK_FILE_LIST_MODEL(tree_model);
+  guint file;
+
+  g_return_if_fail(iter->stamp == model->stamp);
+  g_return_if_fail(column >= 0 && column < NUM_FILE_COLS);
+
+  file = GPOINTER_TO_UINT(iter->user_data);
+  g_value_init(value, column_types[column]);
+
+  switch(column)
+  {
+    case COL_FILE_ICON:
+      g_value_set_object(value, model->icons[model->states[file]]);
+      break;
+    case COL_FILE_NAME:
+      g_value_set_static_string(value, model->names->str + model->name_offsets[file]);
+      break;
+    case COL_FILE_SIZE:
+      g_value_set_int64(value, model->sizes[file]);
+      break;
+    case COL_FILE_FIRST_PIECE:
+      g_value_set_uint(value, model->first_pieces[file]);
+      break;
+    case COL_FILE_N_PIECES:
+      g_value_set_uint(value, model->n_pieces[file]);
+      break;
+    case COL_FILE_REMAINS:
+      g_value_set_int64(value, model->remains[file]);
+      break;
+    default: /* COL_FILE_PIECESBITARRAY */
+      g_value_set_object(value, model->pieces);
+  }
+
+  return;
+}
+
+/**
+ * @brief the next row.
+ */
+static gboolean
+gtk_file_list_model_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  g_return_val_if_fail(iter->stamp == GTK_FILE_LIST_MODEL(tree_model)->stamp, FALSE);
+
+  return gtk_file_list_model_set_iter(GTK_FILE_LIST_MODEL(tree_model), iter,
+                                      GPOINTER_TO_INT(iter->user_data) + 1);
+}
+
+/**
+ * @brief the first row if parent is NULL (it's a list).
+ */
+static gboolean
+gtk_file_list_model_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                                  GtkTreeIter *parent)
+{
+  return gtk_file_list_model_iter_nth_child(tree_model, iter, parent, 0);
+}
+
+/**
+ * @brief the rows don't have children.
+ */
+static gboolean
+gtk_file_list_model_iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  return FALSE;
+}
+
+/**
+ * @brief the number of rows if iter is NULL, the rows don't have children.
+ */
+static gint
+gtk_file_list_model_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  return (iter == NULL)? (gint)GTK_FILE_LIST_MODEL(tree_model)->n_files : 0;
+}
+
+/**
+ * @brief the nth row if parent is NULL.
+ */
+static gboolean
+gtk_file_list_model_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                                   GtkTreeIter *parent, gint n)
+{
+  return gtk_file_list_model_set_iter(GTK_FILE_LIST_MODEL(tree_model), iter,
+                                      (parent == NULL)? n : -1);
+}
+
+/**
+ * @brief the rows don't have a parent.
+ */
+static gboolean
+gtk_file_list_model_iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                                GtkTreeIter *child)
+{
+  iter->stamp = 0;
+  return FALSE;
+}
+
+/**
+ * @brief Set an iter to a row. DON'T USE DIRECTLY.
+ *
+ * @param model: the GtkFileListModel.
+ * @param iter: the iter.
+ * @param file: the row.
+ * @return FALSE if there is no such row (the iter is invalid then).
+ */
+static gboolean
+gtk_file_list_model_set_iter(GtkFileListModel *model, GtkTreeIter *iter,
+                             gint file)
+{
+  if(file < 0 || (guint)file >= model->n_files)
+  {
+    iter->stamp = 0;
+    return FALSE;
+  }
+
+  iter->stamp = model->stamp;
+  iter->user_data = GINT_TO_POINTER(file);
+  iter->user_data2 = NULL;
+  iter->user_data3 = NULL;
+  return TRUE;
+}
+
+/**
+ * @brief Emit row-changed for a file. DON'T USE DIRECTLY.
+ *
+ * @param model: the GtkFileListModel.
+ * @param file: the row.
+ */
+static void
+gtk_file_list_model_row_changed(GtkFileListModel *model, guint file)
+{
+  GtkTreePath *path;
+  GtkTreeIter iter;
+
+  gtk_file_list_model_set_iter(model, &iter, (gint)file);
+  path = gtk_tree_path_new();
+  gtk_tree_path_append_index(path, (gint)file);
+  gtk_tree_model_row_changed(GTK_TREE_MODEL(model), path, &iter);
+  gtk_tree_path_free(path);
+
+  return;
+}
+
+/* END **********************************************************************/
@@ -0,0 +1,104 @@
+/**
+ * @file gtkfilelistmodel.h
+ *
+ * @brief header file for the GtkTreeModel of the files list.
+ */
+
+#ifndef _GTKFILELISTMODEL_H
+#define _GTKFILELISTMODEL_H
+
+#include <gtk/gtk.h>
+#include "gbitarray.h"
+
+G_BEGIN_DECLS
+
+/* MACROS *******************************************************************/
+
+#define GTK_TYPE_FILE_LIST_MODEL            (gtk_file_list_model_get_type())
+#define GTK_FILE_LIST_MODEL(obj)            (G_TYPE_CHECK_INSTANCE_CAST((obj), GTK_TYPE_FILE_LIST_MODEL, GtkFileListModel))
+#define GTK_FILE_LIST_MODEL_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST((klass), GTK_TYPE_FILE_LIST_MODEL, GtkFileListModelClass))
+#define GTK_IS_FILE_LIST_MODEL(obj)         (G_TYPE_CHECK_INSTANCE_TYPE((obj), GTK_TYPE_FILE_LIST_MODEL))
+#define GTK_IS_FILE_LIST_MODEL_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), GTK_TYPE_FILE_LIST_MODEL))
+#define GTK_FILE_LIST_MODEL_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS((obj), GTK_TYPE_FILE_LIST_MODEL, GtkFileListModelClass))
+
+/* TYPEDEF ******************************************************************/
+
+enum /* files list columns */
+{
+  COL_FILE_ICON = 0,
+  COL_FILE_NAME,
+  COL_FILE_SIZE,
+  COL_FILE_FIRST_PIECE,
+  COL_FILE_N_PIECES,
+  COL_FILE_REMAINS,
+  COL_FILE_PIECESBITARRAY,
+  NUM_FILE_COLS
+};
+
+enum /* files states */
+{
+  FILE_STATE_OK = 0,
+  FILE_STATE_BAD,
+  FILE_STATE_UNKNOWN,
+  NUM_FILE_STATES
+};
+
+typedef struct _GtkFileListModel GtkFileListModel;
+typedef struct _GtkFileListModelClass GtkFileListModelClass;
+
+/**
+ * @brief A GtkTreeModel of the files list of a torrent.
+ *
+ * Each column is an array with a value per file (the names are in a
+ * single block, the array has their offsets), so the rows are accessed
+ * in O(1) and nothing is boxed until the view asks for it. The remains
+ * and state columns can be changed, only the changed row is notified.
+ */
+struct _GtkFileListModel
+{
+  GObject parent;
+
+  /* private */
+  gint      stamp;         /**< the stamp of the valid iters.            */
+  guint     n_files;       /**< the number of rows.                      */
+  GString   *names;        /**< the names, each one NUL terminated.      */
+  guint     *name_offsets; /**< offset of each name in names.            */
+  gint64    *sizes;        /**< size of each file.                       */
+  guint     *first_pieces; /**< first piece of each file.                */
+  guint     *n_pieces;     /**< number of pieces of each file.           */
+  gint64    *remains;      /**< bytes to check of each file, -1 unknown. */
+  guint8    *states;       /**< state of each file (FILE_STATE_*).       */
+  GdkPixbuf **icons;       /**< the icons of the states.                 */
+  GBitArray *pieces;       /**< the complete pieces (can be NULL).       */
+};
+
+/**
+ * @brief GtkFileListModel Class structure
+ */
+struct _GtkFileListModelClass
+{
+  GObjectClass parent_class;
+};
+
+/* PROTOTYPES ***************************************************************/
+
+GType gtk_file_list_model_get_type(void);
+GtkFileListModel *gtk_file_list_model_new(guint n_files, GBitArray *pieces,
+                                          GdkPixbuf **icons);
+
+void gtk_file_list_model_set_file(GtkFileListModel *model, guint file,
+                                  const gchar *name, gint64 size,
+                                  guint first_piece, guint n_pieces);
+void gtk_file_list_model_set_remains(GtkFileListModel *model, guint file,
+                                     gint64 remains);
+void gtk_file_list_model_set_state(GtkFileListModel *model, guint file,
+                                   guint state);
+
+guint        gtk_file_list_model_get_n_files(GtkFileListModel *model);
+const gchar *gtk_file_list_model_get_name(GtkFileListModel *model, guint file);
+gint64       gtk_file_list_model_get_size(GtkFileListModel *model, guint file);
+GBitArray   *gtk_file_list_model_get_pieces(GtkFileListModel *model);
+
+G_END_DECLS
+
+#endif /* _GTKFILELISTMODEL_H */
@@ -35,7 +35,10 @@
 #include <glib/gprintf.h>
 
 #include <unistd.h>
+#include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
 #include <getopt.h>
 #include <errno.h>
 
@@ -43,34 +46,125 @@
 #include <curl/easy.h> 
 
 #include "bencode.h"
+#include "torrent.h"
+#include "verify.h"
 #include "utilities.h"
-#include "mainwindow.h"
 #include "gbitarray.h"
+#include "gtkfilelistmodel.h"
+#include "mainwindow.h"
 #include "sha1.h"
+#include "batch.h"
+#include "eventqueue.h"
 #include "main.h"
 
 /* MACROS *******************************************************************/
 
-#ifdef HAVE_FSEEKO
-# define _fseeko fseeko
-#else
-# define _fseeko fseek
-#endif
+#define log_ok(format, args...)        ui_event_log(LOG_OK, format, ## args)
+#define log_warning(format, args...)   ui_event_log(LOG_WARNING, format, ## args)
+#define log_error(format, args...)     ui_event_log(LOG_ERROR, format, ## args)
+
+/* TYPEDEF ******************************************************************/
+
+/**
+ * @brief A files check, made in check_files_start (the main loop) and
+ *        freed in check_files_done (the main loop).
+ *
+ * The workers don't touch the files list: they publish the remaining
+ * bytes of each file in remains, with seqs[i] odd while remains[i] is
+ * written, and the main loop shows the changed files a few times per
+ * second. There is just a writer at once (the Verify calls its
+ * VerifyFunc with its mutex locked).
+ */
+typedef struct
+{
+  gchar            *name;       /**< the file or folder to check.             */
+  Torrent          *torrent;    /**< the checked torrent (a reference).       */
+  gboolean         incremental; /**< only read the changed files.             */
+  GtkFileListModel *files;      /**< the files list (a reference).            */
+  GBitArray        *pieces;     /**< its valid pieces (a reference), or NULL. */
+  guint            n_files;     /**< the number of files.                     */
+  gint64           *remains;    /**< remaining bytes of each file.            */
+  gint             *seqs;       /**< changes of each file, odd while written. */
+  gint             *shown;      /**< seqs[i] when remains[i] was showed.      */
+  gint             changed;     /**< TRUE if some remains changed.            */
+  guint8           *states;     /**< the states at the end, NULL if canceled. */
+  guint            refresh_id;  /**< the check_files_refresh timeout.         */
+} CheckFilesData;
+
+/**
+ * @brief The wait after a scrape, see tracker_scrape_countdown.
+ */
+typedef struct
+{
+  guint timeout;        /**< seconds left.                            */
+  gchar *seeds_label;   /**< the label of the refresh seeds button.   */
+  gchar *tracker_label; /**< the label of the refresh tracker button. */
+} ScrapeWait;
+
+typedef enum /* the events from the threads */
+{
+  UI_EVENT_LOG = 0,
+  UI_EVENT_OPEN_STARTED,
+  UI_EVENT_OPEN_FAILED,
+  UI_EVENT_TORRENT_LOADED,
+  UI_EVENT_SCRAPE_STARTED,
+  UI_EVENT_SCRAPE_RESULT,
+  UI_EVENT_SCRAPE_DONE,
+  UI_EVENT_DETAILS_READY,
+  UI_EVENT_CHECK_STARTED,
+  UI_EVENT_CHECK_DONE
+} UiEventType;
 
-#define log_ok(format, args...)        mainwindow_log_printf(MAINWINDOW(gmainwin), LOG_OK, format, ## args)
-#define log_warning(format, args...)   mainwindow_log_printf(MAINWINDOW(gmainwin), LOG_WARNING, format, ## args)
-#define log_error(format, args...)     mainwindow_log_printf(MAINWINDOW(gmainwin), LOG_ERROR, format, ## args)
+/**
+ * @brief An event from a thread to the main loop, the threads never touch
+ *        the widgets, they post these events (see ui_event_dispatch).
+ */
+typedef struct
+{
+  EventQueueItem item;   /**< the link in gevents.                 */
+  UiEventType    type;   /**< what happened.                       */
+  gshort         level;  /**< the level of a UI_EVENT_LOG.         */
+  gchar          *text;  /**< a text (freed with the event).       */
+  gpointer       data;   /**< the data of the event.               */
+  gboolean       show;   /**< show the scrape in the tracker tree. */
+  gchar          info_hash[SHA_DIGEST_LENGTH]; /**< the scraped torrent. */
+  MainWindowTabs *tabs;  /**< the tabs of the loaded torrent.     */
+  GtkTreeModel   *model; /**< the torrent details, or NULL.        */
+} UiEvent;
 
 /* PRIVATE FUNCTIONS ********************************************************/
 
 static void display_usage(void);
+static gboolean cmd_line_is_batch(gint argc, gchar **argv);
 static void parse_cmd_line(gint argc, gchar **argv);
+static void ui_event_post(UiEventType type, gchar *text, gpointer data);
+static void ui_event_log(gshort level, const gchar *format, ...) G_GNUC_PRINTF(2, 3);
+static void ui_event_dispatch(EventQueueItem *item, gpointer user_data);
+static void torrent_loaded(gchar *name, Torrent *torrent, MainWindowTabs *tabs);
+static void tracker_scrape_result(BencNode *root, gboolean show, const gchar *info_hash);
+static gboolean tracker_scrape_countdown(gpointer data);
+static gpointer torrent_details(gpointer data);
+static void torrent_details_ready(Torrent *torrent, GtkTreeModel *model);
+static gpointer check_files(gpointer data);
+static void check_files_piece_checked(Verify *verify, guint piece, gboolean valid,
+                                      guint first_file, guint last_file, gpointer data);
+static void check_files_started(CheckFilesData *check);
+static void check_files_done(CheckFilesData *check);
+static gboolean check_files_refresh(gpointer data);
+static void check_files_data_free(CheckFilesData *check);
 
 /* GLOBALS ******************************************************************/
 
 static GtkWidget *gmainwin = NULL;
 static gchar *gfilename = NULL;
-static BencNode *gtorrentmetainfo = NULL;
+static Torrent *gtorrent = NULL;
+static EventQueue *gevents = NULL;
+
+static gchar *gverify = NULL;  /* the --verify torrent, gfilename is its data */
+static gchar *gscan = NULL;    /* the --scan folder */
+static BatchFormat gformat = BATCH_FORMAT_TSV;
+static gboolean gincremental = FALSE;
+static guint gworkers = 0;
 
 gboolean gissaved = TRUE;
 
@@ -81,19 +175,33 @@ static GThread *checkfiles_thread = NULL;
 static gboolean scrape_cancel = FALSE;
 static gboolean checkfiles_cancel = FALSE;
 
+static gboolean details_loading = FALSE; /* only used in the main loop */
+
 /* MAIN *********************************************************************/
 
 int
 main(int argc, char *argv[])
 {
-  /* Init GTK */
-  gtk_init(&argc, &argv);
-
 #ifdef ENABLE_NLS
   bindtextdomain(PACKAGE_NAME, LOCALE_DIR);
   bind_textdomain_codeset(PACKAGE_NAME, "UTF-8");
   textdomain(PACKAGE_NAME);
 #endif
+
+  /* the batch mode runs without display, so GTK+ is never started */
+  if(cmd_line_is_batch(argc, argv))
+  {
+    if(!g_thread_supported())
+      g_thread_init(NULL);
+
+    parse_cmd_line(argc, argv);
+    if(gscan != NULL)
+      exit(batch_scan(gscan, gformat, gworkers));
+    exit(batch_verify(gverify, gfilename, gformat, gincremental, gworkers));
+  }
+
+  /* Init GTK */
+  gtk_init(&argc, &argv);
   
   /* check GTK version */
   if (!GTK_CHECK_VERSION(3, 0, 0))
@@ -108,7 +216,9 @@ main(int argc, char *argv[])
   if(!g_thread_supported()) 
     g_thread_init(NULL);
   
-  gdk_threads_init();
+  /* the threads post their events to the main loop */
+  gevents = event_queue_new(ui_event_dispatch, NULL);
+  event_queue_attach(gevents, NULL);
 
   /* Init LibCurl */
   curl_global_init(CURL_GLOBAL_NOTHING);
@@ -124,22 +234,20 @@ main(int argc, char *argv[])
   if(gfilename)
   {
     log_ok(_("Command line file option: %s."), gfilename);
-    open_torrent_file(gfilename);
+    open_torrent_file(g_strdup(gfilename));
   }
   
   /* Enter the Main loop */
-  gdk_threads_enter();;
   log_ok("%s", LOG_WELCOME_MSN);  
   gtk_widget_show(gmainwin);
   gtk_main();
-  gdk_threads_leave();
  
   /* free any allocated memory */  
   if(gfilename)
     g_free(gfilename);
 
-  if(gtorrentmetainfo)
-    benc_node_destroy(gtorrentmetainfo);
+  if(gtorrent)
+    torrent_free(gtorrent);
 
   /* exit ok */
   exit(EXIT_SUCCESS);
@@ -152,18 +260,54 @@ static void
 display_usage(void)
 {
   g_print(_("Usage: gtv [options] [torrentfile]\n"));
+  g_print(_("       gtv --verify torrentfile path [--format tsv|json] [--incremental]\n"));
+  g_print(_("       gtv --scan folder [--format tsv|json]\n"));
   g_print("\n-h, --help             ");
   g_print(_("Display this text and exit."));
   g_print("\n-v, --version          ");
-  g_print(_("Print version number and exit.\n"));
+  g_print(_("Print version number and exit."));
+  g_print("\n--verify torrentfile   ");
+  g_print(_("Check the files in path without display, print the\n"
+            "                       results and exit (1 if they don't match)."));
+  g_print("\n--scan folder          ");
+  g_print(_("Print a summary of each torrent file in folder (and\n"
+            "                       its subfolders) without display and exit."));
+  g_print("\n--format tsv|json      ");
+  g_print(_("Format of the --verify and --scan results (tsv by default)."));
+  g_print("\n--incremental          ");
+  g_print(_("Only check the files changed since the last check."));
+  g_print("\n--workers n            ");
+  g_print(_("Threads of --verify and --scan (one by processor by default).\n"));
 
   exit(EXIT_SUCCESS);
 }
 
+/**
+ * @brief find the --verify or --scan option, before GTK+ takes its own
+ *        options.
+ *
+ * @param argc: number of arguments
+ * @param argv: pointer to the arguments
+ * @return TRUE if it's the batch mode.
+ */
+static gboolean
+cmd_line_is_batch(gint argc, gchar **argv)
+{
+  gint i;
+
+  for(i = 1; i < argc && strcmp(argv[i], "--") != 0; i++)
+    if(strcmp(argv[i], "--verify") == 0 || strncmp(argv[i], "--verify=", 9) == 0 ||
+       strcmp(argv[i], "--scan") == 0 || strncmp(argv[i], "--scan=", 7) == 0)
+      return TRUE;
+
+  return FALSE;
+}
+
 /**
  * @brief parse command line options
  * 
- * BE AWARE: It use the filename global variable.
+ * BE AWARE: It use the filename global variable, and the batch mode
+ * ones.
  *
  * @param argc: number of arguments
  * @param argv: pointer to the arguments
@@ -174,6 +318,11 @@ parse_cmd_line(gint argc, gchar **argv)
   gint c;
   static struct option long_options[] = {{"help", 0, NULL, 'h'},
                                          {"version", 0, NULL, 'v'},
+                                         {"verify", 1, NULL, 'c'},
+                                         {"format", 1, NULL, 'f'},
+                                         {"incremental", 0, NULL, 'i'},
+                                         {"scan", 1, NULL, 's'},
+                                         {"workers", 1, NULL, 'w'},
                                          {0, 0, 0, 0}};
 
   while ((c = getopt_long(argc, argv, "hv", long_options, NULL)) != -1)
@@ -187,17 +336,47 @@ parse_cmd_line(gint argc, gchar **argv)
       g_printf("%s %s\n", PACKAGE_NAME, PACKAGE_VERSION);
       exit(EXIT_SUCCESS);
       break;
+    case 'c':
+      g_free(gverify);
+      gverify = g_strdup(optarg);
+      break;
+    case 'f':
+      if(!batch_parse_format(optarg, &gformat))
+      {
+        g_printerr(_("Unknown format: %s.\n"), optarg);
+        exit(BATCH_EXIT_ERROR);
+      }
+      break;
+    case 'i':
+      gincremental = TRUE;
+      break;
+    case 's':
+      g_free(gscan);
+      gscan = g_strdup(optarg);
+      break;
+    case 'w':
+      gworkers = (guint)strtoul(optarg, NULL, 10);
+      break;
     }
   }
   
   if(optind < argc)
     gfilename = g_strdup(argv[optind]);
+
+  if(gscan == NULL && gverify != NULL && gfilename == NULL)
+  {
+    g_printerr("%s\n", _("--verify needs the path of the torrent data."));
+    exit(BATCH_EXIT_ERROR);
+  }
   
   return;
 }
 
 /**
- * @brief Get Torrent MetaInfo from a file. 
+ * @brief Get Torrent MetaInfo from a file.
+ *
+ * The contents of the tabs are prepared here too, the loaded torrent
+ * and its tabs are sent to the main loop (torrent_loaded).
  *
  * @param name: the name of the file.
  * @return nothing, this is not a joinble thread.
@@ -205,104 +384,55 @@ parse_cmd_line(gint argc, gchar **argv)
 gpointer
 open_torrent_file(gpointer name)
 {
-  FILE *fp;
-  BencNode *root;
-  MainWindow *mwin = MAINWINDOW(gmainwin);
+  Torrent *torrent;
+  UiEvent *event;
+  GError *err = NULL;
 
-  gdk_threads_enter();;
-  gtk_widget_set_sensitive(GTK_WIDGET(mwin->OpenToolButton), FALSE);
+  ui_event_post(UI_EVENT_OPEN_STARTED, NULL, NULL);
   log_ok(_("Opening %s."), (gchar*)name);
-  gdk_threads_leave();
-
-  if((fp = fopen((gchar*)name, "r")) == NULL)
-  { 
-    gdk_threads_enter();; 
-    gtk_widget_set_sensitive(GTK_WIDGET(mwin->OpenToolButton), TRUE);
-    log_error("%s", g_strerror(errno));
-    gdk_threads_leave();
-    g_free(name);
-    return NULL;
-  }
-
-  root = benc_decode_file(fp);
-  fclose(fp);
 
-  if(root == NULL)
+  if((torrent = torrent_open_cached((gchar*)name, &err)) == NULL)
   {
-    gdk_threads_enter();;
-    gtk_widget_set_sensitive(GTK_WIDGET(mwin->OpenToolButton), TRUE);
-    log_error(_("Open error: %s is not a bencoded torrent file or have corrupted data."),
-              (gchar*)name);
-    gdk_threads_leave();
+    if(err->domain == TORRENT_ERROR)
+      log_error(_("Open error: %s is not a bencoded torrent file or have corrupted data."),
+                (gchar*)name);
+    else
+      log_error("%s", err->message);
+    ui_event_post(UI_EVENT_OPEN_FAILED, NULL, NULL);
+    g_error_free(err);
     g_free(name);
     return NULL;
   }
 
-  /* cancel any other thread */
-  G_LOCK(thread_mutex);
-
-  if(scrape_thread != NULL)
-    scrape_cancel = TRUE;
-
-  if(checkfiles_thread != NULL)
-    checkfiles_cancel = TRUE;
-
-  G_UNLOCK(thread_mutex);
-
-  /* save filename pointer in a global variable, IMPORTANT: don't free it outside of here. */
-  if(gfilename != NULL)
-    g_free(gfilename);
-
-  gfilename = name;
-
-  /* save matainfo pointer in a global variable, IMPORTANT: don't free it outside of here. */
-  if(gtorrentmetainfo != NULL)
-    benc_node_destroy(gtorrentmetainfo);
-  
-  gtorrentmetainfo = root;
-
-  /* ok, fill the GUI */
-  gdk_threads_enter();;
-  mainwindow_fill_general_tab(mwin, gtorrentmetainfo);
-  gdk_threads_leave();
-
-  gdk_threads_enter();;
-  mainwindow_fill_files_tab(mwin, gtorrentmetainfo);
-  gdk_threads_leave();
-
-  gdk_threads_enter();;
-  mainwindow_fill_trackers_tab(mwin, gtorrentmetainfo);
-  gdk_threads_leave();
-
-  gdk_threads_enter();;
-  mainwindow_fill_torrent_tab(mwin, gtorrentmetainfo);
-  gdk_threads_leave();
-
-  gdk_threads_enter();;
-  log_ok("%s",_("Open success."));
-  gtk_widget_set_sensitive(GTK_WIDGET(mwin->OpenToolButton), TRUE);
-  gdk_threads_leave();
-
+  /* name, torrent and tabs belong to the main loop from here */
+  event = g_new0(UiEvent, 1);
+  event->type = UI_EVENT_TORRENT_LOADED;
+  event->text = name;
+  event->data = torrent;
+  event->tabs = mainwindow_tabs_new(MAINWINDOW(gmainwin), torrent);
+  event_queue_push(gevents, &event->item);
   return NULL;
 }
 
 /**
  * @brief Scrape the Tracker
  *
- * @param tracker: the tracker sitrng, if it terminate with "info_hash=", 
- *        then it is completed with the SHA1 of the opened torrent. It most 
+ * The answer is sent to the main loop (tracker_scrape_result), that
+ * waits DEF_WAIT_AFTER_SCRAPE seconds before allowing another scrape.
+ *
+ * @param tracker: the tracker sitrng, if it terminate with "info_hash=",
+ *        then it is completed with the SHA1 of the opened torrent. It most
  *        be dinamic allocated 'cos it will be free() here.
  * @return nothing, it is a no joinble thread.
  */
 gpointer
 tracker_scrape(gpointer tracker)
 {
-  MainWindow *mwin;
   gchar *string, *host, msn[CURL_ERROR_SIZE], torrent_sha[SHA_DIGEST_LENGTH];
-  gchar *seeds_button_label, *tracker_button_label;
+  gboolean has_info, canceled;
   FILE *fp;
-  guint number, timeout;
-  BencNode *root, *node, *child;
+  BencNode *root;
+  UiEvent *event;
   CURL *curl;
   CURLcode success;
 
@@ -311,30 +441,22 @@ tracker_scrape(gpointer tracker)
     scrape_thread = g_thread_self();
   else
   {
-    gdk_threads_enter();;
     log_warning("%s", _("Previous connection not finish yet. Try again later."));
-    gdk_threads_leave();
     g_free(tracker);
     G_UNLOCK(thread_mutex);
     return NULL;
   }
+
+  /* a new torrent can be loaded while scraping */
+  has_info = (gtorrent != NULL && torrent_has_info(gtorrent));
+  if(has_info)
+    memcpy(torrent_sha, gtorrent->info_hash, SHA_DIGEST_LENGTH);
   G_UNLOCK(thread_mutex);
-  
-  mwin = MAINWINDOW(gmainwin);
-  timeout = DEF_WAIT_AFTER_SCRAPE;
-  
-  gdk_threads_enter();;
-  gtk_widget_set_sensitive(GTK_WIDGET(mwin->RefreshSeedsButton), FALSE);
-  gtk_widget_set_sensitive(GTK_WIDGET(mwin->RefreshTrackerButton), FALSE);
-  gdk_threads_leave();
-  
-  node = benc_node_find_key(gtorrentmetainfo, "info");
-  if(node != NULL)
-  {
-    string = benc_encode_buf(node, &number);
-    SHA1((guint8*)string, number, (guint8*)torrent_sha);
-    g_free(string);
 
+  ui_event_post(UI_EVENT_SCRAPE_STARTED, NULL, NULL);
+
+  if(has_info)
+  {
     string = util_convert_to_hex(torrent_sha, SHA_DIGEST_LENGTH, "%");
     host = g_strdup_printf("%s?info_hash=%s", (gchar*)tracker, string);
     g_free(string);
@@ -346,12 +468,10 @@ tracker_scrape(gpointer tracker)
       g_strlcpy(string+6, string+8, strlen(string+7));
 
       if((fp = tmpfile()) != NULL)
-      {  
+      {
         if((curl = curl_easy_init()) != NULL)
-        { 
-          gdk_threads_enter();;
+        {
           log_ok(_("Connecting to %s"), host);
-          gdk_threads_leave();
 
           curl_easy_setopt(curl, CURLOPT_URL, host);
           curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
@@ -362,187 +482,188 @@ tracker_scrape(gpointer tracker)
           if((success = curl_easy_perform(curl)) == 0)
           {
             G_LOCK(thread_mutex);
-            if(!scrape_cancel)
+            canceled = scrape_cancel;
+            G_UNLOCK(thread_mutex);
+
+            if(!canceled)
             {
               rewind(fp);
               root = benc_decode_file(fp);
 
               if(root != NULL)
               {
-                gdk_threads_enter();;
-               
-                if(!g_str_has_suffix((gchar*)tracker, "info_hash="))
-                  mainwindow_fill_bencode_tree(mwin, mwin->TrackerTreeView, root);
-
-                node = benc_node_find(root, BENC_TYPE_KEY, SHA_DIGEST_LENGTH, torrent_sha);
-
-                if(node != NULL)
-                {
-                  child = benc_node_find_key(node, "complete");
-                  gtk_entry_set_text(mwin->SeedEntry, child?benc_node_data(child):"?");
-
-                  child = benc_node_find_key(node, "incomplete");
-                  gtk_entry_set_text(mwin->PeersEntry, child?benc_node_data(child):"?");
-
-                  child = benc_node_find_key(node, "downloaded");
-                  gtk_entry_set_text(mwin->DownloadedEntry, child?benc_node_data(child):"?");
-                }
-                else
-                {
-                  gtk_entry_set_text(mwin->SeedEntry, "?");
-                  gtk_entry_set_text(mwin->PeersEntry, "?");
-                  gtk_entry_set_text(mwin->DownloadedEntry, "?");
-                }
- 
-                benc_node_destroy(root);          
-
-                log_ok("%s", _("Scrape success."));
-                gdk_threads_leave();
+                event = g_new0(UiEvent, 1);
+                event->type = UI_EVENT_SCRAPE_RESULT;
+                event->data = root;
+                event->show = !g_str_has_suffix((gchar*)tracker, "info_hash=");
+                memcpy(event->info_hash, torrent_sha, SHA_DIGEST_LENGTH);
+                event_queue_push(gevents, &event->item);
               }
               else
-              {
-                gdk_threads_enter();;
                 log_error("%s", _("Bad data from tracker"));
-                gdk_threads_leave();
-              }
             }
-
-            G_UNLOCK(thread_mutex);
           }
           else
-          {
-            G_UNLOCK(thread_mutex);
-            gdk_threads_enter();;
             log_error("%s", msn);
-            gdk_threads_leave();
-          }
-          
+
           curl_easy_cleanup(curl);
         }
         else
-        {
-          gdk_threads_enter();;
           log_error("%s", _("Error in Curl library."));
-          gdk_threads_leave();
-        }
+
+        fclose(fp);
       }
       else
-      {
-        gdk_threads_enter();;
         log_error("%s", _("Couldn't create the temporary file for the tracker scrape."));
-        gdk_threads_leave();
-      }
-
-      fclose(fp);
     }
-    else 
-    {
-      gdk_threads_enter();;
+    else
       log_error("%s", _("This tracker don't support scrape."));
-      gdk_threads_leave();
-    }
 
     g_free(host);
   }
   else
-  {
-    gdk_threads_enter();;
     log_error("%s", _("Couldn't scrape. Bad Torrent data, Info section lost."));
-    gdk_threads_leave();
-  }
-  
+
   g_free(tracker);
 
-  /* interval timeout wait there */
-  seeds_button_label = g_strdup(gtk_label_get_label(mwin->RefreshSeedsButtonLabel));
-  tracker_button_label = g_strdup(gtk_label_get_label(mwin->RefreshTrackerButtonLabel));
-  while(timeout > 0)
+  /* the interval timeout is waited in the main loop */
+  ui_event_post(UI_EVENT_SCRAPE_DONE, NULL, NULL);
+  return NULL;
+}
+
+/**
+ * @brief Load the details of the shown torrent in a new thread, if they
+ *        aren't loaded or being loaded. Called from the main loop.
+ */
+void
+torrent_details_load(void)
+{
+  GError *err = NULL;
+
+  if(gtorrent == NULL || details_loading)
+    return;
+
+  /* the thread keeps a reference, another torrent can be loaded */
+  if(g_thread_create(torrent_details, torrent_ref(gtorrent), FALSE, &err) == NULL)
   {
-    G_LOCK(thread_mutex);
-    if(scrape_cancel)
-    {
-      G_UNLOCK(thread_mutex);
-      break;
-    }
-    G_UNLOCK(thread_mutex);
-    
-    string = g_strdup_printf(_("Wait(%i)"), timeout);
-    
-    gdk_threads_enter();;
-    gtk_label_set_label(mwin->RefreshSeedsButtonLabel, string); 
-    gtk_label_set_label(mwin->RefreshTrackerButtonLabel, string); 
-    gdk_threads_leave();
-    g_free(string);
-    
-    timeout--;
-    g_usleep(G_USEC_PER_SEC);
+    g_warning("%s", err->message);
+    g_error_free(err);
+    torrent_free(gtorrent);
+    return;
   }
 
-  gdk_threads_enter();;
-  gtk_label_set_label(mwin->RefreshSeedsButtonLabel, tracker_button_label); 
-  gtk_label_set_label(mwin->RefreshTrackerButtonLabel, tracker_button_label); 
-  gtk_widget_set_sensitive(GTK_WIDGET(mwin->RefreshSeedsButton), TRUE);
-  gtk_widget_set_sensitive(GTK_WIDGET(mwin->RefreshTrackerButton), TRUE);
-  gdk_threads_leave();
+  details_loading = TRUE;
+  return;
+}
 
-  g_free(seeds_button_label);
-  g_free(tracker_button_label);
+/**
+ * @brief Decode a torrent and make its details model, the result is sent
+ *        to the main loop (torrent_details_ready).
+ *
+ * @param data: the Torrent (a reference).
+ * @return nothing, this is not a joinble thread.
+ */
+static gpointer
+torrent_details(gpointer data)
+{
+  Torrent *torrent = (Torrent*)data;
+  UiEvent *event;
 
-  G_LOCK(thread_mutex);
-  scrape_thread = NULL;
-  scrape_cancel = FALSE;
-  G_UNLOCK(thread_mutex);
+  event = g_new0(UiEvent, 1);
+  event->type = UI_EVENT_DETAILS_READY;
+  event->data = torrent;
+  event->model = mainwindow_details_model_new(MAINWINDOW(gmainwin), torrent);
+
+  if(event->model == NULL)
+    log_error(_("Open error: %s is not a bencoded torrent file or have corrupted data."),
+              torrent->filename);
 
-  return NULL;  
+  event_queue_push(gevents, &event->item);
+  return NULL;
 }
 
 /**
- * @brief Check The files.
+ * @brief Start a files check in a new thread.
+ *
+ * The torrent, the files list and the options are taken here (in the
+ * main loop), the thread doesn't touch the widgets.
  *
- * @param name: the file or folder name, It most 
+ * @param name: the file or folder name, It most
  *        be dinamic allocated 'cos it will be free() here.
- * @return nothing.
  */
-gpointer
-check_files(gpointer name)
+void
+check_files_start(gchar *name)
 {
-  struct _fq
-  {
-    gchar *filename;
-    GtkTreeIter iter;
-    gint64 filesize, fileremain, firstpiecesize, lastpiecesize;
-    guint  firstpiece, npieces;    
-    GBitArray *pieces_array;
-  } *files_queue;
-  guint files_number, pieces_number;
-  gint64 readed, piece_size, offset;
-  guint i, j, k;
-  gchar *string, *piece_buf, *torrent_sha_array, sha[SHA_DIGEST_LENGTH];
-  GtkTreeModel *liststore;
-  FILE *fp;
-  BencNode *node;
+  CheckFilesData *check;
+  GThread *thread;
+  GError *err = NULL;
+  guint i;
   MainWindow *mwin = MAINWINDOW(gmainwin);
 
   G_LOCK(thread_mutex);
-  if(checkfiles_thread == NULL)
-    checkfiles_thread = g_thread_self();
-  else
+  if(checkfiles_thread != NULL)
   {
-    gdk_threads_enter();;
-    log_warning("%s", _("Already checking files. Try again later."));
-    gdk_threads_leave();
     G_UNLOCK(thread_mutex);
-    if(name)
-      g_free(name);    
+    log_warning("%s", _("Already checking files. Try again later."));
+    g_free(name);
+    return;
   }
+
+  check = g_new0(CheckFilesData, 1);
+  check->name = name;
+  check->torrent = (gtorrent != NULL)? torrent_ref(gtorrent) : NULL;
+  check->incremental = gtk_toggle_button_get_active(mwin->IncrementalCheckButton);
+  check->files = GTK_FILE_LIST_MODEL(gtk_tree_view_get_model(mwin->FilesTreeView));
+  g_object_ref(G_OBJECT(check->files));
+  check->n_files = gtk_file_list_model_get_n_files(check->files);
+  check->remains = g_new(gint64, check->n_files);
+  check->seqs = g_new0(gint, check->n_files);
+  check->shown = g_new0(gint, check->n_files);
+  for(i = 0; i < check->n_files; i++)
+    check->remains[i] = gtk_file_list_model_get_size(check->files, i);
+
+  thread = g_thread_create(check_files, check, FALSE, &err);
+  checkfiles_thread = thread;
   G_UNLOCK(thread_mutex);
 
-  gdk_threads_enter();;
+  if(thread == NULL)
+  {
+    g_warning("%s", err->message);
+    g_error_free(err);
+    check_files_data_free(check);
+    return;
+  }
+
   gtk_widget_set_sensitive(GTK_WIDGET(mwin->CheckFilesButton), FALSE);
-  gdk_threads_leave();
+  return;
+}
 
-  G_LOCK(thread_mutex);
-  node = benc_node_find_key(gtorrentmetainfo, "pieces");
+/**
+ * @brief Check The files.
+ *
+ * The pieces are checked by a Verify engine (a reader and a pool of
+ * hashing threads), the files list is updated by the main loop as the
+ * pieces are checked, and at the end (check_files_done).
+ *
+ * @param data: the CheckFilesData, see check_files_start.
+ * @return nothing.
+ */
+static gpointer
+check_files(gpointer data)
+{
+  CheckFilesData *check = (CheckFilesData*)data;
+  Verify *verify;
+  guint i, pieces_number;
+  gint64 piece_size;
+  gint error;
+  gboolean complete;
+  gchar *filename, *torrent_sha_array;
+  BencNode *info, *node;
+
+  /* the torrent is a reference, it doesn't change while checking (a
+   * cached torrent is decoded here, out of the main loop) */
+  info = (check->torrent != NULL)? torrent_get_info(check->torrent) : NULL;
+  node = benc_dict_get(info, "pieces");
   if(node != NULL)
   {
     pieces_number = benc_node_length(node)/SHA_DIGEST_LENGTH;
@@ -553,201 +674,537 @@ check_files(gpointer name)
     pieces_number = 0;
     torrent_sha_array = NULL;
   }
-  node = benc_node_find_key(gtorrentmetainfo, "piece length");
+  node = benc_dict_get(info, "piece length");
   if(node != NULL)
-    piece_size = strtol(benc_node_data(node), (char**)NULL, 10);
+    piece_size = benc_node_integer(node);
   else
     piece_size = 0;
 
-  G_UNLOCK(thread_mutex);
-  liststore = gtk_tree_view_get_model(mwin->FilesTreeView);
-  files_number = gtk_tree_model_iter_n_children(liststore, NULL);
-  if(files_number > 0 && pieces_number > 0 && piece_size > 0)
+  /* the engine keeps a copy of the hashes */
+  verify = (pieces_number > 0 && piece_size > 0)?
+           verify_new(torrent_sha_array, pieces_number, piece_size) : NULL;
+
+  /* an interrupted check of the same data is resumed, and an incremental
+   * one only reads the files changed (or replaced) since the last check */
+  if(verify != NULL && check->name != NULL)
+  {
+    filename = verify_checkpoint_filename(check->torrent->info_hash, check->name);
+    verify_set_checkpoint(verify, filename);
+    verify_set_incremental(verify, check->incremental, TRUE);
+    g_free(filename);
+  }
+
+  if(check->n_files > 0 && verify != NULL)
   {
-    gdk_threads_enter();;
-    log_ok("%s", _("Files check started."));
-    gdk_threads_leave();
-
-    G_LOCK(thread_mutex);
-    piece_buf = g_malloc0(piece_size);
-    /* load the files queue */
-    files_queue = g_new0(struct _fq, files_number);
-    for(i = 0, offset = 0; i < files_number; i++) 
+    /* all the files share the pieces of the files list */
+    check->pieces = gtk_file_list_model_get_pieces(check->files);
+    if(check->pieces != NULL)
     {
-      if(gtk_tree_model_iter_nth_child(liststore, &files_queue[i].iter, NULL, i))
-      {
-        gtk_tree_model_get(liststore, &files_queue[i].iter, 
-                           COL_FILE_NAME, &string,
-                           COL_FILE_SIZE, &files_queue[i].filesize, 
-                           COL_FILE_FIRST_PIECE, &files_queue[i].firstpiece,
-                           COL_FILE_N_PIECES, &files_queue[i].npieces, 
-                           COL_FILE_PIECESBITARRAY, &files_queue[i].pieces_array,
-                           -1);
-        g_bitarray_clear(files_queue[i].pieces_array);
-        files_queue[i].fileremain = files_queue[i].filesize;
-        files_queue[i].lastpiecesize = 0;
-        files_queue[i].firstpiecesize = MIN(piece_size-offset, files_queue[i].filesize);
-        if(offset >= piece_size)
-          offset = files_queue[i].filesize - piece_size*(files_queue[i].npieces-1);
-        else
-          offset += files_queue[i].filesize - piece_size*(files_queue[i].npieces-1);
-        
-        if(files_number > 1)
-          files_queue[i].filename = g_strdup_printf("%s/%s", (gchar*)name, string);
-        else
-          files_queue[i].filename = g_strdup(name);
+      g_object_ref(G_OBJECT(check->pieces));
+      g_bitarray_clear(check->pieces);
+    }
 
-        g_free(string);
-      }
+    /* load the files, the names and sizes of the files list don't change */
+    for(i = 0; i < check->n_files; i++)
+    {
+      if(check->n_files > 1)
+        filename = g_strdup_printf("%s/%s", check->name,
+                                   gtk_file_list_model_get_name(check->files, i));
       else
-      {
-        gdk_threads_enter();;
-        log_warning("%s", _("Unexpected files list reading error."));
-        gdk_threads_leave();
-      }
+        filename = g_strdup(check->name);
+
+      verify_add_file(verify, filename, gtk_file_list_model_get_size(check->files, i));
+      g_free(filename);
     }
-    G_UNLOCK(thread_mutex);
+    ui_event_post(UI_EVENT_CHECK_STARTED, NULL, check);
 
-    /* check the files */   
-    for(i = 0, j = 0; i < files_number; i++, j = 0) 
-    {     
-      G_LOCK(thread_mutex);            
-      if(checkfiles_cancel)
-      {
-        G_UNLOCK(thread_mutex);
-        break;
-      }
+    /* check the files */
+    complete = verify_run(verify, check_files_piece_checked, check);
 
-      gdk_threads_enter();;
-      gtk_list_store_set(GTK_LIST_STORE(liststore), &files_queue[i].iter, 
-                         COL_FILE_REMAINS, files_queue[i].fileremain, -1);    
-      gdk_threads_leave();
-      G_UNLOCK(thread_mutex);
+    if(verify_get_n_resumed(verify) > 0)
+      log_ok(check->incremental?
+             _("%u pieces of unchanged files were taken from the last check."):
+             _("%u pieces were taken from the last interrupted check."),
+             verify_get_n_resumed(verify));
 
-      if((fp = fopen(files_queue[i].filename, "r")) != NULL)
+    if(complete)
+    {
+      check->states = g_new(guint8, check->n_files);
+      for(i = 0; i < check->n_files; i++)
       {
-        if(i > 0 && (files_queue[i].firstpiece == files_queue[i-1].firstpiece + files_queue[i-1].npieces - 1))
-        {
-          if(g_bitarray_get_bit(files_queue[i-1].pieces_array, files_queue[i-1].firstpiece+files_queue[i-1].npieces-1) == TRUE)
-          {
-            g_bitarray_set_bit(files_queue[i].pieces_array, files_queue[i].firstpiece, 1);
-            files_queue[i].fileremain -= files_queue[i].firstpiecesize;
-          }
-          _fseeko(fp, files_queue[i].firstpiecesize, SEEK_SET);
-          j++;
-        }
- 
-        for( ; j < files_queue[i].npieces && !feof(fp); j++)
-        {
-          G_LOCK(thread_mutex);      
-          if(checkfiles_cancel)
-          {
-            G_UNLOCK(thread_mutex);
-            break;
-          }
-          
-          files_queue[i].lastpiecesize = (gint64)fread(piece_buf, sizeof(gchar), (size_t)piece_size, fp);
-          readed = files_queue[i].lastpiecesize;
-        
-          if(readed < piece_size)
-          {
-            if(j == files_queue[i].npieces-1)
-            {
-              for(k = i+1; readed < piece_size && k < files_number; k++)
-              {
-                fclose(fp);
-                if((fp = fopen(files_queue[k].filename, "r")) == NULL)
-                  break;
-          
-                files_queue[k].lastpiecesize = (gint64)fread(piece_buf+readed, sizeof(gchar), (size_t)piece_size-readed, fp);
-                readed += files_queue[k].lastpiecesize;
-              }
-            }
-            else
-            {
-              gdk_threads_enter();;
-              log_warning(_("%s is smaller than it should be"), files_queue[i].filename);
-              gdk_threads_leave();
-            }
-          }
-          
-          SHA1((guint8*)piece_buf, (guint32)readed, (guint8*)sha);
-          if(memcmp(sha, torrent_sha_array+((j+files_queue[i].firstpiece)*SHA_DIGEST_LENGTH), SHA_DIGEST_LENGTH) == 0)
-          {
-            g_bitarray_set_bit(files_queue[i].pieces_array, files_queue[i].firstpiece+j, 1);
-            files_queue[i].fileremain -= files_queue[i].lastpiecesize;
-            gdk_threads_enter();;
-            gtk_list_store_set(GTK_LIST_STORE(liststore), &files_queue[i].iter, 
-                               COL_FILE_REMAINS, files_queue[i].fileremain, -1);    
-            gdk_threads_leave();
-          }
-          G_UNLOCK(thread_mutex);
-        }
-
-        if(fp != NULL)
-          fclose(fp);
-
-        G_LOCK(thread_mutex); 
-        if(!checkfiles_cancel)
-        {
-          gdk_threads_enter();;
-          gtk_list_store_set(GTK_LIST_STORE(liststore), &files_queue[i].iter, 
-                             COL_FILE_ICON, mwin->file_state_icons[files_queue[i].fileremain>0?FILE_STATE_BAD:FILE_STATE_OK],
-                             COL_FILE_REMAINS, files_queue[i].fileremain, -1);    
-          gdk_threads_leave();
-        }
-        G_UNLOCK(thread_mutex); 
+        error = verify_file_error(verify, i);
+        if(error == VERIFY_FILE_SHORT)
+          log_warning(_("%s is smaller than it should be"), verify_file_name(verify, i));
+        else if(error != 0)
+          log_warning("%s: %s", verify_file_name(verify, i), g_strerror(error));
+
+        check->states[i] = (error != 0 || verify_file_remain(verify, i) > 0)?
+                           FILE_STATE_BAD : FILE_STATE_OK;
+
+        g_atomic_int_inc(&check->seqs[i]);
+        check->remains[i] = verify_file_remain(verify, i);
+        g_atomic_int_inc(&check->seqs[i]);
       }
-      else
-      {
-        G_LOCK(thread_mutex); 
-        if(!checkfiles_cancel)
-        {
-          gdk_threads_enter();;
-          log_warning("%s: %s", files_queue[i].filename, g_strerror(errno));
-          gtk_list_store_set(GTK_LIST_STORE(liststore), &files_queue[i].iter, 
-                             COL_FILE_ICON, mwin->file_state_icons[FILE_STATE_BAD],
-                             COL_FILE_REMAINS, files_queue[i].filesize, -1);    
-          gdk_threads_leave();
-        }
-        G_UNLOCK(thread_mutex); 
-      }
-      
-    }
-    /* free the files queue */
-    for(i = 0; i < files_number; i++) 
-    {
-      g_object_unref(G_OBJECT(files_queue[i].pieces_array));
-      g_free(files_queue[i].filename);
+      g_atomic_int_set(&check->changed, TRUE);
+      log_ok("%s", _("Files check complete."));
     }
-    g_free(files_queue);
-    g_free(piece_buf);
-    
-    G_LOCK(thread_mutex); 
-    gdk_threads_enter();;
-    if(checkfiles_cancel)
+    else if(g_atomic_int_get(&checkfiles_cancel))
       log_warning("%s", _("Files check canceled."));
     else
-      log_ok("%s", _("Files check complete."));
-    gdk_threads_leave();
-    G_UNLOCK(thread_mutex); 
+      log_error("%s", _("Files check failed, there isn't memory for the pieces or the threads couldn't be created."));
   }
+  else if(piece_size > VERIFY_MAX_PIECE_SIZE)
+    log_error("%s", _("The pieces of the torrent are too big to be checked."));
   else
-  {
-    gdk_threads_enter();;
     log_error("%s", _("The files list seems to be empty"));
-    gdk_threads_leave();
-  }    
 
-  if(name)
-    g_free(name);    
- 
-  gdk_threads_enter();;
+  verify_free(verify);
+
+  /* check belongs to the main loop from here */
+  ui_event_post(UI_EVENT_CHECK_DONE, NULL, check);
+  return NULL;
+}
+
+/**
+ * @brief Send an event to the main loop, from any thread.
+ *
+ * @param type: the UiEventType.
+ * @param text: a text for the event (it's freed after the event), or NULL.
+ * @param data: the data of the event, or NULL.
+ */
+static void
+ui_event_post(UiEventType type, gchar *text, gpointer data)
+{
+  UiEvent *event;
+
+  event = g_new0(UiEvent, 1);
+  event->type = type;
+  event->text = text;
+  event->data = data;
+  event_queue_push(gevents, &event->item);
+
+  return;
+}
+
+/**
+ * @brief Send a log line to the main loop, from any thread.
+ *
+ * @param level: LOG_OK, LOG_WARNING or LOG_ERROR.
+ * @param format: the printf format of the line.
+ */
+static void
+ui_event_log(gshort level, const gchar *format, ...)
+{
+  UiEvent *event;
+  va_list args;
+
+  event = g_new0(UiEvent, 1);
+  event->type = UI_EVENT_LOG;
+  event->level = level;
+
+  va_start(args, format);
+  event->text = g_strdup_vprintf(format, args);
+  va_end(args);
+
+  event_queue_push(gevents, &event->item);
+  return;
+}
+
+/**
+ * @brief Do an event in the main loop, the only place where the widgets
+ *        are changed for the threads.
+ *
+ * @param item: the UiEvent.
+ * @param user_data: not used.
+ */
+static void
+ui_event_dispatch(EventQueueItem *item, gpointer user_data)
+{
+  UiEvent *event = (UiEvent*)item;
+  MainWindow *mwin = MAINWINDOW(gmainwin);
+
+  switch(event->type)
+  {
+    case UI_EVENT_LOG:
+      mainwindow_log_printf(mwin, event->level, "%s", event->text);
+      break;
+    case UI_EVENT_OPEN_STARTED:
+      gtk_widget_set_sensitive(GTK_WIDGET(mwin->OpenToolButton), FALSE);
+      break;
+    case UI_EVENT_OPEN_FAILED:
+      gtk_widget_set_sensitive(GTK_WIDGET(mwin->OpenToolButton), TRUE);
+      break;
+    case UI_EVENT_TORRENT_LOADED:
+      torrent_loaded(event->text, (Torrent*)event->data, event->tabs);
+      event->text = NULL;
+      break;
+    case UI_EVENT_SCRAPE_STARTED:
+      gtk_widget_set_sensitive(GTK_WIDGET(mwin->RefreshSeedsButton), FALSE);
+      gtk_widget_set_sensitive(GTK_WIDGET(mwin->RefreshTrackerButton), FALSE);
+      break;
+    case UI_EVENT_SCRAPE_RESULT:
+      tracker_scrape_result((BencNode*)event->data, event->show, event->info_hash);
+      break;
+    case UI_EVENT_SCRAPE_DONE:
+      tracker_scrape_countdown(NULL);
+      break;
+    case UI_EVENT_DETAILS_READY:
+      torrent_details_ready((Torrent*)event->data, event->model);
+      break;
+    case UI_EVENT_CHECK_STARTED:
+      check_files_started((CheckFilesData*)event->data);
+      break;
+    default: /* UI_EVENT_CHECK_DONE */
+      check_files_done((CheckFilesData*)event->data);
+  }
+
+  g_free(event->text);
+  g_free(event);
+  return;
+}
+
+/**
+ * @brief Show a loaded torrent, it cancels the scrape and the files check
+ *        of the previous one.
+ *
+ * @param name: the file name (it's saved in gfilename).
+ * @param torrent: the Torrent (it's saved in gtorrent).
+ * @param tabs: the contents of the tabs, it's freed here.
+ */
+static void
+torrent_loaded(gchar *name, Torrent *torrent, MainWindowTabs *tabs)
+{
+  MainWindow *mwin = MAINWINDOW(gmainwin);
+
+  /* cancel any other thread */
+  G_LOCK(thread_mutex);
+
+  if(scrape_thread != NULL)
+    scrape_cancel = TRUE;
+
+  if(checkfiles_thread != NULL)
+    g_atomic_int_set(&checkfiles_cancel, TRUE);
+
+  /* save filename pointer in a global variable, IMPORTANT: don't free it outside of here. */
+  if(gfilename != NULL)
+    g_free(gfilename);
+
+  gfilename = name;
+
+  /* save torrent pointer in a global variable, IMPORTANT: don't free it outside of here. */
+  if(gtorrent != NULL)
+    torrent_free(gtorrent);
+
+  gtorrent = torrent;
+
+  G_UNLOCK(thread_mutex);
+
+  /* ok, show the prepared tabs */
+  mainwindow_tabs_show(mwin, tabs);
+  mainwindow_tabs_free(tabs);
+
+  /* the details of a cached torrent are loaded when they are showed */
+  if(gtk_tree_view_get_model(mwin->TorrentTreeView) == NULL &&
+     gtk_widget_get_mapped(GTK_WIDGET(mwin->TorrentTreeView)))
+    torrent_details_load();
+
+  log_ok("%s",_("Open success."));
+  gtk_widget_set_sensitive(GTK_WIDGET(mwin->OpenToolButton), TRUE);
+
+  return;
+}
+
+/**
+ * @brief Show the details of a torrent, if it's still the shown one.
+ *
+ * @param torrent: the Torrent (a reference, it's freed here).
+ * @param model: its details model (it's unrefed here), or NULL.
+ */
+static void
+torrent_details_ready(Torrent *torrent, GtkTreeModel *model)
+{
+  MainWindow *mwin = MAINWINDOW(gmainwin);
+
+  details_loading = FALSE;
+
+  if(torrent == gtorrent)
+  {
+    if(model != NULL)
+      gtk_tree_view_set_model(mwin->TorrentTreeView, model);
+  }
+  else if(gtk_tree_view_get_model(mwin->TorrentTreeView) == NULL &&
+          gtk_widget_get_mapped(GTK_WIDGET(mwin->TorrentTreeView)))
+    torrent_details_load(); /* another one was loaded meanwhile */
+
+  if(model != NULL)
+    g_object_unref(G_OBJECT(model));
+  torrent_free(torrent);
+
+  return;
+}
+
+/**
+ * @brief Show the answer of a tracker scrape.
+ *
+ * @param root: the answer (it's destroyed here, or by the tracker details).
+ * @param show: TRUE to show it in the tracker details.
+ * @param info_hash: the info hash of the scraped torrent.
+ */
+static void
+tracker_scrape_result(BencNode *root, gboolean show, const gchar *info_hash)
+{
+  BencNode *node, *child;
+  gboolean canceled;
+  MainWindow *mwin = MAINWINDOW(gmainwin);
+
+  G_LOCK(thread_mutex);
+  canceled = scrape_cancel;
+  G_UNLOCK(thread_mutex);
+
+  if(canceled)
+  {
+    benc_node_destroy(root);
+    return;
+  }
+
+  node = benc_dict_lookup(benc_dict_get(root, "files"),
+                          info_hash, SHA_DIGEST_LENGTH);
+
+  if(node != NULL)
+  {
+    child = benc_dict_get(node, "complete");
+    gtk_entry_set_text(mwin->SeedEntry, child?benc_node_data(child):"?");
+
+    child = benc_dict_get(node, "incomplete");
+    gtk_entry_set_text(mwin->PeersEntry, child?benc_node_data(child):"?");
+
+    child = benc_dict_get(node, "downloaded");
+    gtk_entry_set_text(mwin->DownloadedEntry, child?benc_node_data(child):"?");
+  }
+  else
+  {
+    gtk_entry_set_text(mwin->SeedEntry, "?");
+    gtk_entry_set_text(mwin->PeersEntry, "?");
+    gtk_entry_set_text(mwin->DownloadedEntry, "?");
+  }
+
+  /* the tree model owns root then */
+  if(show)
+    mainwindow_fill_bencode_tree(mwin, mwin->TrackerTreeView, root,
+                                 root, (GDestroyNotify)benc_node_destroy);
+  else
+    benc_node_destroy(root);
+
+  log_ok("%s", _("Scrape success."));
+  return;
+}
+
+/**
+ * @brief The wait after a scrape, the refresh buttons show the seconds
+ *        left. It's called with NULL when the scrape ends, then every
+ *        second by a timeout until the wait ends or it's canceled.
+ *
+ * @param data: the ScrapeWait, NULL to start.
+ * @return TRUE while waiting.
+ */
+static gboolean
+tracker_scrape_countdown(gpointer data)
+{
+  ScrapeWait *wait = (ScrapeWait*)data;
+  gchar *string;
+  gboolean canceled;
+  MainWindow *mwin = MAINWINDOW(gmainwin);
+
+  if(wait == NULL)
+  {
+    wait = g_new0(ScrapeWait, 1);
+    wait->timeout = DEF_WAIT_AFTER_SCRAPE;
+    wait->seeds_label = g_strdup(gtk_label_get_label(mwin->RefreshSeedsButtonLabel));
+    wait->tracker_label = g_strdup(gtk_label_get_label(mwin->RefreshTrackerButtonLabel));
+
+    if(tracker_scrape_countdown(wait))
+      g_timeout_add_seconds(1, tracker_scrape_countdown, wait);
+    return FALSE;
+  }
+
+  G_LOCK(thread_mutex);
+  canceled = scrape_cancel;
+  G_UNLOCK(thread_mutex);
+
+  if(wait->timeout > 0 && !canceled)
+  {
+    string = g_strdup_printf(_("Wait(%i)"), wait->timeout);
+    gtk_label_set_label(mwin->RefreshSeedsButtonLabel, string);
+    gtk_label_set_label(mwin->RefreshTrackerButtonLabel, string);
+    g_free(string);
+
+    wait->timeout--;
+    return TRUE;
+  }
+
+  gtk_label_set_label(mwin->RefreshSeedsButtonLabel, wait->seeds_label);
+  gtk_label_set_label(mwin->RefreshTrackerButtonLabel, wait->tracker_label);
+  gtk_widget_set_sensitive(GTK_WIDGET(mwin->RefreshSeedsButton), TRUE);
+  gtk_widget_set_sensitive(GTK_WIDGET(mwin->RefreshTrackerButton), TRUE);
+
+  g_free(wait->seeds_label);
+  g_free(wait->tracker_label);
+  g_free(wait);
+
+  G_LOCK(thread_mutex);
+  scrape_thread = NULL;
+  scrape_cancel = FALSE;
+  G_UNLOCK(thread_mutex);
+
+  return FALSE;
+}
+
+/**
+ * @brief Called by the Verify engine for each checked piece. It publishes
+ *        the remaining bytes of the files of the piece, the files list is
+ *        updated by check_files_refresh.
+ *
+ * @param verify: the Verify.
+ * @param piece: the piece index.
+ * @param valid: TRUE if the piece is right.
+ * @param first_file: the first file of the piece.
+ * @param last_file: the last file of the piece.
+ * @param data: the CheckFilesData.
+ */
+static void
+check_files_piece_checked(Verify *verify, guint piece, gboolean valid,
+                          guint first_file, guint last_file, gpointer data)
+{
+  CheckFilesData *check = (CheckFilesData*)data;
+  guint i;
+
+  if(g_atomic_int_get(&checkfiles_cancel))
+    verify_cancel(verify);
+  else if(valid)
+  {
+    if(check->pieces != NULL)
+      g_bitarray_set_bit(check->pieces, piece, TRUE);
+
+    for(i = first_file; i <= last_file; i++)
+    {
+      g_atomic_int_inc(&check->seqs[i]);
+      check->remains[i] = verify_file_remain(verify, i);
+      g_atomic_int_inc(&check->seqs[i]);
+    }
+    g_atomic_int_set(&check->changed, TRUE);
+  }
+
+  return;
+}
+
+/**
+ * @brief The files check started: the remains of the files are their
+ *        sizes, and they are refreshed every CHECK_FILES_REFRESH_INTERVAL.
+ *
+ * @param check: the CheckFilesData.
+ */
+static void
+check_files_started(CheckFilesData *check)
+{
+  guint i;
+
+  for(i = 0; i < check->n_files; i++)
+    gtk_file_list_model_set_remains(check->files, i,
+                                    gtk_file_list_model_get_size(check->files, i));
+
+  check->refresh_id = g_timeout_add(CHECK_FILES_REFRESH_INTERVAL,
+                                    check_files_refresh, check);
+
+  log_ok("%s", _("Files check started."));
+  return;
+}
+
+/**
+ * @brief The files check ended (the thread doesn't use check anymore):
+ *        show the last remains and the state of the files.
+ *
+ * @param check: the CheckFilesData, it's freed here.
+ */
+static void
+check_files_done(CheckFilesData *check)
+{
+  guint i;
+  MainWindow *mwin = MAINWINDOW(gmainwin);
+
+  if(check->refresh_id != 0)
+  {
+    g_source_remove(check->refresh_id);
+    check_files_refresh(check);
+  }
+
+  for(i = 0; check->states != NULL && i < check->n_files; i++)
+    gtk_file_list_model_set_state(check->files, i, check->states[i]);
+
   gtk_widget_set_sensitive(GTK_WIDGET(mwin->CheckFilesButton), TRUE);
-  gdk_threads_leave();
+  check_files_data_free(check);
+
   G_LOCK(thread_mutex);
   checkfiles_thread = NULL;
-  checkfiles_cancel = FALSE;
+  g_atomic_int_set(&checkfiles_cancel, FALSE);
   G_UNLOCK(thread_mutex);
-  return NULL;
+
+  return;
+}
+
+/**
+ * @brief Show the remaining bytes published by check_files_piece_checked,
+ *        every CHECK_FILES_REFRESH_INTERVAL ms in the main loop.
+ *
+ * A file being written is skipped, its writer sets changed again.
+ *
+ * @param data: the CheckFilesData.
+ * @return TRUE, the timeout is removed by check_files_done.
+ */
+static gboolean
+check_files_refresh(gpointer data)
+{
+  CheckFilesData *check = (CheckFilesData*)data;
+  gint64 remains;
+  gint seq;
+  guint i;
+
+  if(g_atomic_int_compare_and_exchange(&check->changed, TRUE, FALSE))
+  {
+    for(i = 0; i < check->n_files; i++)
+    {
+      seq = g_atomic_int_get(&check->seqs[i]);
+      if(seq == check->shown[i] || (seq & 1))
+        continue;
+
+      remains = check->remains[i];
+      if(g_atomic_int_get(&check->seqs[i]) != seq)
+        continue;
+
+      check->shown[i] = seq;
+      gtk_file_list_model_set_remains(check->files, i, remains);
+    }
+  }
+
+  return TRUE;
+}
+
+/**
+ * @brief Free a CheckFilesData.
+ *
+ * @param check: the CheckFilesData.
+ */
+static void
+check_files_data_free(CheckFilesData *check)
+{
+  torrent_free(check->torrent);
+  g_object_unref(G_OBJECT(check->files));
+  if(check->pieces != NULL)
+    g_object_unref(G_OBJECT(check->pieces));
+  g_free(check->name);
+  g_free(check->remains);
+  g_free(check->seqs);
+  g_free(check->shown);
+  g_free(check->states);
+  g_free(check);
+  return;
 }
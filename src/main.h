@@ -15,6 +15,8 @@
 
 #define LOG_WELCOME_MSN     PACKAGE_NAME " started."
 
+#define CHECK_FILES_REFRESH_INTERVAL  33 /* ms between files list updates (~30Hz) */
+
 /* GLOBALS ******************************************************************/
 
 extern gboolean gissaved;
@@ -25,7 +27,8 @@ G_BEGIN_DECLS
 
 gpointer open_torrent_file(gpointer name);
 gpointer tracker_scrape(gpointer tracker);
-gpointer check_files(gpointer name);
+void     torrent_details_load(void);
+void     check_files_start(gchar *name);
 
 G_END_DECLS
 
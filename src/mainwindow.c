@@ -33,7 +33,7 @@
 
 #include <time.h>
 #include <stdarg.h>
-#include <math.h>
+#include <string.h>
 
 #include <glib.h>
 #include <glib/gi18n.h>
@@ -43,11 +43,14 @@
 #include <gtk/gtk.h>
 
 #include "bencode.h"
+#include "torrent.h"
 #include "utilities.h"
 #include "sha1.h"
 #include "main.h"
 #include "gbitarray.h"
 #include "gtkcellrendererbitarray.h"
+#include "gtkbenctreemodel.h"
+#include "gtkfilelistmodel.h"
 #include "mainwindow.h"
 
 #include "inline_pixmaps.h"
@@ -73,7 +76,9 @@ static void mainwindow_create_about_tab(MainWindow *mwin, GtkWidget *notebook);
 static void mainwindow_signal_autoconnect(MainWindow *mwin);
 static void mainwindow_drag_drop_signal_connect(GtkWidget *widget);
 
-static void mainwindow_append_row_bencode_tree(GtkTreeStore *treestore, GtkTreeIter *parent, gchar *prefix, GdkPixbuf **icons, BencNode *data);
+static gchar *mainwindow_node_strdup(BencNode *node);
+static gint64 mainwindow_set_files_from_info(GtkFileListModel *model, BencNode *info, gint64 piece_length, guint total_pieces);
+
 
 void cell_int64_to_human(GtkTreeViewColumn *tree_column, GtkCellRenderer *cell, GtkTreeModel *tree_model, GtkTreeIter *iter, gpointer data);
 
@@ -86,6 +91,7 @@ void on_QuitToolButton_clicked(MainWindow *mwin, gpointer user_data);
 void on_RefreshSeedsButton_clicked(MainWindow *mwin, gpointer user_data);
 void on_CheckFilesButton_clicked(MainWindow *mwin, gpointer user_data);
 void on_RefreshTrackerButton_clicked(MainWindow *mwin, gpointer user_data);
+void on_TorrentTreeView_map(MainWindow *mwin, gpointer user_data);
 
 /* DEFINES AND ENUMS ********************************************************/
 
@@ -189,277 +195,263 @@ mainwindow_log_printf(MainWindow const *mwin, gshort event_type, gchar const *fo
 }
 
 /**
- * @brief Fill the General Tab
+ * @brief Prepare the contents of the torrent tabs: the texts and the
+ *        models of the files list, the trackers and the torrent details.
  *
- * @param mwin: the MainWindow.
- * @param torrent: the BencNode metainfo.
+ * It doesn't touch the widgets, so it can be called from any thread,
+ * the main loop only has to show the result with mainwindow_tabs_show.
+ * A torrent taken from its MetaCache isn't decoded here, its details
+ * are made when they are showed (mainwindow_details_model_new).
+ *
+ * @param mwin: the MainWindow (only its icons are used).
+ * @param loaded: the loaded Torrent, with its MetaCache (if it's NULL,
+ *        the metainfo is used).
+ * @return the new MainWindowTabs, free it with mainwindow_tabs_free.
  */
-void
-mainwindow_fill_general_tab(MainWindow const *mwin, BencNode *torrent)
+MainWindowTabs *
+mainwindow_tabs_new(MainWindow const *mwin, Torrent *loaded)
 {
-  GtkTextBuffer *text_buffer;
-  BencNode *node;
-  gchar *string, torrent_sha[SHA_DIGEST_LENGTH], date_string[100];
-  guint number;
+  MainWindowTabs *tabs;
+  GtkFileListModel *files_model;
+  GtkListStore *liststore;
+  GtkTreeIter iter;
+  GBitArray *bitarray;
+  BencNode *node, *subnode;
+  MetaCache *cache;
+  const gchar *comment, *path;
+  gchar *string, date_string[100];
   GDate *date;
+  gint64 creation_date, piece_length, total_size;
+  gboolean has_date;
+  guint length, files_number, i, total_pieces, n_trackers;
 
-  /* name */
-  node = benc_node_find_key(torrent, "name");
-  gtk_entry_set_text(mwin->NameEntry, node!=NULL?benc_node_data(node):"");
+  tabs = g_new0(MainWindowTabs, 1);
+  cache = loaded->cache;
 
-  /* tracker announce */
-  node = benc_node_find_key(torrent, "announce");
-  gtk_entry_set_text(mwin->TrackerEntry, node!=NULL?benc_node_data(node):"");
-
-  /* sha1 of info header */
-  node = benc_node_find_key(torrent, "info");
-  if(node != NULL)
+  /* general */
+  if(cache != NULL)
   {
-    string = benc_encode_buf(node, &number);
-    SHA1((guint8*)string, number, (guint8*)torrent_sha);
-    g_free(string);
-    string = util_convert_to_hex(torrent_sha, SHA_DIGEST_LENGTH, NULL);      
-    gtk_entry_set_text(mwin->SHAEntry, string);
-    g_free(string);
-  }
-  else
-    gtk_entry_set_text(mwin->SHAEntry, "");
+    tabs->name = g_strdup(metacache_get_name(cache));
+    tabs->announce = g_strdup(metacache_get_announce(cache));
+    if(metacache_has_info(cache))
+      tabs->sha = util_convert_to_hex((gchar*)loaded->info_hash, SHA_DIGEST_LENGTH, NULL);
+    tabs->created_by = g_strdup(metacache_get_created_by(cache));
 
-  /* created by */
-  node = benc_node_find_key(torrent, "created by");
-  gtk_entry_set_text(mwin->CreatedEntry, node!=NULL?benc_node_data(node):"");
+    comment = metacache_get_comment(cache, &length);
+    tabs->comment = (comment != NULL)? g_strndup(comment, length) : NULL;
 
-  /* comments */
-  node = benc_node_find_key(torrent, "comment");
-  text_buffer = gtk_text_view_get_buffer(mwin->CommentTextView);
-  gtk_text_buffer_set_text(text_buffer, node!=NULL?benc_node_data(node):"", -1);
+    has_date = metacache_get_creation_date(cache, &creation_date);
+  }
+  else /* too big to be cached */
+  {
+    tabs->name = mainwindow_node_strdup(benc_dict_get(loaded->info, "name"));
+    tabs->announce = mainwindow_node_strdup(benc_dict_get(loaded->metainfo, "announce"));
+    if(loaded->info != NULL)
+      tabs->sha = util_convert_to_hex((gchar*)loaded->info_hash, SHA_DIGEST_LENGTH, NULL);
+    tabs->created_by = mainwindow_node_strdup(benc_dict_get(loaded->metainfo, "created by"));
+    tabs->comment = mainwindow_node_strdup(benc_dict_get(loaded->metainfo, "comment"));
+
+    node = benc_dict_get(loaded->metainfo, "creation date");
+    has_date = (node != NULL);
+    creation_date = (node != NULL)? benc_node_integer(node) : 0;
+  }
 
-  /* date */
-  node = benc_node_find_key(torrent, "creation date");
-  if(node != NULL)
+  if(has_date)
   {
     date = g_date_new();
-    number = (guint)g_strtod(benc_node_data(node), (gchar**)NULL);
-    g_date_set_time(date,(GTime)number);
+    g_date_set_time(date,(GTime)creation_date);
     g_date_strftime(date_string, 100, "%x", date);
-    gtk_entry_set_text(mwin->DateEntry, date_string);
+    tabs->date = g_strdup(date_string);
     g_date_free(date);
   }
-  else
-    gtk_entry_set_text(mwin->DateEntry, "");
-
-  /* clean the seeds, peers and dowloaded entry */
-  gtk_entry_set_text(mwin->SeedEntry, "");
-  gtk_entry_set_text(mwin->PeersEntry, "");
-  gtk_entry_set_text(mwin->DownloadedEntry, "");
 
-  /* activate the resfresh seed and peers button */
-  gtk_widget_set_sensitive(GTK_WIDGET(mwin->RefreshSeedsButton), TRUE);
-
-  return;
-}
-
-/**
- * @brief Fill the Files Tab
- *
- * @param mwin: the MainWindow.
- * @param torrent: the BencNode metainfo.
- */
-void
-mainwindow_fill_files_tab(MainWindow const *mwin, BencNode *torrent)
-{
-  GtkListStore *liststore;
-  GtkTreeIter child;
-  GBitArray *bitarray;
-  BencNode *node, *subnode, *value;
-  gchar *string;
-  gint files_number, i, total_pieces, piece_length, n_pieces;
-  gint64 size;
-  gdouble first_piece, total_size, tmp;
-
-  files_number = 0;
-  total_size = 0.0l;
-
-  /* pieces */ 
-  node = benc_node_find_key(torrent, "pieces");
-  if(node != NULL)
+  /* files */
+  if(cache != NULL)
   {
-    total_pieces = benc_node_length(node)/SHA_DIGEST_LENGTH;
-    string = g_strdup_printf("%i", total_pieces);
-    gtk_entry_set_text(mwin->PiecesEntry, string);
-    g_free(string);
+    total_pieces = metacache_get_n_pieces(cache);
+    piece_length = metacache_get_piece_length(cache);
+    files_number = metacache_get_n_files(cache);
   }
   else
   {
-    total_pieces = 0;
-    gtk_entry_set_text(mwin->PiecesEntry, "0");
+    node = benc_dict_get(loaded->info, "pieces");
+    total_pieces = (node != NULL)? benc_node_length(node)/SHA_DIGEST_LENGTH : 0;
+    node = benc_dict_get(loaded->info, "piece length");
+    piece_length = (node != NULL)? benc_node_integer(node) : 0;
+    node = benc_dict_get(loaded->info, "files");
+    if(node == NULL) /* single file mode */
+      files_number = (benc_dict_get(loaded->info, "name") != NULL)? 1 : 0;
+    else /* multi file mode */
+      files_number = benc_node_n_children(node);
   }
 
+  tabs->pieces = g_strdup_printf("%u", total_pieces);
+  if(piece_length != 0)
+    tabs->piece_length = util_convert_to_human((gdouble)piece_length, "B");
+  else
+    tabs->piece_length = g_strdup("0");
+  tabs->files = g_strdup_printf("%u", files_number);
+
   bitarray = G_BITARRAY(g_bitarray_new(total_pieces));
-  
-  /* piece length */
-  node = benc_node_find_key(torrent, "piece length");
-  if(node != NULL)
+  files_model = gtk_file_list_model_new(files_number, bitarray,
+                                        (GdkPixbuf**)mwin->file_state_icons);
+  if(cache != NULL)
   {
-    piece_length = (gint)g_strtod(benc_node_data(node), (char**)NULL);
-    string = util_convert_to_human((gdouble)piece_length, "B");
-    gtk_entry_set_text(mwin->PieceLenEntry, string);
-    g_free(string);
+    for(i = 0; i < files_number; i++)
+    {
+      path = metacache_file_path(cache, i);
+      gtk_file_list_model_set_file(files_model, i, path?path:"",
+                                   metacache_file_size(cache, i),
+                                   metacache_file_first_piece(cache, i),
+                                   metacache_file_n_pieces(cache, i));
+    }
+    total_size = metacache_get_total_size(cache);
   }
   else
-  {
-    piece_length = 0;
-    gtk_entry_set_text(mwin->PieceLenEntry, "0");
-  }
+    total_size = mainwindow_set_files_from_info(files_model, loaded->info,
+                                                piece_length, total_pieces);
+  tabs->size = util_convert_to_human((gdouble)total_size,"B");
+  tabs->files_model = GTK_TREE_MODEL(files_model);
+  g_object_unref(G_OBJECT(bitarray));
 
-  /* create the file list */  
-  liststore = gtk_list_store_new(NUM_FILE_COLS, GDK_TYPE_PIXBUF, G_TYPE_STRING,
-                                 G_TYPE_INT64, G_TYPE_UINT, G_TYPE_UINT,
-                                 G_TYPE_INT64, G_TYPE_OBJECT);
-  
-  node = benc_node_find_key(torrent, "files");
-  if(node == NULL) /* single file mode */
+  /* trackers */
+  liststore = gtk_list_store_new(1, G_TYPE_STRING);
+  gtk_list_store_append(liststore, &iter);
+  gtk_list_store_set(liststore, &iter, 0, tabs->announce?tabs->announce:"", -1);
+
+  if(cache != NULL)
   {
-    subnode = benc_node_find_key(torrent, "name");
-    if(subnode != NULL)
+    path = metacache_get_trackers(cache, &n_trackers);
+    for(i = 0; i < n_trackers; i++)
     {
-      files_number = 1;
-      gtk_list_store_append(liststore, &child);
-      gtk_list_store_set(liststore, &child, 
-                      COL_FILE_ICON, mwin->file_state_icons[FILE_STATE_UNKNOWN],
-                      COL_FILE_NAME, benc_node_data(subnode),
-                      -1);
-
-      subnode = benc_node_find_key(torrent, "length");
-      total_size = subnode?(g_strtod(benc_node_data(subnode), (gchar**)NULL)):((gdouble)G_MAXUINT);  
-      gtk_list_store_set(liststore, &child, COL_FILE_SIZE, (gint64)total_size, 
-                         COL_FILE_FIRST_PIECE, 0, 
-                         COL_FILE_N_PIECES, total_pieces, 
-                         COL_FILE_REMAINS, ((gint64)-1),
-                         COL_FILE_PIECESBITARRAY, bitarray,
-                         -1);
+      gtk_list_store_append(liststore, &iter);
+      gtk_list_store_set(liststore, &iter, 0, path, -1);
+      path += strlen(path) + 1;
     }
-  } 
-  else /* multi file mode */
+  }
+  else if((node = benc_dict_get(loaded->metainfo, "announce-list")) != NULL) /* multi-tracker support */
   {
-    total_size = 0.0l;
-    first_piece = 0.0l;
-    files_number = (gint)g_strtod(benc_node_data(node), (gchar**)NULL);
-    for(i = 0; i<files_number; i++)
+    for (node = benc_node_first_child(node); node != NULL;
+         node = benc_node_next_sibling(node))
     {
-      subnode = benc_node_nth_child(node, i);
-      if(subnode == NULL)
-        break;
-
-      gtk_list_store_append(liststore, &child);
-
-      value = benc_node_find_key(subnode, "path");
-      if(value != NULL)
-      {
-        string = util_convert_node_to_string(value, DIRECTORY_DELIMITER);
-        if(string != NULL)
-        {
-          gtk_list_store_set(liststore, &child, 
-                      COL_FILE_ICON, mwin->file_state_icons[FILE_STATE_UNKNOWN], 
-                      COL_FILE_NAME, string,
-                      -1);
-          g_free(string);
-        }
-      }
-      
-      value = benc_node_find_key(subnode, "length");
-      if(value != NULL)
+      for(subnode = benc_node_first_child(node); subnode != NULL; 
+          subnode = benc_node_next_sibling(subnode))
       {
-        size = (gint64)g_strtod(benc_node_data(value), (gchar**)NULL);
-        n_pieces = (piece_length==0)?0:(guint)ceil(modf(first_piece, &tmp) + ((gdouble)size)/piece_length);
-        gtk_list_store_set(liststore, &child, COL_FILE_SIZE, (gint64)size,
-                           COL_FILE_FIRST_PIECE, (guint)first_piece,
-                           COL_FILE_N_PIECES, n_pieces,
-                           COL_FILE_REMAINS, ((gint64)-1),
-                           COL_FILE_PIECESBITARRAY, bitarray, 
-                           -1);
-        
-        first_piece += (piece_length!=0)?((gdouble)size)/piece_length:0;
-        total_size += (gdouble)size; 
+        string = g_strndup(benc_node_data(subnode), benc_node_length(subnode));
+        gtk_list_store_append(liststore, &iter);
+        gtk_list_store_set(liststore, &iter, 0, string, -1);
+        g_free(string);
       }
     }
   }
+  tabs->trackers_model = GTK_TREE_MODEL(liststore);
 
-  gtk_tree_view_set_model(mwin->FilesTreeView, GTK_TREE_MODEL(liststore));
-  g_object_unref(G_OBJECT(liststore));
+  /* torrent details, only if it's decoded already */
+  if(cache == NULL)
+    tabs->torrent_model = mainwindow_details_model_new(mwin, loaded);
 
-  /* number of files */ 
-  string = g_strdup_printf("%i", files_number);
-  gtk_entry_set_text(mwin->FilesEntry, string);
-  g_free(string); 
+  return tabs;
+}
 
-  /* total size */ 
-  string = util_convert_to_human((gdouble)total_size,"B");
-  gtk_entry_set_text(mwin->SizeEntry, string?string:"");
-  g_free(string);
+/**
+ * @brief Make the torrent details model, the metainfo is decoded now if
+ *        it wasn't. It can be called from any thread.
+ *
+ * @param mwin: the MainWindow (only its icons are used).
+ * @param loaded: the loaded Torrent, the model keeps a reference to it.
+ * @return the new model, or NULL if the metainfo can't be decoded.
+ */
+GtkTreeModel *
+mainwindow_details_model_new(MainWindow const *mwin, Torrent *loaded)
+{
+  BencNode *metainfo;
 
-  /* activate the check file button */
-  gtk_widget_set_sensitive(GTK_WIDGET(mwin->CheckFilesButton), TRUE);
+  if((metainfo = torrent_get_metainfo(loaded)) == NULL)
+    return NULL;
 
-  g_object_unref(G_OBJECT(bitarray));
-  return;
+  return GTK_TREE_MODEL(gtk_benc_tree_model_new(metainfo,
+                        (GdkPixbuf**)mwin->benc_icons,
+                        torrent_ref(loaded), (GDestroyNotify)torrent_free));
 }
 
 /**
- * @brief Fill the Trackers Details Tab
+ * @brief Show the contents of the torrent tabs, the models are just
+ *        attached to their views.
  *
  * @param mwin: the MainWindow.
- * @param torrent: the BencNode metainfo.
+ * @param tabs: the MainWindowTabs made by mainwindow_tabs_new.
  */
 void
-mainwindow_fill_trackers_tab(MainWindow const *mwin, BencNode *torrent)
+mainwindow_tabs_show(MainWindow const *mwin, MainWindowTabs *tabs)
 {
-  GtkListStore *liststore;
-  GtkTreeIter iter;
-  BencNode *node, *subnode;
-  
-  liststore = gtk_list_store_new(1, G_TYPE_STRING);
+  GtkTextBuffer *text_buffer;
 
-  gtk_combo_box_set_active(mwin->TrackerComboBox, -1); 
+  /* general */
+  gtk_entry_set_text(mwin->NameEntry, tabs->name?tabs->name:"");
+  gtk_entry_set_text(mwin->TrackerEntry, tabs->announce?tabs->announce:"");
+  gtk_entry_set_text(mwin->SHAEntry, tabs->sha?tabs->sha:"");
+  gtk_entry_set_text(mwin->CreatedEntry, tabs->created_by?tabs->created_by:"");
+  gtk_entry_set_text(mwin->DateEntry, tabs->date?tabs->date:"");
 
-  node = benc_node_find_key(torrent, "announce");
-  gtk_list_store_append(liststore, &iter);
-  gtk_list_store_set(liststore, &iter, 0, node!=NULL?benc_node_data(node):"", -1);
+  text_buffer = gtk_text_view_get_buffer(mwin->CommentTextView);
+  gtk_text_buffer_set_text(text_buffer, tabs->comment?tabs->comment:"", -1);
 
-  node = benc_node_find_key(torrent, "announce-list");
-  if(node != NULL) /* multi-tracker support */
-  {
-    for (node = benc_node_first_child(node); node != NULL;
-         node = benc_node_next_sibling(node))
-    {
-      for(subnode = benc_node_first_child(node); subnode != NULL; 
-          subnode = benc_node_next_sibling(subnode))
-      {
-        gtk_list_store_append(liststore, &iter);
-        gtk_list_store_set(liststore, &iter, 0, benc_node_data(subnode), -1);
-      }
-    }
-  }
-  
-  gtk_combo_box_set_model(mwin->TrackerComboBox, GTK_TREE_MODEL(liststore));
-  g_object_unref(G_OBJECT(liststore));
+  /* clean the seeds, peers and dowloaded entry */
+  gtk_entry_set_text(mwin->SeedEntry, "");
+  gtk_entry_set_text(mwin->PeersEntry, "");
+  gtk_entry_set_text(mwin->DownloadedEntry, "");
+
+  /* activate the resfresh seed and peers button */
+  gtk_widget_set_sensitive(GTK_WIDGET(mwin->RefreshSeedsButton), TRUE);
+
+  /* files */
+  gtk_entry_set_text(mwin->PiecesEntry, tabs->pieces);
+  gtk_entry_set_text(mwin->PieceLenEntry, tabs->piece_length);
+  gtk_entry_set_text(mwin->FilesEntry, tabs->files);
+  gtk_entry_set_text(mwin->SizeEntry, tabs->size?tabs->size:"");
+  gtk_tree_view_set_model(mwin->FilesTreeView, tabs->files_model);
 
+  /* activate the check file button */
+  gtk_widget_set_sensitive(GTK_WIDGET(mwin->CheckFilesButton), TRUE);
+
+  /* trackers */
+  gtk_combo_box_set_active(mwin->TrackerComboBox, -1); 
+  gtk_combo_box_set_model(mwin->TrackerComboBox, tabs->trackers_model);
   gtk_combo_box_set_active(mwin->TrackerComboBox, 0);
   gtk_widget_set_sensitive(GTK_WIDGET(mwin->RefreshTrackerButton), TRUE);
-  
+
+  /* torrent details */
+  gtk_tree_view_set_model(mwin->TorrentTreeView, tabs->torrent_model);
+
   return;
 }
 
 /**
- * @brief Fill the Torrent Details Tab
+ * @brief Free a MainWindowTabs, the views keep their own references to
+ *        the showed models.
  *
- * @param mwin: the MainWindow.
- * @param torrent: the BencNode metainfo.
+ * @param tabs: the MainWindowTabs.
  */
 void
-mainwindow_fill_torrent_tab(MainWindow const *mwin, BencNode *torrent)
+mainwindow_tabs_free(MainWindowTabs *tabs)
 {
-  mainwindow_fill_bencode_tree(mwin, mwin->TorrentTreeView, torrent);
+  g_free(tabs->name);
+  g_free(tabs->announce);
+  g_free(tabs->sha);
+  g_free(tabs->created_by);
+  g_free(tabs->comment);
+  g_free(tabs->date);
+  g_free(tabs->pieces);
+  g_free(tabs->piece_length);
+  g_free(tabs->files);
+  g_free(tabs->size);
+
+  g_object_unref(G_OBJECT(tabs->files_model));
+  g_object_unref(G_OBJECT(tabs->trackers_model));
+  if(tabs->torrent_model != NULL)
+    g_object_unref(G_OBJECT(tabs->torrent_model));
+
+  g_free(tabs);
   return;
 }
 
@@ -467,117 +459,28 @@ mainwindow_fill_torrent_tab(MainWindow const *mwin, BencNode *torrent)
  * @brief Fill the Torrent details or the Tracker details tree
  *        with Bencode Meta information.
  *
+ * The rows aren't copied, the tree is showed by a GtkBencTreeModel so
+ * it must live (and don't change) while it is in the tree view. 
+ *
  * @param mwin: the MainWindow.
  * @param tree: the GtkTreeView to fill.
  * @param torrent: the BencNode Tree to be used.
+ * @param owner: what keeps torrent alive (can be NULL).
+ * @param destroy: function to release owner when the tree is replaced
+ *                 (can be NULL).
  */
 void
-mainwindow_fill_bencode_tree(MainWindow const *mwin, GtkTreeView *tree, BencNode *torrent)
+mainwindow_fill_bencode_tree(MainWindow const *mwin, GtkTreeView *tree,
+                             BencNode *torrent, gpointer owner,
+                             GDestroyNotify destroy)
 {
-  GtkTreeStore *treestore;
-  
-  treestore = gtk_tree_store_new(NUM_COLS, GDK_TYPE_PIXBUF, G_TYPE_STRING);
-
-  mainwindow_append_row_bencode_tree(treestore, NULL,
-                      (benc_node_type(torrent) == BENC_TYPE_DICTIONARY
-                      || benc_node_type(torrent) == BENC_TYPE_LIST)?"root":NULL,
-                      (GdkPixbuf**)mwin->benc_icons, torrent);
-
-  gtk_tree_view_set_model(tree, GTK_TREE_MODEL(treestore));
-  g_object_unref(G_OBJECT(treestore));
+  GtkBencTreeModel *model;
   
-  return;
-}
+  model = gtk_benc_tree_model_new(torrent, (GdkPixbuf**)mwin->benc_icons,
+                                  owner, destroy);
 
-/**
- * @brief Append rows to the Torrent details Tree or the Tracker details tree.
- *        It is a Internal funcion used just by mainwindow_fill_bencode_tree.
- *
- * @param treestore: the treestore to append a row.
- * @param parent: the parent of the item to append.
- * @param prefix: a prefix to prepend to the row text.
- * @param icons: the array of bencode type icons.
- * @param data: the BencNode item to append.
- */
-static void
-mainwindow_append_row_bencode_tree(GtkTreeStore *treestore, GtkTreeIter *parent, 
-                                   gchar *prefix, GdkPixbuf **icons,
-                                   BencNode *data)
-{
-  GtkTreeIter child;
-  gchar *string, *node_data;
-  BencNode *next_node;
-  gboolean valid_utf8;
-  
-  node_data = NULL;
-  next_node = data;
-  
-  while(next_node!=NULL)
-  {
-    valid_utf8 = g_utf8_validate(benc_node_data(next_node),
-                                 benc_node_length(next_node),NULL);
-    if(!valid_utf8) 
-    {            
-      string = util_convert_to_hex(benc_node_data(next_node),
-                  MIN(benc_node_length(next_node), MAX_HEX_TO_SHOW_TREEVIEW), NULL);
-      
-      if(benc_node_length(next_node)>MAX_HEX_TO_SHOW_TREEVIEW)
-      {
-        node_data = g_strdup_printf("\"%s...\"", string);
-        g_free(string);
-      }
-      else
-        node_data = string;
-    }
-    else
-    {
-      node_data = g_strndup(benc_node_data(next_node),
-                         MIN( benc_node_length(next_node),MAX_TREE_STRING_LEN));
-    }
- 
-    if(benc_node_type(next_node) == BENC_TYPE_KEY)
-    {
-      mainwindow_append_row_bencode_tree(treestore, parent, node_data, icons,
-                                         benc_node_first_child(next_node));       
-    }
-    else
-    {
-      gtk_tree_store_append(treestore, &child, parent);
-      
-      switch(benc_node_type(next_node))
-      {
-        case BENC_TYPE_INTEGER:
-          string = g_strdup_printf("%s%s%s", prefix?prefix:"", prefix?" = ":"",
-                                   node_data);
-          break;
-        case BENC_TYPE_STRING:
-          string = g_strdup_printf("%s (%i)%s%s", prefix?prefix:"",
-                     benc_node_length(next_node), prefix?" = ":" ", node_data);
-          break;
-        case BENC_TYPE_DICTIONARY:
-          string = g_strdup_printf("%s%s{%s}", prefix?prefix:"", prefix?" ":"",
-                                   node_data);
-          break;
-        default: /* BENC_TYPE_LIST */
-          string = g_strdup_printf("%s%s[%s]", prefix?prefix:"", prefix?" ":"",
-                                   node_data);
-      }
-      
-      gtk_tree_store_set(treestore, &child, COL_ICON,
-               icons[benc_node_type(next_node)], COL_TEXT, string, -1);
-      
-      g_free(string);
-      
-      if(!benc_node_is_leaf(next_node))
-      {
-        mainwindow_append_row_bencode_tree(treestore, &child, NULL, icons,
-                                           benc_node_first_child(next_node));       
-      }
-    }
-    
-    g_free(node_data);
-    next_node = benc_node_next_sibling(next_node);
-  }
+  gtk_tree_view_set_model(tree, GTK_TREE_MODEL(model));
+  g_object_unref(G_OBJECT(model));
   
   return;
 }
@@ -690,7 +593,6 @@ void
 on_CheckFilesButton_clicked(MainWindow *mwin, gpointer user_data)
 {
   GtkWidget *dialog;
-  GError *err;
   GtkFileChooserAction action;
   gchar *filename, *title, *lastdir;
   guint number_files;
@@ -721,12 +623,7 @@ on_CheckFilesButton_clicked(MainWindow *mwin, gpointer user_data)
      {
        /* get the selected file or folder name */
        filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
-       if(g_thread_create(check_files, filename, FALSE, &err) == NULL)
-       {
-         g_warning(err->message);
-         g_free(filename); 
-         g_error_free(err);
-       }
+       check_files_start(filename);
      }
      gtk_widget_destroy(dialog);
   } 
@@ -763,6 +660,22 @@ on_RefreshTrackerButton_clicked(MainWindow *mwin, gpointer user_data)
   return;
 }
 
+/**
+ * @brief Torrent Details Tree map CallBack, the details of a torrent
+ *        taken from its cache are loaded the first time they are showed.
+ *
+ * @param mwin: a pointer to the MainWindow.
+ * @param user_data: a pointer to the instance that fire the event(the Torrent Details Tree).
+ */
+void
+on_TorrentTreeView_map(MainWindow *mwin, gpointer user_data)
+{
+  if(gtk_tree_view_get_model(mwin->TorrentTreeView) == NULL)
+    torrent_details_load();
+
+  return;
+}
+
 /**
  * @brief Quit Button CallBack. synthesize delete_event to close the window.
  *
@@ -933,6 +846,83 @@ mainwindow_drag_drop(GtkWidget *widget, GdkDragContext *context, gint x,
 	return result;
 }
 
+/**
+ * @brief Copy a string node, its data isn't NUL terminated.
+ *        DON'T USE DIRECTLY.
+ *
+ * @param node: the BencNode (can be NULL).
+ * @return a new allocated string, or NULL if node isn't a string.
+ */
+static gchar *
+mainwindow_node_strdup(BencNode *node)
+{
+  if(node == NULL || benc_node_type(node) != BENC_TYPE_STRING)
+    return NULL;
+
+  return g_strndup(benc_node_data(node), benc_node_length(node));
+}
+
+/**
+ * @brief Set the files list from the info dictionary, as metacache_new
+ *        makes it, for the torrents without a MetaCache.
+ *        DON'T USE DIRECTLY.
+ *
+ * @param model: the GtkFileListModel, with a row for each file.
+ * @param info: the "info" dictionary (can be NULL).
+ * @param piece_length: the size of the pieces.
+ * @param total_pieces: the number of pieces.
+ * @return the sum of the files sizes.
+ */
+static gint64
+mainwindow_set_files_from_info(GtkFileListModel *model, BencNode *info,
+                               gint64 piece_length, guint total_pieces)
+{
+  BencNode *files, *file, *value;
+  gchar *path;
+  gint64 total_size, file_size, offset;
+  guint i, first_piece, n_pieces;
+
+  total_size = 0;
+  files = benc_dict_get(info, "files");
+  if(files == NULL) /* single file mode */
+  {
+    value = benc_dict_get(info, "name");
+    if(value == NULL)
+      return 0;
+
+    path = mainwindow_node_strdup(value);
+    value = benc_dict_get(info, "length");
+    total_size = (value != NULL)? benc_node_integer(value) : ((gint64)G_MAXUINT);
+    gtk_file_list_model_set_file(model, 0, path?path:"", total_size, 0, total_pieces);
+    g_free(path);
+    return total_size;
+  }
+
+  /* multi file mode */
+  for(file = benc_node_first_child(files), i = 0; file != NULL;
+      file = benc_node_next_sibling(file), i++)
+  {
+    value = benc_dict_get(file, "path");
+    path = (value != NULL)? util_convert_node_to_string(value, "/") : NULL;
+
+    value = benc_dict_get(file, "length");
+    file_size = (value != NULL)? benc_node_integer(value) : 0;
+    first_piece = n_pieces = 0;
+    if(value != NULL && piece_length > 0)
+    {
+      offset = total_size % piece_length;
+      first_piece = (guint)(total_size/piece_length);
+      n_pieces = (guint)((offset + file_size + piece_length - 1)/piece_length);
+    }
+    gtk_file_list_model_set_file(model, i, path?path:"", file_size,
+                                 first_piece, n_pieces);
+    g_free(path);
+    total_size += file_size;
+  }
+
+  return total_size;
+}
+
 /**
  * @brief free resources when the last unref is call.
  *
@@ -1012,6 +1002,12 @@ mainwindow_init(MainWindow *mwin)
     gdk_pixbuf_unref(icon_pixbuf);
   }
 
+  /* the tabs models are made in the threads (mainwindow_tabs_new), but
+   * their _get_type aren't thread safe, so the types are registered here */
+  g_type_class_ref(G_TYPE_BITARRAY);
+  g_type_class_ref(GTK_TYPE_FILE_LIST_MODEL);
+  g_type_class_ref(GTK_TYPE_BENC_TREE_MODEL);
+
   /* make the widgets inside the main window */
   vbox = gtk_vbox_new(FALSE, 0);
   gtk_widget_show(vbox);
@@ -1337,7 +1333,7 @@ mainwindow_create_files_tab(MainWindow *mwin, GtkWidget *notebook)
   GtkWidget *label1, *label2, *label3, *label4, *label5, *label6, *label7;
   GtkTreeViewColumn *col;
   GtkCellRenderer *renderer;
-  GtkListStore *liststore;
+  GtkFileListModel *model;
 
   vbox = gtk_vbox_new(FALSE, 0);
   gtk_widget_show(vbox);
@@ -1428,11 +1424,9 @@ mainwindow_create_files_tab(MainWindow *mwin, GtkWidget *notebook)
 
   gtk_tree_view_append_column(mwin->FilesTreeView, col);
 
-  liststore = gtk_list_store_new(NUM_FILE_COLS, GDK_TYPE_PIXBUF, G_TYPE_STRING,
-                                 G_TYPE_INT64, G_TYPE_UINT, G_TYPE_UINT,
-                                 G_TYPE_INT64, G_TYPE_OBJECT);
-  gtk_tree_view_set_model(mwin->FilesTreeView, GTK_TREE_MODEL(liststore));
-  g_object_unref(G_OBJECT(liststore));
+  model = gtk_file_list_model_new(0, NULL, (GdkPixbuf**)mwin->file_state_icons);
+  gtk_tree_view_set_model(mwin->FilesTreeView, GTK_TREE_MODEL(model));
+  g_object_unref(G_OBJECT(model));
   /* end initialize tree */
 
   label1 = gtk_label_new(_("Files list:"));
@@ -1525,6 +1519,13 @@ mainwindow_create_files_tab(MainWindow *mwin, GtkWidget *notebook)
   gtk_widget_show(label6);
   gtk_box_pack_start(GTK_BOX(hbox2), label6, FALSE, FALSE, 0);
 
+  mwin->IncrementalCheckButton = GTK_TOGGLE_BUTTON(
+    gtk_check_button_new_with_mnemonic(_("Only c_hanged")));
+  gtk_widget_show(GTK_WIDGET(mwin->IncrementalCheckButton));
+  gtk_box_pack_start(GTK_BOX(hbox1), GTK_WIDGET(mwin->IncrementalCheckButton), FALSE, FALSE, 3);
+  gtk_widget_set_tooltip_text(GTK_WIDGET(mwin->IncrementalCheckButton),
+    _("Only check again the pieces of the files changed since the last check"));
+
   label7 = gtk_label_new(_("Files"));
   gtk_widget_show(label7);
   gtk_notebook_set_tab_label(GTK_NOTEBOOK(notebook), 
@@ -1822,6 +1823,11 @@ mainwindow_signal_autoconnect(MainWindow *mwin)
                            G_CALLBACK(on_RefreshTrackerButton_clicked),
                            G_OBJECT(mwin));
 
+  /* the torrent details are loaded when they are showed */
+  g_signal_connect_swapped((gpointer)mwin->TorrentTreeView, "map",
+                           G_CALLBACK(on_TorrentTreeView_map),
+                           G_OBJECT(mwin));
+
 	/* Drag and Drop support */
 	gtk_drag_dest_set(GTK_WIDGET (mwin), GTK_DEST_DEFAULT_DROP |
                     GTK_DEST_DEFAULT_MOTION, drag_types, n_drag_types,
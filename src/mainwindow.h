@@ -15,9 +15,6 @@ G_BEGIN_DECLS
 
 /* DEFINES ******************************************************************/
 
-#define MAX_HEX_TO_SHOW_TREEVIEW  30 /*if invalid utf8 show just 30 hex nums*/
-#define MAX_TREE_STRING_LEN      200 /*max lenght of a row in the a treeview*/
-
 #define DEF_WAIT_AFTER_SCRAPE 30 /* wait 30 seconds after scrape a tracker */ 
 
 #define DIRECTORY_DELIMITER  "/"
@@ -38,18 +35,6 @@ G_BEGIN_DECLS
 
 #define MAINWINDOW_TITLE     "Torrent Metainfo Viewer v" PACKAGE_VERSION
 
-enum /* files list columns */
-{
-  COL_FILE_ICON = 0,
-  COL_FILE_NAME,
-  COL_FILE_SIZE,
-  COL_FILE_FIRST_PIECE,
-  COL_FILE_N_PIECES,
-  COL_FILE_REMAINS,
-  COL_FILE_PIECESBITARRAY,
-  NUM_FILE_COLS
-};
-
 enum /* detailed trees columns */
 {
   COL_ICON = 0,
@@ -65,14 +50,6 @@ enum /* log events */
   NUM_LOG_EVENTS
 };
 
-enum /* files states */
-{
-  FILE_STATE_OK = 0,
-  FILE_STATE_BAD,
-  FILE_STATE_UNKNOWN,
-  NUM_FILE_STATES
-};
-
 /* MACROS *******************************************************************/
 
 #define MAINWINDOW_TYPE            (mainwindow_get_type())
@@ -102,6 +79,7 @@ struct _MainWindow
   GtkLabel  *RefreshSeedsButtonLabel;  /**< Refresh Seeds/Peers button Label */
   GtkButton *CheckFilesButton;         /**< The Check Files button */
   GtkLabel  *CheckFilesButtonLabel;    /**< Check Files button Label */
+  GtkToggleButton *IncrementalCheckButton; /**< Only check changed files */
   GtkButton *RefreshTrackerButton;     /**< The Refresh Tracker Info button */
   GtkLabel  *RefreshTrackerButtonLabel;/**< efresh Tracker Info button Label */  
 
@@ -142,6 +120,29 @@ struct _MainWindowClass
   GtkWindowClass parent_class;
 };
 
+/**
+ * @brief The contents of the torrent tabs, prepared out of the main loop
+ *        (mainwindow_tabs_new) and showed at once (mainwindow_tabs_show).
+ */
+typedef struct
+{
+  gchar *name;         /**< the name.                        */
+  gchar *announce;     /**< the tracker announce.            */
+  gchar *sha;          /**< the info hash in hexadecimal.    */
+  gchar *created_by;   /**< the created by.                  */
+  gchar *comment;      /**< the comment.                     */
+  gchar *date;         /**< the creation date.               */
+  gchar *pieces;       /**< the number of pieces.            */
+  gchar *piece_length; /**< the piece length.                */
+  gchar *files;        /**< the number of files.             */
+  gchar *size;         /**< the total size.                  */
+
+  GtkTreeModel *files_model;    /**< the files list.             */
+  GtkTreeModel *trackers_model; /**< the trackers of the combo.  */
+  GtkTreeModel *torrent_model;  /**< the torrent details tree, NULL
+                                     until the torrent is decoded. */
+} MainWindowTabs;
+
 /* PROTOTYPES ***************************************************************/
 
 GType mainwindow_get_type(void);
@@ -149,12 +150,14 @@ GtkWidget* mainwindow_new(void);
 
 gint mainwindow_log_printf(MainWindow const *mwin, gshort event_type, gchar const *format, ...) G_GNUC_PRINTF(3, 4);
 
-void mainwindow_fill_general_tab(MainWindow const *mwin, BencNode *torrent);
-void mainwindow_fill_files_tab(MainWindow const *mwin, BencNode *torrent);
-void mainwindow_fill_trackers_tab(MainWindow const *mwin, BencNode *torrent);
-void mainwindow_fill_torrent_tab(MainWindow const *mwin, BencNode *torrent);
+MainWindowTabs *mainwindow_tabs_new(MainWindow const *mwin, Torrent *loaded);
+void mainwindow_tabs_show(MainWindow const *mwin, MainWindowTabs *tabs);
+void mainwindow_tabs_free(MainWindowTabs *tabs);
+GtkTreeModel *mainwindow_details_model_new(MainWindow const *mwin, Torrent *loaded);
 
-void mainwindow_fill_bencode_tree(MainWindow const *mwin, GtkTreeView *tree, BencNode *torrent);
+void mainwindow_fill_bencode_tree(MainWindow const *mwin, GtkTreeView *tree,
+                                  BencNode *torrent, gpointer owner,
+                                  GDestroyNotify destroy);
 
 G_END_DECLS
 
@@ -0,0 +1,777 @@
+/**
+ * @file metacache.c
+ *
+ * @brief Cache of the opened torrents metainfo, so a known torrent is
+ *        showed without decoding it again.
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* INCLUDES *****************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "bencode.h"
+#include "sha1.h"
+#include "metacache.h"
+
+/* DEFINES ******************************************************************/
+
+/* header offsets */
+#define METACACHE_SIZE           8  /* i64 size of the .torrent file    */
+#define METACACHE_MTIME         16  /* i64 its modification time        */
+#define METACACHE_PIECE_LENGTH  24  /* i64                              */
+#define METACACHE_TOTAL_SIZE    32  /* i64 sum of the files sizes       */
+#define METACACHE_DATE          40  /* i64 creation date                */
+#define METACACHE_N_FILES       48  /* u32                              */
+#define METACACHE_N_PIECES      52  /* u32                              */
+#define METACACHE_FLAGS         56  /* u32 METACACHE_HAS_*              */
+#define METACACHE_PATH          60  /* u32 string, the .torrent file    */
+#define METACACHE_NAME          64  /* u32 string                       */
+#define METACACHE_ANNOUNCE      68  /* u32 string                       */
+#define METACACHE_CREATED_BY    72  /* u32 string                       */
+#define METACACHE_COMMENT       76  /* u32 string                       */
+#define METACACHE_COMMENT_LEN   80  /* u32 (the comment can have NULs)  */
+#define METACACHE_INFO_HASH     84  /* SHA_DIGEST_LENGTH bytes          */
+#define METACACHE_MTIME_NSEC   104  /* i64 nanoseconds of the mtime     */
+#define METACACHE_INODE        112  /* i64 inode of the .torrent file   */
+#define METACACHE_TRACKERS     120  /* u32 strings, one after the other */
+#define METACACHE_N_TRACKERS   124  /* u32 of the announce-list         */
+
+/* file record offsets */
+#define METACACHE_FILE_SIZE      0  /* i64                              */
+#define METACACHE_FILE_PATH      8  /* u32 string                       */
+#define METACACHE_FILE_FIRST    12  /* u32 first piece                  */
+#define METACACHE_FILE_PIECES   16  /* u32 number of pieces             */
+
+#define METACACHE_HAS_INFO       1
+#define METACACHE_HAS_DATE       2
+
+/* TYPEDEF ******************************************************************/
+
+/**
+ * @brief A loaded cache. @see metacache.h
+ */
+struct _MetaCache
+{
+  GMappedFile *mapping;  /**< the mapped cache file, or NULL.        */
+  gchar       *data;     /**< the contents (mapped or allocated).    */
+  gsize       length;    /**< length of data.                        */
+};
+
+/* PRIVATE FUNCTIONS ********************************************************/
+
+static gchar   *metacache_filename(const gchar *path);
+static gchar   *metacache_absolute_path(const gchar *filename);
+static guint32  metacache_get_u32(const gchar *data, gsize offset);
+static gint64   metacache_get_i64(const gchar *data, gsize offset);
+static void     metacache_set_u32(gchar *data, gsize offset, guint32 value);
+static void     metacache_set_i64(gchar *data, gsize offset, gint64 value);
+static guint32  metacache_add_string(GString *strings, gsize base,
+                                     const gchar *string, gsize length);
+static guint32  metacache_add_node(GString *strings, gsize base, BencNode *node);
+static gboolean metacache_check_string(MetaCache *cache, guint32 offset);
+static gboolean metacache_check_strings(MetaCache *cache, guint32 offset, guint32 n);
+
+/* FUNCTIONS ****************************************************************/
+
+/**
+ * @brief Load the cache of a .torrent file.
+ *
+ * The cache is in the user cache folder, named after the SHA1 of the
+ * full path of the .torrent file. It's used only if it's of the same
+ * path, size, modification time (with the nanoseconds) and inode, so a
+ * changed or replaced torrent is always readed again.
+ *
+ * @param filename: the .torrent file.
+ * @param size: its size.
+ * @param mtime: its modification time.
+ * @param mtime_nsec: the nanoseconds of mtime, 0 if they are unknown.
+ * @param inode: its inode.
+ * @return the MetaCache (free with metacache_free), or NULL if there is
+ *         no cache or it's stale.
+ */
+MetaCache *
+metacache_load(const gchar *filename, gint64 size, gint64 mtime,
+               gint64 mtime_nsec, gint64 inode)
+{
+  MetaCache *cache;
+  GMappedFile *mapping;
+  gchar *path, *cachefile;
+  guint32 n_files, i;
+  gboolean valid;
+
+  path = metacache_absolute_path(filename);
+  cachefile = metacache_filename(path);
+  mapping = g_mapped_file_new(cachefile, FALSE, NULL);
+  g_free(cachefile);
+
+  if(mapping == NULL)
+  {
+    g_free(path);
+    return NULL;
+  }
+
+  cache = g_new0(MetaCache, 1);
+  cache->mapping = mapping;
+  cache->data = g_mapped_file_get_contents(mapping);
+  cache->length = g_mapped_file_get_length(mapping);
+
+  /* the strings are NUL terminated inside of the file */
+  valid = (cache->data != NULL && cache->length > METACACHE_HEADER_SIZE &&
+           memcmp(cache->data, METACACHE_MAGIC, 8) == 0 &&
+           cache->data[cache->length - 1] == '\0' &&
+           metacache_get_i64(cache->data, METACACHE_SIZE) == size &&
+           metacache_get_i64(cache->data, METACACHE_MTIME) == mtime &&
+           metacache_get_i64(cache->data, METACACHE_MTIME_NSEC) == mtime_nsec &&
+           metacache_get_i64(cache->data, METACACHE_INODE) == inode);
+
+  if(valid)
+  {
+    n_files = metacache_get_u32(cache->data, METACACHE_N_FILES);
+    valid = ((cache->length - METACACHE_HEADER_SIZE)/METACACHE_RECORD_SIZE >= n_files &&
+             metacache_check_string(cache, metacache_get_u32(cache->data, METACACHE_PATH)) &&
+             metacache_check_string(cache, metacache_get_u32(cache->data, METACACHE_NAME)) &&
+             metacache_check_string(cache, metacache_get_u32(cache->data, METACACHE_ANNOUNCE)) &&
+             metacache_check_string(cache, metacache_get_u32(cache->data, METACACHE_CREATED_BY)) &&
+             metacache_check_string(cache, metacache_get_u32(cache->data, METACACHE_COMMENT)) &&
+             (gsize)metacache_get_u32(cache->data, METACACHE_COMMENT) +
+               metacache_get_u32(cache->data, METACACHE_COMMENT_LEN) < cache->length &&
+             metacache_check_strings(cache, metacache_get_u32(cache->data, METACACHE_TRACKERS),
+                                     metacache_get_u32(cache->data, METACACHE_N_TRACKERS)));
+
+    for(i = 0; valid && i < n_files; i++)
+      valid = metacache_check_string(cache, metacache_get_u32(cache->data,
+                  METACACHE_HEADER_SIZE + i*METACACHE_RECORD_SIZE + METACACHE_FILE_PATH));
+
+    /* two paths with the same SHA1 */
+    valid = valid && strcmp(cache->data + metacache_get_u32(cache->data, METACACHE_PATH), path) == 0;
+  }
+
+  g_free(path);
+
+  if(!valid)
+  {
+    metacache_free(cache);
+    return NULL;
+  }
+
+  return cache;
+}
+
+/**
+ * @brief Make the cache of a decoded .torrent file and save it, it
+ *        replaces any stale cache of the same file. @see metacache_load
+ *
+ * The files list is computed as the Files tab shows it: the path
+ * elements joined with '/', the first piece and the number of pieces
+ * with data of each file. The trackers are the strings of the tiers of
+ * the announce-list, in order.
+ *
+ * @param filename: the .torrent file.
+ * @param size: its size.
+ * @param mtime: its modification time.
+ * @param mtime_nsec: the nanoseconds of mtime, 0 if they are unknown.
+ * @param inode: its inode.
+ * @param metainfo: its decoded metainfo.
+ * @param info_hash: its info hash.
+ * @return the MetaCache (free with metacache_free), it's returned even if
+ *         it couldn't be saved. NULL if it's too big.
+ */
+MetaCache *
+metacache_new(const gchar *filename, gint64 size, gint64 mtime,
+              gint64 mtime_nsec, gint64 inode,
+              BencNode *metainfo, const guint8 *info_hash)
+{
+  MetaCache *cache;
+  GString *strings;
+  BencNode *info, *node, *files, *file, *value, *element;
+  gchar *contents, *record, *path, *cachefile, *folder;
+  gint64 piece_length, total_size, file_size, offset;
+  guint32 n_files, n_pieces, n_trackers, flags;
+  gsize base;
+
+  info = benc_dict_get(metainfo, "info");
+  node = benc_dict_get(info, "piece length");
+  piece_length = (node != NULL)? benc_node_integer(node) : 0;
+  node = benc_dict_get(info, "pieces");
+  n_pieces = (node != NULL)? benc_node_length(node)/SHA_DIGEST_LENGTH : 0;
+
+  files = benc_dict_get(info, "files");
+  if(files == NULL) /* single file mode */
+    n_files = (benc_dict_get(info, "name") != NULL)? 1 : 0;
+  else /* multi file mode */
+    n_files = benc_node_n_children(files);
+
+  base = METACACHE_HEADER_SIZE + (gsize)n_files*METACACHE_RECORD_SIZE;
+  contents = g_malloc0(base);
+  strings = g_string_sized_new(4096);
+
+  /* offset 0 is the header, so it's used for no string */
+  path = metacache_absolute_path(filename);
+  memcpy(contents, METACACHE_MAGIC, 8);
+  metacache_set_i64(contents, METACACHE_SIZE, size);
+  metacache_set_i64(contents, METACACHE_MTIME, mtime);
+  metacache_set_i64(contents, METACACHE_MTIME_NSEC, mtime_nsec);
+  metacache_set_i64(contents, METACACHE_INODE, inode);
+  metacache_set_u32(contents, METACACHE_PATH,
+                    metacache_add_string(strings, base, path, strlen(path)));
+  metacache_set_u32(contents, METACACHE_ANNOUNCE,
+                    metacache_add_node(strings, base, benc_dict_get(metainfo, "announce")));
+  metacache_set_u32(contents, METACACHE_CREATED_BY,
+                    metacache_add_node(strings, base, benc_dict_get(metainfo, "created by")));
+  node = benc_dict_get(metainfo, "comment");
+  metacache_set_u32(contents, METACACHE_COMMENT, metacache_add_node(strings, base, node));
+  metacache_set_u32(contents, METACACHE_COMMENT_LEN,
+                    (node != NULL && benc_node_type(node) == BENC_TYPE_STRING)?
+                    benc_node_length(node) : 0);
+
+  /* multi-tracker support */
+  n_trackers = 0;
+  node = benc_dict_get(metainfo, "announce-list");
+  for(node = (node != NULL)? benc_node_first_child(node) : NULL; node != NULL;
+      node = benc_node_next_sibling(node))
+  {
+    for(value = benc_node_first_child(node); value != NULL;
+        value = benc_node_next_sibling(value))
+    {
+      if(benc_node_type(value) != BENC_TYPE_STRING)
+        continue;
+
+      if(n_trackers++ == 0)
+        metacache_set_u32(contents, METACACHE_TRACKERS, base + strings->len);
+      metacache_add_node(strings, base, value);
+    }
+  }
+  metacache_set_u32(contents, METACACHE_N_TRACKERS, n_trackers);
+
+  flags = 0;
+  node = benc_dict_get(metainfo, "creation date");
+  if(node != NULL)
+  {
+    metacache_set_i64(contents, METACACHE_DATE, benc_node_integer(node));
+    flags |= METACACHE_HAS_DATE;
+  }
+
+  if(info != NULL)
+  {
+    flags |= METACACHE_HAS_INFO;
+    memcpy(contents + METACACHE_INFO_HASH, info_hash, SHA_DIGEST_LENGTH);
+    metacache_set_u32(contents, METACACHE_NAME,
+                      metacache_add_node(strings, base, benc_dict_get(info, "name")));
+  }
+
+  metacache_set_i64(contents, METACACHE_PIECE_LENGTH, piece_length);
+  metacache_set_u32(contents, METACACHE_N_PIECES, n_pieces);
+  metacache_set_u32(contents, METACACHE_N_FILES, n_files);
+  metacache_set_u32(contents, METACACHE_FLAGS, flags);
+
+  /* the files table */
+  total_size = 0;
+  if(files == NULL && n_files == 1)
+  {
+    node = benc_dict_get(info, "length");
+    total_size = (node != NULL)? benc_node_integer(node) : ((gint64)G_MAXUINT);
+    record = contents + METACACHE_HEADER_SIZE;
+    metacache_set_i64(record, METACACHE_FILE_SIZE, total_size);
+    metacache_set_u32(record, METACACHE_FILE_PATH,
+                      metacache_add_node(strings, base, benc_dict_get(info, "name")));
+    metacache_set_u32(record, METACACHE_FILE_PIECES, n_pieces);
+  }
+  else if(files != NULL)
+  {
+    record = contents + METACACHE_HEADER_SIZE;
+    for(file = benc_node_first_child(files); file != NULL;
+        file = benc_node_next_sibling(file), record += METACACHE_RECORD_SIZE)
+    {
+      /* the path elements joined, as util_convert_node_to_string */
+      value = benc_dict_get(file, "path");
+      if(value != NULL && benc_node_type(value) == BENC_TYPE_LIST && !benc_node_is_leaf(value))
+      {
+        metacache_set_u32(record, METACACHE_FILE_PATH, base + strings->len);
+        for(element = benc_node_first_child(value); element != NULL;
+            element = benc_node_next_sibling(element))
+        {
+          if(element != benc_node_first_child(value))
+            g_string_append_c(strings, '/');
+          g_string_append_len(strings, benc_node_data(element), benc_node_length(element));
+        }
+        g_string_append_c(strings, '\0');
+      }
+
+      value = benc_dict_get(file, "length");
+      if(value == NULL)
+        continue;
+
+      file_size = benc_node_integer(value);
+      metacache_set_i64(record, METACACHE_FILE_SIZE, file_size);
+      if(piece_length > 0)
+      {
+        offset = total_size % piece_length;
+        metacache_set_u32(record, METACACHE_FILE_FIRST, (guint32)(total_size/piece_length));
+        metacache_set_u32(record, METACACHE_FILE_PIECES,
+                          (guint32)((offset + file_size + piece_length - 1)/piece_length));
+      }
+      total_size += file_size;
+    }
+  }
+  metacache_set_i64(contents, METACACHE_TOTAL_SIZE, total_size);
+
+  if(base + strings->len > G_MAXUINT32)
+  {
+    g_string_free(strings, TRUE);
+    g_free(contents);
+    g_free(path);
+    return NULL;
+  }
+
+  cache = g_new0(MetaCache, 1);
+  cache->length = base + strings->len;
+  cache->data = g_realloc(contents, cache->length);
+  memcpy(cache->data + base, strings->str, strings->len);
+  g_string_free(strings, TRUE);
+
+  /* it's renamed over the old one, so a mapped cache is never changed */
+  cachefile = metacache_filename(path);
+  folder = g_path_get_dirname(cachefile);
+  g_mkdir_with_parents(folder, 0700);
+  g_file_set_contents(cachefile, cache->data, cache->length, NULL);
+  g_free(folder);
+  g_free(cachefile);
+  g_free(path);
+
+  return cache;
+}
+
+/**
+ * @brief Free a MetaCache.
+ *
+ * @param cache: the MetaCache (can be NULL).
+ */
+void
+metacache_free(MetaCache *cache)
+{
+  if(cache == NULL)
+    return;
+
+  if(cache->mapping != NULL)
+    g_mapped_file_unref(cache->mapping);
+  else
+    g_free(cache->data);
+
+  g_free(cache);
+  return;
+}
+
+/**
+ * @brief the info hash of the torrent.
+ *
+ * @param cache: the MetaCache.
+ * @return SHA_DIGEST_LENGTH bytes (zeros if there is no info).
+ */
+const guint8 *
+metacache_get_info_hash(MetaCache *cache)
+{
+  return (const guint8*)cache->data + METACACHE_INFO_HASH;
+}
+
+/**
+ * @brief if the torrent has an info dictionary.
+ *
+ * @param cache: the MetaCache.
+ * @return TRUE if it has it.
+ */
+gboolean
+metacache_has_info(MetaCache *cache)
+{
+  return (metacache_get_u32(cache->data, METACACHE_FLAGS) & METACACHE_HAS_INFO) != 0;
+}
+
+/**
+ * @brief the name in the info dictionary.
+ *
+ * @param cache: the MetaCache.
+ * @return the name, or NULL.
+ */
+const gchar *
+metacache_get_name(MetaCache *cache)
+{
+  guint32 offset = metacache_get_u32(cache->data, METACACHE_NAME);
+  return (offset != 0)? cache->data + offset : NULL;
+}
+
+/**
+ * @brief the tracker announce url.
+ *
+ * @param cache: the MetaCache.
+ * @return the url, or NULL.
+ */
+const gchar *
+metacache_get_announce(MetaCache *cache)
+{
+  guint32 offset = metacache_get_u32(cache->data, METACACHE_ANNOUNCE);
+  return (offset != 0)? cache->data + offset : NULL;
+}
+
+/**
+ * @brief the program that made the torrent.
+ *
+ * @param cache: the MetaCache.
+ * @return the "created by" string, or NULL.
+ */
+const gchar *
+metacache_get_created_by(MetaCache *cache)
+{
+  guint32 offset = metacache_get_u32(cache->data, METACACHE_CREATED_BY);
+  return (offset != 0)? cache->data + offset : NULL;
+}
+
+/**
+ * @brief the comment of the torrent.
+ *
+ * @param cache: the MetaCache.
+ * @param length: return the length of the comment (it can have NULs).
+ * @return the comment, or NULL.
+ */
+const gchar *
+metacache_get_comment(MetaCache *cache, guint *length)
+{
+  guint32 offset = metacache_get_u32(cache->data, METACACHE_COMMENT);
+
+  *length = (offset != 0)? metacache_get_u32(cache->data, METACACHE_COMMENT_LEN) : 0;
+  return (offset != 0)? cache->data + offset : NULL;
+}
+
+/**
+ * @brief the creation date of the torrent.
+ *
+ * @param cache: the MetaCache.
+ * @param date: return the date (seconds since the epoch).
+ * @return FALSE if the torrent has no date.
+ */
+gboolean
+metacache_get_creation_date(MetaCache *cache, gint64 *date)
+{
+  *date = metacache_get_i64(cache->data, METACACHE_DATE);
+  return (metacache_get_u32(cache->data, METACACHE_FLAGS) & METACACHE_HAS_DATE) != 0;
+}
+
+/**
+ * @brief the size of the pieces.
+ *
+ * @param cache: the MetaCache.
+ * @return the size, 0 if it's unknown.
+ */
+gint64
+metacache_get_piece_length(MetaCache *cache)
+{
+  return metacache_get_i64(cache->data, METACACHE_PIECE_LENGTH);
+}
+
+/**
+ * @brief the number of pieces.
+ *
+ * @param cache: the MetaCache.
+ * @return the number of pieces.
+ */
+guint
+metacache_get_n_pieces(MetaCache *cache)
+{
+  return metacache_get_u32(cache->data, METACACHE_N_PIECES);
+}
+
+/**
+ * @brief the sum of the files sizes.
+ *
+ * @param cache: the MetaCache.
+ * @return the size in bytes.
+ */
+gint64
+metacache_get_total_size(MetaCache *cache)
+{
+  return metacache_get_i64(cache->data, METACACHE_TOTAL_SIZE);
+}
+
+/**
+ * @brief the number of files.
+ *
+ * @param cache: the MetaCache.
+ * @return the number of files.
+ */
+guint
+metacache_get_n_files(MetaCache *cache)
+{
+  return metacache_get_u32(cache->data, METACACHE_N_FILES);
+}
+
+/**
+ * @brief the trackers of the announce-list.
+ *
+ * They are NUL terminated strings one after the other, the next one
+ * starts after the NUL of the previous.
+ *
+ * @param cache: the MetaCache.
+ * @param n_trackers: return the number of trackers.
+ * @return the first tracker, or NULL if there are none.
+ */
+const gchar *
+metacache_get_trackers(MetaCache *cache, guint *n_trackers)
+{
+  guint32 offset = metacache_get_u32(cache->data, METACACHE_TRACKERS);
+
+  *n_trackers = (offset != 0)? metacache_get_u32(cache->data, METACACHE_N_TRACKERS) : 0;
+  return (offset != 0)? cache->data + offset : NULL;
+}
+
+/**
+ * @brief the path of a file, its elements joined with '/'.
+ *
+ * @param cache: the MetaCache.
+ * @param file: the file index.
+ * @return the path, or NULL if the file has no path.
+ */
+const gchar *
+metacache_file_path(MetaCache *cache, guint file)
+{
+  guint32 offset;
+
+  offset = metacache_get_u32(cache->data, METACACHE_HEADER_SIZE +
+                             file*METACACHE_RECORD_SIZE + METACACHE_FILE_PATH);
+  return (offset != 0)? cache->data + offset : NULL;
+}
+
+/**
+ * @brief the size of a file.
+ *
+ * @param cache: the MetaCache.
+ * @param file: the file index.
+ * @return the size (0 if it's unknown).
+ */
+gint64
+metacache_file_size(MetaCache *cache, guint file)
+{
+  return metacache_get_i64(cache->data, METACACHE_HEADER_SIZE +
+                           file*METACACHE_RECORD_SIZE + METACACHE_FILE_SIZE);
+}
+
+/**
+ * @brief the first piece with data of a file.
+ *
+ * @param cache: the MetaCache.
+ * @param file: the file index.
+ * @return the piece index.
+ */
+guint
+metacache_file_first_piece(MetaCache *cache, guint file)
+{
+  return metacache_get_u32(cache->data, METACACHE_HEADER_SIZE +
+                           file*METACACHE_RECORD_SIZE + METACACHE_FILE_FIRST);
+}
+
+/**
+ * @brief the number of pieces with data of a file.
+ *
+ * @param cache: the MetaCache.
+ * @param file: the file index.
+ * @return the number of pieces.
+ */
+guint
+metacache_file_n_pieces(MetaCache *cache, guint file)
+{
+  return metacache_get_u32(cache->data, METACACHE_HEADER_SIZE +
+                           file*METACACHE_RECORD_SIZE + METACACHE_FILE_PIECES);
+}
+
+/**
+ * @brief the cache file of a .torrent file. DON'T USE DIRECTLY.
+ *
+ * @param path: the full path of the .torrent file.
+ * @return a new allocated string.
+ */
+static gchar *
+metacache_filename(const gchar *path)
+{
+  guint8 hash[SHA_DIGEST_LENGTH];
+  gchar name[2*SHA_DIGEST_LENGTH + 1];
+  guint i;
+
+  SHA1((guint8*)path, strlen(path), hash);
+  for(i = 0; i < SHA_DIGEST_LENGTH; i++)
+    g_snprintf(name + 2*i, 3, "%02x", hash[i]);
+
+  return g_build_filename(g_get_user_cache_dir(), PACKAGE, "metainfo", name, NULL);
+}
+
+/**
+ * @brief the full path of a file. DON'T USE DIRECTLY.
+ *
+ * @param filename: the file name.
+ * @return a new allocated string.
+ */
+static gchar *
+metacache_absolute_path(const gchar *filename)
+{
+  gchar *folder, *path;
+
+  if(g_path_is_absolute(filename))
+    return g_strdup(filename);
+
+  folder = g_get_current_dir();
+  path = g_build_filename(folder, filename, NULL);
+  g_free(folder);
+  return path;
+}
+
+/**
+ * @brief Read a little endian 32 bits integer. DON'T USE DIRECTLY.
+ */
+static guint32
+metacache_get_u32(const gchar *data, gsize offset)
+{
+  guint32 value;
+
+  memcpy(&value, data + offset, 4);
+  return GUINT32_FROM_LE(value);
+}
+
+/**
+ * @brief Read a little endian 64 bits integer. DON'T USE DIRECTLY.
+ */
+static gint64
+metacache_get_i64(const gchar *data, gsize offset)
+{
+  guint64 value;
+
+  memcpy(&value, data + offset, 8);
+  return (gint64)GUINT64_FROM_LE(value);
+}
+
+/**
+ * @brief Write a little endian 32 bits integer. DON'T USE DIRECTLY.
+ */
+static void
+metacache_set_u32(gchar *data, gsize offset, guint32 value)
+{
+  value = GUINT32_TO_LE(value);
+  memcpy(data + offset, &value, 4);
+  return;
+}
+
+/**
+ * @brief Write a little endian 64 bits integer. DON'T USE DIRECTLY.
+ */
+static void
+metacache_set_i64(gchar *data, gsize offset, gint64 value)
+{
+  guint64 le = GUINT64_TO_LE((guint64)value);
+
+  memcpy(data + offset, &le, 8);
+  return;
+}
+
+/**
+ * @brief Append a string (and a NUL) to the strings of a new cache.
+ *        DON'T USE DIRECTLY.
+ *
+ * @param strings: the strings.
+ * @param base: offset of the strings in the cache.
+ * @param string: the string.
+ * @param length: its length.
+ * @return its offset in the cache.
+ */
+static guint32
+metacache_add_string(GString *strings, gsize base, const gchar *string,
+                     gsize length)
+{
+  guint32 offset = (guint32)(base + strings->len);
+
+  g_string_append_len(strings, string, length);
+  g_string_append_c(strings, '\0');
+  return offset;
+}
+
+/**
+ * @brief Append a string node to the strings of a new cache.
+ *        DON'T USE DIRECTLY.
+ *
+ * @param strings: the strings.
+ * @param base: offset of the strings in the cache.
+ * @param node: the node (can be NULL).
+ * @return its offset in the cache, 0 if it isn't a string.
+ */
+static guint32
+metacache_add_node(GString *strings, gsize base, BencNode *node)
+{
+  if(node == NULL || benc_node_type(node) != BENC_TYPE_STRING)
+    return 0;
+
+  return metacache_add_string(strings, base, benc_node_data(node),
+                              benc_node_length(node));
+}
+
+/**
+ * @brief Check that a string offset of a loaded cache is in its strings.
+ *        DON'T USE DIRECTLY.
+ *
+ * @param cache: the MetaCache.
+ * @param offset: the offset.
+ * @return TRUE if it's 0 (no string) or a valid offset.
+ */
+static gboolean
+metacache_check_string(MetaCache *cache, guint32 offset)
+{
+  return offset == 0 ||
+         (offset >= METACACHE_HEADER_SIZE +
+                    (gsize)metacache_get_u32(cache->data, METACACHE_N_FILES)*METACACHE_RECORD_SIZE &&
+          offset < cache->length);
+}
+
+/**
+ * @brief Check that the strings one after the other of a loaded cache
+ *        are in its strings. DON'T USE DIRECTLY.
+ *
+ * @param cache: the MetaCache.
+ * @param offset: the offset of the first string (0 if there are none).
+ * @param n: the number of strings.
+ * @return TRUE if they are all there.
+ */
+static gboolean
+metacache_check_strings(MetaCache *cache, guint32 offset, guint32 n)
+{
+  gsize next;
+  guint32 i;
+
+  if(offset == 0 || n == 0)
+    return TRUE;
+
+  /* the cache ends with a NUL, so strlen stops inside of it */
+  for(i = 0, next = offset; i < n; i++, next += strlen(cache->data + next) + 1)
+  {
+    if(!metacache_check_string(cache, (guint32)next) || next >= cache->length)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* END **********************************************************************/
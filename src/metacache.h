@@ -0,0 +1,66 @@
+/**
+ * @file metacache.h
+ *
+ * @brief header file for the cache of the opened torrents metainfo.
+ */
+
+#ifndef _METACACHE_H
+#define _METACACHE_H
+
+/* INCLUDES *****************************************************************/
+
+#include <glib.h>
+#include "bencode.h"
+
+/* DEFINES ******************************************************************/
+
+#define METACACHE_MAGIC       "GTVMETA3"  /* 8 bytes, with the version */
+#define METACACHE_HEADER_SIZE  128        /* bytes before the files table */
+#define METACACHE_RECORD_SIZE   24        /* bytes of each file record    */
+
+/* TYPEDEF ******************************************************************/
+
+/**
+ * @brief The summary of a torrent, its files list and its trackers, as
+ *        they are showed in the General, Files and Trackers tabs.
+ *        @see metacache_load
+ *
+ * It's a little endian binary file, mapped in memory when it's loaded:
+ * a header of METACACHE_HEADER_SIZE bytes, a record of
+ * METACACHE_RECORD_SIZE bytes for each file and the strings (NUL
+ * terminated, the offsets are from the beginning of the file).
+ */
+typedef struct _MetaCache MetaCache;
+
+/* PROTOTYPES ***************************************************************/
+
+G_BEGIN_DECLS
+
+MetaCache   *metacache_load(const gchar *filename, gint64 size, gint64 mtime,
+                            gint64 mtime_nsec, gint64 inode);
+MetaCache   *metacache_new(const gchar *filename, gint64 size, gint64 mtime,
+                           gint64 mtime_nsec, gint64 inode,
+                           BencNode *metainfo, const guint8 *info_hash);
+void         metacache_free(MetaCache *cache);
+
+const guint8 *metacache_get_info_hash(MetaCache *cache);
+gboolean     metacache_has_info(MetaCache *cache);
+const gchar *metacache_get_name(MetaCache *cache);
+const gchar *metacache_get_announce(MetaCache *cache);
+const gchar *metacache_get_created_by(MetaCache *cache);
+const gchar *metacache_get_comment(MetaCache *cache, guint *length);
+gboolean     metacache_get_creation_date(MetaCache *cache, gint64 *date);
+gint64       metacache_get_piece_length(MetaCache *cache);
+guint        metacache_get_n_pieces(MetaCache *cache);
+gint64       metacache_get_total_size(MetaCache *cache);
+guint        metacache_get_n_files(MetaCache *cache);
+const gchar *metacache_get_trackers(MetaCache *cache, guint *n_trackers);
+
+const gchar *metacache_file_path(MetaCache *cache, guint file);
+gint64       metacache_file_size(MetaCache *cache, guint file);
+guint        metacache_file_first_piece(MetaCache *cache, guint file);
+guint        metacache_file_n_pieces(MetaCache *cache, guint file);
+
+G_END_DECLS
+
+#endif /* _METACACHE_H */
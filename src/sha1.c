@@ -11,6 +11,10 @@
  *   - SHA1 function, compute sha1 of a memory block using just 1 function.
  *   - R, S and P macros moved outside sha1_process function.
  *   - SHA_DIGEST_LENGTH defined and sustituted where needed.
+ *   - Blocks go through a backend chosen at run time (x86 SHA extensions
+ *     when the CPU has them, the portable code otherwise).
+ *   - sha1_multi_* hash up to SHA1_MULTI_LANES buffers side by side
+ *     (AVX2 when there are no SHA extensions).
  *
  * Fri Oct  8 20:32:33 2004
  * Copyright (C) 2004  Alejandro Claro
@@ -40,6 +44,13 @@
 
 #include "sha1.h"
 
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#  define SHA1_X86_BACKENDS 1
+#  include <cpuid.h>
+#  include <immintrin.h>
+#endif
+
 /* MACROS *******************************************************************/
 
 #define GET_UINT32(n,b,i)              \
@@ -72,8 +83,39 @@
   e += S(a,5) + F(b,c,d) + K + x; b = S(b,30); \
 }
 
+/* TYPEDEF ******************************************************************/
+
+/**
+ * @brief A SHA-1 backend, it processes a run of 64 bytes blocks.
+ */
+typedef void (*Sha1BlocksFunc) (sha1_context *ctx, guint8 *data,
+                                guint32 blocks);
+
+/**
+ * @brief A multi-buffer SHA-1 backend, it processes the same number of
+ *        blocks of up to SHA1_MULTI_LANES buffers at once.
+ */
+typedef void (*Sha1MultiBlocksFunc) (sha1_context *lane, guint8 **data,
+                                     guint n, guint32 blocks);
+
+/* PRIVATE FUNCTIONS ********************************************************/
+
+static gpointer sha1_select_backend(gpointer data);
+static void     sha1_blocks_c(sha1_context *ctx, guint8 *data, guint32 blocks);
+#ifdef SHA1_X86_BACKENDS
+static void     sha1_blocks_shani(sha1_context *ctx, guint8 *data,
+                                  guint32 blocks);
+static void     sha1_multi_blocks_avx2(sha1_context *lane, guint8 **data,
+                                       guint n, guint32 blocks);
+#endif
+
 /* GLOBALS ******************************************************************/
 
+static GOnce          sha1_backend_once = G_ONCE_INIT;
+static Sha1BlocksFunc sha1_blocks = sha1_blocks_c;
+static const gchar   *sha1_backend_name = "c";
+static Sha1MultiBlocksFunc sha1_multi_blocks = NULL;
+
 static guint8 sha1_padding[64] =
 {
  0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -92,6 +134,8 @@ static guint8 sha1_padding[64] =
 void
 sha1_starts(sha1_context *ctx)
 {
+  g_once(&sha1_backend_once, sha1_select_backend, NULL);
+
   ctx->total[0] = 0;
   ctx->total[1] = 0;
 
@@ -282,17 +326,17 @@ sha1_update(sha1_context *ctx, guint8 *input, guint32 length)
   if(left && length >= fill)
   {
     memcpy((void*)(ctx->buffer + left), (void*)input, fill);
-    sha1_process(ctx, ctx->buffer);
+    sha1_blocks(ctx, ctx->buffer, 1);
     length -= fill;
     input  += fill;
     left = 0;
   }
 
-  while(length >= 64)
+  if(length >= 64)
   {
-    sha1_process(ctx, input);
-    length -= 64;
-    input  += 64;
+    sha1_blocks(ctx, input, length/64);
+    input  += length & ~0x3F;
+    length &= 0x3F;
   }
 
   if(length)
@@ -360,3 +404,454 @@ SHA1(guint8 *input, guint32 length, guint8 *digest)
 
   return digest;
 }
+
+/**
+ * @brief name of the SHA-1 backend in use.
+ *
+ * @return "sha-ni" when the x86 SHA extensions are used, "avx2" when
+ *         the multi-buffer AVX2 code is, "c" otherwise.
+ */
+const gchar *
+sha1_backend(void)
+{
+  g_once(&sha1_backend_once, sha1_select_backend, NULL);
+  return sha1_backend_name;
+}
+
+/**
+ * @brief start a multi-buffer SHA-1 calculation.
+ *
+ * The n buffers are hashed side by side, each one has its own digest.
+ * All of them must get the same number of bytes in each sha1_multi_update.
+ *
+ * @param ctx: the multi-buffer sha1 context structure.
+ * @param n: the number of buffers (1 to SHA1_MULTI_LANES).
+ */
+void
+sha1_multi_starts(sha1_multi_context *ctx, guint n)
+{
+  guint i;
+
+  ctx->n = CLAMP(n, 1, SHA1_MULTI_LANES);
+  for(i = 0; i < ctx->n; i++)
+    sha1_starts(&ctx->lane[i]);
+
+  return;
+}
+
+/**
+ * @brief add data to each buffer of a multi-buffer SHA-1.
+ *
+ * @param ctx: the multi-buffer sha1 context structure.
+ * @param input: the ctx->n pointers to the input data.
+ * @param length: the byte length of each input data.
+ */
+void
+sha1_multi_update(sha1_multi_context *ctx, guint8 **input, guint32 length)
+{
+  guint8 *data[SHA1_MULTI_LANES];
+  guint32 left, fill, done;
+  guint i;
+
+  if(sha1_multi_blocks == NULL || ctx->n == 1)
+  {
+    for(i = 0; i < ctx->n; i++)
+      sha1_update(&ctx->lane[i], input[i], length);
+    return;
+  }
+
+  if(!length)
+    return;
+
+  /* all the lanes have the same total, so the same left */
+  left = ctx->lane[0].total[0] & 0x3F;
+  fill = 64 - left;
+  done = 0;
+
+  for(i = 0; i < ctx->n; i++)
+  {
+    ctx->lane[i].total[0] += length;
+    if(ctx->lane[i].total[0] < length)
+      ctx->lane[i].total[1]++;
+  }
+
+  if(left && length >= fill)
+  {
+    for(i = 0; i < ctx->n; i++)
+    {
+      memcpy((void*)(ctx->lane[i].buffer + left), (void*)input[i], fill);
+      data[i] = ctx->lane[i].buffer;
+    }
+    sha1_multi_blocks(ctx->lane, data, ctx->n, 1);
+    done = fill;
+    left = 0;
+  }
+
+  if(length - done >= 64)
+  {
+    for(i = 0; i < ctx->n; i++)
+      data[i] = input[i] + done;
+    sha1_multi_blocks(ctx->lane, data, ctx->n, (length - done)/64);
+    done += (length - done) & ~0x3F;
+  }
+
+  if(length > done)
+  {
+    for(i = 0; i < ctx->n; i++)
+      memcpy((void*)(ctx->lane[i].buffer + left), (void*)(input[i] + done),
+             length - done);
+  }
+
+  return;
+}
+
+/**
+ * @brief digest the sha1 of each buffer of a multi-buffer SHA-1.
+ *
+ * @param ctx: the multi-buffer sha1 context structure.
+ * @param digest: ctx->n pointers to SHA_DIGEST_LENGTH bytes.
+ */
+void
+sha1_multi_finish(sha1_multi_context *ctx, guint8 **digest)
+{
+  guint i;
+
+  /* just the padding is left, one or two blocks */
+  for(i = 0; i < ctx->n; i++)
+    sha1_finish(&ctx->lane[i], digest[i]);
+
+  return;
+}
+
+/**
+ * @brief the number of buffers worth hashing together.
+ *
+ * @return SHA1_MULTI_LANES if there is a multi-buffer backend faster
+ *         than the single one, 1 otherwise.
+ */
+guint
+sha1_multi_lanes(void)
+{
+  g_once(&sha1_backend_once, sha1_select_backend, NULL);
+  return (sha1_multi_blocks != NULL)? SHA1_MULTI_LANES : 1;
+}
+
+/* PRIVATE FUNCTIONS ********************************************************/
+
+/**
+ * @brief choose the fastest backend the CPU supports (run once).
+ *
+ * DON'T USE DIRECTLY, it's called with g_once by sha1_starts.
+ */
+static gpointer
+sha1_select_backend(gpointer data)
+{
+#ifdef SHA1_X86_BACKENDS
+  guint eax, ebx, ecx, edx, xcr0;
+
+  if(__get_cpuid_max(0, NULL) < 7)
+    return NULL;
+
+  /* SSSE3 (pshufb) and SSE4.1 (pextrd) are needed too */
+  __cpuid(1, eax, ebx, ecx, edx);
+  if(!(ecx & (1 << 9)) || !(ecx & (1 << 19)))
+    return NULL;
+
+  /* the OS must save the YMM registers (OSXSAVE, then XCR0) for AVX2 */
+  xcr0 = 0;
+  if(ecx & (1 << 27))
+    __asm__ __volatile__("xgetbv" : "=a"(xcr0), "=d"(edx) : "c"(0));
+
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  if(ebx & (1 << 29))
+  {
+    /* about as fast as eight AVX2 lanes, without batching the buffers */
+    sha1_blocks = sha1_blocks_shani;
+    sha1_backend_name = "sha-ni";
+  }
+  else if((ebx & (1 << 5)) && (xcr0 & 0x6) == 0x6)
+  {
+    sha1_multi_blocks = sha1_multi_blocks_avx2;
+    sha1_backend_name = "avx2";
+  }
+#endif
+
+  return NULL;
+}
+
+/**
+ * @brief portable backend, sha1_process over each block.
+ *
+ * @param ctx: the sha1 context structure.
+ * @param data: the blocks.
+ * @param blocks: number of 64 bytes blocks in data.
+ */
+static void
+sha1_blocks_c(sha1_context *ctx, guint8 *data, guint32 blocks)
+{
+  while(blocks--)
+  {
+    sha1_process(ctx, data);
+    data += 64;
+  }
+
+  return;
+}
+
+#ifdef SHA1_X86_BACKENDS
+
+/*
+ * Four rounds of the SHA extensions: e0 gets the next E, e1 saves ABCD for
+ * the next group, and the message schedule goes one group ahead
+ * (m1 completed, m3 and m2 started). m0..m3 are W[t..t+15] in 4 words
+ * registers, rotated in each call.
+ */
+#define SHANI_ROUNDS(f,e0,e1,m0,m1,m2,m3)      \
+{                                              \
+  e0 = _mm_sha1nexte_epu32(e0, m0);            \
+  e1 = abcd;                                   \
+  m1 = _mm_sha1msg2_epu32(m1, m0);             \
+  abcd = _mm_sha1rnds4_epu32(abcd, e0, f);     \
+  m3 = _mm_sha1msg1_epu32(m3, m0);             \
+  m2 = _mm_xor_si128(m2, m0);                  \
+}
+
+/**
+ * @brief x86 SHA extensions backend.
+ *
+ * @param ctx: the sha1 context structure.
+ * @param data: the blocks.
+ * @param blocks: number of 64 bytes blocks in data.
+ */
+__attribute__((target("sha,sse4.1")))
+static void
+sha1_blocks_shani(sha1_context *ctx, guint8 *data, guint32 blocks)
+{
+  __m128i abcd, abcd_save, e0, e0_save, e1;
+  __m128i msg0, msg1, msg2, msg3, mask;
+
+  mask = _mm_set_epi64x(0x0001020304050607LL, 0x08090A0B0C0D0E0FLL);
+
+  abcd = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*)ctx->state), 0x1B);
+  e0 = _mm_set_epi32((gint)ctx->state[4], 0, 0, 0);
+
+  while(blocks--)
+  {
+    abcd_save = abcd;
+    e0_save = e0;
+
+    /* rounds 0-15, the first message words come from the block */
+    msg0 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)(data +  0)), mask);
+    e0 = _mm_add_epi32(e0, msg0);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+    msg1 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)(data + 16)), mask);
+    e1 = _mm_sha1nexte_epu32(e1, msg1);
+    e0 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+    msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+    msg2 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)(data + 32)), mask);
+    e0 = _mm_sha1nexte_epu32(e0, msg2);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+    msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+    msg0 = _mm_xor_si128(msg0, msg2);
+
+    msg3 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)(data + 48)), mask);
+    SHANI_ROUNDS(0, e1, e0, msg3, msg0, msg1, msg2);
+
+    /* rounds 16-79 */
+    SHANI_ROUNDS(0, e0, e1, msg0, msg1, msg2, msg3);
+    SHANI_ROUNDS(1, e1, e0, msg1, msg2, msg3, msg0);
+    SHANI_ROUNDS(1, e0, e1, msg2, msg3, msg0, msg1);
+    SHANI_ROUNDS(1, e1, e0, msg3, msg0, msg1, msg2);
+    SHANI_ROUNDS(1, e0, e1, msg0, msg1, msg2, msg3);
+    SHANI_ROUNDS(1, e1, e0, msg1, msg2, msg3, msg0);
+    SHANI_ROUNDS(2, e0, e1, msg2, msg3, msg0, msg1);
+    SHANI_ROUNDS(2, e1, e0, msg3, msg0, msg1, msg2);
+    SHANI_ROUNDS(2, e0, e1, msg0, msg1, msg2, msg3);
+    SHANI_ROUNDS(2, e1, e0, msg1, msg2, msg3, msg0);
+    SHANI_ROUNDS(2, e0, e1, msg2, msg3, msg0, msg1);
+    SHANI_ROUNDS(3, e1, e0, msg3, msg0, msg1, msg2);
+    SHANI_ROUNDS(3, e0, e1, msg0, msg1, msg2, msg3);
+    SHANI_ROUNDS(3, e1, e0, msg1, msg2, msg3, msg0);
+    SHANI_ROUNDS(3, e0, e1, msg2, msg3, msg0, msg1);
+    SHANI_ROUNDS(3, e1, e0, msg3, msg0, msg1, msg2);
+
+    e0 = _mm_sha1nexte_epu32(e0, e0_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+
+    data += 64;
+  }
+
+  _mm_storeu_si128((__m128i*)ctx->state, _mm_shuffle_epi32(abcd, 0x1B));
+  ctx->state[4] = (guint32)_mm_extract_epi32(e0, 3);
+
+  return;
+}
+
+#undef SHANI_ROUNDS
+
+#define ROTL256(x,n) _mm256_or_si256(_mm256_slli_epi32(x, n), \
+                                     _mm256_srli_epi32(x, 32 - n))
+
+/*
+ * One round over the eight lanes, the vector version of P: W must hold
+ * the schedule word t.
+ */
+#define AVX2_ROUND(F,k,w)                                           \
+{                                                                   \
+  temp = _mm256_add_epi32(_mm256_add_epi32(ROTL256(a, 5), F),       \
+                          _mm256_add_epi32(e, _mm256_add_epi32(k, w)));\
+  e = d; d = c; c = ROTL256(b, 30); b = a; a = temp;                \
+}
+
+#define AVX2_F1 _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)))
+#define AVX2_F2 _mm256_xor_si256(b, _mm256_xor_si256(c, d))
+#define AVX2_F3 _mm256_or_si256(_mm256_and_si256(b, c), \
+                                _mm256_and_si256(d, _mm256_or_si256(b, c)))
+
+/**
+ * @brief load 8 big endian words of each lane, transposed: w[j] gets the
+ *        word j of all the lanes.
+ *
+ * DON'T USE DIRECTLY, it's a helper of sha1_multi_blocks_avx2.
+ */
+__attribute__((target("avx2")))
+static inline void
+sha1_avx2_load8(__m256i *w, guint8 **data, guint offset)
+{
+  __m256i r[8], t[8], u[8], mask;
+  guint i;
+
+  mask = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                         12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+  for(i = 0; i < 8; i++)
+    r[i] = _mm256_loadu_si256((__m256i*)(data[i] + offset));
+
+  for(i = 0; i < 8; i += 2)
+  {
+    t[i]   = _mm256_unpacklo_epi32(r[i], r[i+1]);
+    t[i+1] = _mm256_unpackhi_epi32(r[i], r[i+1]);
+  }
+
+  for(i = 0; i < 8; i += 4)
+  {
+    u[i]   = _mm256_unpacklo_epi64(t[i],   t[i+2]);
+    u[i+1] = _mm256_unpackhi_epi64(t[i],   t[i+2]);
+    u[i+2] = _mm256_unpacklo_epi64(t[i+1], t[i+3]);
+    u[i+3] = _mm256_unpackhi_epi64(t[i+1], t[i+3]);
+  }
+
+  for(i = 0; i < 4; i++)
+  {
+    w[i]   = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u[i], u[i+4], 0x20), mask);
+    w[i+4] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u[i], u[i+4], 0x31), mask);
+  }
+
+  return;
+}
+
+/**
+ * @brief AVX2 multi-buffer backend, eight SHA-1 in the 32 bits lanes of
+ *        the YMM registers.
+ *
+ * @param lane: the n sha1 context structures.
+ * @param data: the n blocks runs.
+ * @param n: number of buffers (up to SHA1_MULTI_LANES, the missing
+ *           lanes hash the first buffer again and are discarded).
+ * @param blocks: number of 64 bytes blocks in each data.
+ */
+__attribute__((target("avx2")))
+static void
+sha1_multi_blocks_avx2(sha1_context *lane, guint8 **data, guint n,
+                       guint32 blocks)
+{
+  __m256i state[5], a, b, c, d, e, temp, k, W[16];
+  guint32 words[5][SHA1_MULTI_LANES];
+  guint8 *ptr[SHA1_MULTI_LANES];
+  guint i, j, t;
+
+  for(i = 0; i < SHA1_MULTI_LANES; i++)
+  {
+    j = (i < n)? i : 0;
+    ptr[i] = data[j];
+    for(t = 0; t < 5; t++)
+      words[t][i] = lane[j].state[t];
+  }
+
+  for(t = 0; t < 5; t++)
+    state[t] = _mm256_loadu_si256((__m256i*)words[t]);
+
+  while(blocks--)
+  {
+    sha1_avx2_load8(W, ptr, 0);
+    sha1_avx2_load8(W + 8, ptr, 32);
+
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+
+    for(t = 0; t < 80; t++)
+    {
+      if(t >= 16)
+      {
+        temp = _mm256_xor_si256(_mm256_xor_si256(W[(t - 3) & 0x0F], W[(t - 8) & 0x0F]),
+                                _mm256_xor_si256(W[(t - 14) & 0x0F], W[t & 0x0F]));
+        W[t & 0x0F] = ROTL256(temp, 1);
+      }
+
+      if(t < 20)
+      {
+        k = _mm256_set1_epi32(0x5A827999);
+        AVX2_ROUND(AVX2_F1, k, W[t & 0x0F]);
+      }
+      else if(t < 40)
+      {
+        k = _mm256_set1_epi32(0x6ED9EBA1);
+        AVX2_ROUND(AVX2_F2, k, W[t & 0x0F]);
+      }
+      else if(t < 60)
+      {
+        k = _mm256_set1_epi32((gint)0x8F1BBCDC);
+        AVX2_ROUND(AVX2_F3, k, W[t & 0x0F]);
+      }
+      else
+      {
+        k = _mm256_set1_epi32((gint)0xCA62C1D6);
+        AVX2_ROUND(AVX2_F2, k, W[t & 0x0F]);
+      }
+    }
+
+    state[0] = _mm256_add_epi32(state[0], a);
+    state[1] = _mm256_add_epi32(state[1], b);
+    state[2] = _mm256_add_epi32(state[2], c);
+    state[3] = _mm256_add_epi32(state[3], d);
+    state[4] = _mm256_add_epi32(state[4], e);
+
+    for(i = 0; i < SHA1_MULTI_LANES; i++)
+      ptr[i] += 64;
+  }
+
+  for(t = 0; t < 5; t++)
+    _mm256_storeu_si256((__m256i*)words[t], state[t]);
+
+  for(i = 0; i < n; i++)
+    for(t = 0; t < 5; t++)
+      lane[i].state[t] = words[t][i];
+
+  return;
+}
+
+#undef AVX2_F3
+#undef AVX2_F2
+#undef AVX2_F1
+#undef AVX2_ROUND
+#undef ROTL256
+
+#endif /* SHA1_X86_BACKENDS */
@@ -10,6 +10,9 @@
  *   - SHA1 function, compute sha1 of a memory block using just 1 function.
  *   - R, S and P macros moved outside sha1_process function.
  *   - SHA_DIGEST_LENGTH defined and sustituted where needed.
+ *   - Blocks go through a backend chosen at run time (x86 SHA extensions
+ *     when the CPU has them, the portable code otherwise).
+ *   - sha1_multi_* hash up to SHA1_MULTI_LANES buffers side by side.
  *
  *  Fri Oct  8 20:25:48 2004
  *  Copyright (C) 2004  Alejandro Claro
@@ -20,6 +23,7 @@
 #define _SHA1_H
 
 #define SHA_DIGEST_LENGTH  20
+#define SHA1_MULTI_LANES    8  /* buffers of a sha1_multi_context */
 
 typedef struct
 {
@@ -28,6 +32,12 @@ typedef struct
     guint8  buffer[64];
 } sha1_context;
 
+typedef struct
+{
+    sha1_context lane[SHA1_MULTI_LANES];
+    guint        n;
+} sha1_multi_context;
+
 G_BEGIN_DECLS
 
 void sha1_starts(sha1_context *ctx);
@@ -36,6 +46,13 @@ void sha1_finish(sha1_context *ctx, guint8 digest[20]);
 
 guint8 *SHA1(guint8 *input, guint32 length, guint8 *digest);
 
+void  sha1_multi_starts(sha1_multi_context *ctx, guint n);
+void  sha1_multi_update(sha1_multi_context *ctx, guint8 **input, guint32 length);
+void  sha1_multi_finish(sha1_multi_context *ctx, guint8 **digest);
+guint sha1_multi_lanes(void);
+
+const gchar *sha1_backend(void);
+
 G_END_DECLS
 
 #endif /* _SHA1_H */
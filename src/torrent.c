@@ -0,0 +1,336 @@
+/**
+ * @file torrent.c
+ *
+ * @brief Functions for load torrent metainfo files.
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* INCLUDES *****************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include "bencode.h"
+#include "sha1.h"
+#include "metacache.h"
+#include "torrent.h"
+
+/* PRIVATE FUNCTIONS ********************************************************/
+
+static Torrent *torrent_load(const gchar *filename, gboolean cached, GError **error);
+static gpointer torrent_decode(gpointer data);
+static void     torrent_sha1_write(const char *data, UINT32 length, void *ctx);
+
+/* FUNCTIONS ****************************************************************/
+
+/**
+ * @brief the error domain of the torrent functions.
+ *
+ * @return the TORRENT_ERROR quark.
+ */
+GQuark
+torrent_error_quark(void)
+{
+  return g_quark_from_static_string("torrent-error-quark");
+}
+
+/**
+ * @brief Load a torrent metainfo file.
+ *
+ * The file is memory mapped and decoded in place with
+ * benc_decode_buf_arena, the mapping lives as long as the Torrent.
+ * The info hash is the SHA1 of the "info" value exactly as it is in
+ * the file, so it is right for non canonical encoded torrents too.
+ *
+ * @param filename: the .torrent file name.
+ * @param error: return location for a GError (can be NULL).
+ * @return a new allocated Torrent, or NULL if fail.
+ *         @see torrent_free
+ */
+Torrent *
+torrent_open(const gchar *filename, GError **error)
+{
+  return torrent_load(filename, FALSE, error);
+}
+
+/**
+ * @brief Load a torrent metainfo file, with its MetaCache.
+ *
+ * As torrent_open, but the summary, files list and trackers of the
+ * torrent are in the cache member. If the file was opened before (same
+ * path, size, modification time and inode) they are taken from the
+ * cache with the info hash, and the file is only mapped: it's decoded
+ * when the metainfo is asked (torrent_get_metainfo). Else they are
+ * computed and saved for the next time. The cache is NULL if it can't
+ * be made (a torrent too big for it), the torrent is opened anyway.
+ *
+ * @param filename: the .torrent file name.
+ * @param error: return location for a GError (can be NULL).
+ * @return a new allocated Torrent, or NULL if fail.
+ *         @see torrent_free
+ */
+Torrent *
+torrent_open_cached(const gchar *filename, GError **error)
+{
+  return torrent_load(filename, TRUE, error);
+}
+
+/**
+ * @brief Add a reference to a Torrent, for who keeps it (as a tree
+ *        model of its metainfo) longer than who opened it.
+ *
+ * @param torrent: the Torrent.
+ * @return the torrent. Drop the reference with torrent_free.
+ */
+Torrent *
+torrent_ref(Torrent *torrent)
+{
+  g_atomic_int_inc(&torrent->ref_count);
+  return torrent;
+}
+
+/**
+ * @brief Drop a reference to a Torrent, at the last one free it, its
+ *        metainfo tree and unmap the file.
+ *
+ * @param torrent: the Torrent (can be NULL).
+ */
+void
+torrent_free(Torrent *torrent)
+{
+  if(torrent == NULL || !g_atomic_int_dec_and_test(&torrent->ref_count))
+    return;
+
+  benc_arena_destroy(torrent->arena);
+
+  if(torrent->mapping != NULL)
+    g_mapped_file_unref(torrent->mapping);
+
+  metacache_free(torrent->cache);
+  g_free(torrent->filename);
+  g_free(torrent);
+  return;
+}
+
+/**
+ * @brief Compute the SHA1 of a bencode node (the info hash when the
+ *        node is the info dictionary).
+ *
+ * The node is encoded with benc_encode_stream straight into the SHA1
+ * context, so the encoded data is never held in memory. It's meant for
+ * trees without source bytes (malloc'd or edited ones), for a loaded
+ * torrent use the info_hash member, it's computed over the original data.
+ *
+ * @param info: the BencNode (usually the "info" value).
+ * @param digest: return the SHA1 (SHA_DIGEST_LENGTH bytes).
+ */
+void
+torrent_compute_info_hash(BencNode *info, guint8 *digest)
+{
+  sha1_context ctx;
+
+  sha1_starts(&ctx);
+  benc_encode_stream(info, torrent_sha1_write, &ctx);
+  sha1_finish(&ctx, digest);
+
+  return;
+}
+
+/**
+ * @brief The decoded metainfo of a Torrent, it's decoded now if the
+ *        torrent was taken from its cache. It can be called from any
+ *        thread.
+ *
+ * @param torrent: the Torrent.
+ * @return the metainfo, or NULL if it couldn't be decoded.
+ */
+BencNode *
+torrent_get_metainfo(Torrent *torrent)
+{
+  return (BencNode*)g_once(&torrent->decoded, torrent_decode, torrent);
+}
+
+/**
+ * @brief The "info" dictionary of a Torrent, @see torrent_get_metainfo.
+ *
+ * @param torrent: the Torrent.
+ * @return the info dictionary, or NULL.
+ */
+BencNode *
+torrent_get_info(Torrent *torrent)
+{
+  return (torrent_get_metainfo(torrent) != NULL)? torrent->info : NULL;
+}
+
+/**
+ * @brief if a Torrent has an info dictionary (and so an info hash), it
+ *        doesn't decode the torrent.
+ *
+ * @param torrent: the Torrent.
+ * @return TRUE if it has it.
+ */
+gboolean
+torrent_has_info(Torrent *torrent)
+{
+  if(torrent->cache != NULL)
+    return metacache_has_info(torrent->cache);
+
+  return torrent_get_info(torrent) != NULL;
+}
+
+/**
+ * @brief Load a torrent metainfo file, @see torrent_open and
+ *        torrent_open_cached. DON'T USE DIRECTLY.
+ *
+ * @param filename: the .torrent file name.
+ * @param cached: TRUE to use a MetaCache.
+ * @param error: return location for a GError (can be NULL).
+ * @return a new allocated Torrent, or NULL if fail.
+ */
+static Torrent *
+torrent_load(const gchar *filename, gboolean cached, GError **error)
+{
+  Torrent *torrent;
+  GMappedFile *mapping;
+  struct stat st;
+  gchar *data;
+  gsize length;
+  gint64 mtime_nsec;
+
+  /* the cache key, before the mapping so a later change is seen */
+  if(!cached || g_stat(filename, &st) != 0)
+    cached = FALSE;
+
+#if defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200809L /* has st_mtim */
+  mtime_nsec = (cached)? (gint64)st.st_mtim.tv_nsec : 0;
+#else
+  mtime_nsec = 0;
+#endif
+
+  mapping = g_mapped_file_new(filename, FALSE, error);
+  if(mapping == NULL)
+    return NULL;
+
+  data = g_mapped_file_get_contents(mapping);
+  length = g_mapped_file_get_length(mapping);
+
+  if(data == NULL || length == 0 || length > G_MAXUINT32)
+  {
+    g_set_error(error, TORRENT_ERROR, TORRENT_ERROR_INVALID,
+                _("%s is not a bencoded torrent file or have corrupted data."),
+                filename);
+    g_mapped_file_unref(mapping);
+    return NULL;
+  }
+
+  torrent = g_new0(Torrent, 1);
+  torrent->ref_count = 1;
+  torrent->filename = g_strdup(filename);
+  torrent->mapping = mapping;
+
+  /* a known torrent has all that is showed at first in the cache, the
+   * mapping keeps its data if it's replaced before being decoded */
+  if(cached)
+    torrent->cache = metacache_load(filename, (gint64)st.st_size, (gint64)st.st_mtime,
+                                    mtime_nsec, (gint64)st.st_ino);
+
+  if(torrent->cache != NULL)
+  {
+    memcpy(torrent->info_hash, metacache_get_info_hash(torrent->cache), SHA_DIGEST_LENGTH);
+    return torrent;
+  }
+
+  if(torrent_get_metainfo(torrent) == NULL)
+  {
+    g_set_error(error, TORRENT_ERROR, TORRENT_ERROR_INVALID,
+                _("%s is not a bencoded torrent file or have corrupted data."),
+                filename);
+    torrent_free(torrent);
+    return NULL;
+  }
+
+  if(torrent->info != NULL)
+  {
+    /* computed once, over the original bytes (the arena decoder always
+     * records where they are) */
+    g_assert(benc_node_span(torrent->info) > 0);
+    SHA1((guint8*)data + benc_node_offset(torrent->info),
+         benc_node_span(torrent->info), torrent->info_hash);
+  }
+
+  /* the cache is only an optimization, without it (too big) the
+   * metainfo is used */
+  if(cached && torrent->cache == NULL)
+    torrent->cache = metacache_new(filename, (gint64)st.st_size, (gint64)st.st_mtime,
+                                   mtime_nsec, (gint64)st.st_ino,
+                                   torrent->metainfo, torrent->info_hash);
+
+  return torrent;
+}
+
+/**
+ * @brief BencWriteFunc that feeds a SHA1 context.
+ *
+ * @param data: the encoded data.
+ * @param length: the length of data.
+ * @param ctx: the sha1_context.
+ */
+static void
+torrent_sha1_write(const char *data, UINT32 length, void *ctx)
+{
+  sha1_update((sha1_context*)ctx, (guint8*)data, length);
+  return;
+}
+
+/**
+ * @brief Decode the metainfo of a Torrent, it's called once by
+ *        torrent_get_metainfo. DON'T USE DIRECTLY.
+ *
+ * @param data: the Torrent.
+ * @return the metainfo, or NULL if it's not valid bencode.
+ */
+static gpointer
+torrent_decode(gpointer data)
+{
+  Torrent *torrent = (Torrent*)data;
+  gsize length;
+  UINT32 bytes;
+
+  length = g_mapped_file_get_length(torrent->mapping);
+  torrent->arena = benc_arena_new(CLAMP(length/4, BENC_ARENA_DEFAULT_CHUNK,
+                                        TORRENT_ARENA_MAX_CHUNK));
+  torrent->metainfo = benc_decode_buf_arena(torrent->arena,
+                                            g_mapped_file_get_contents(torrent->mapping),
+                                            (UINT32)length, &bytes);
+
+  if(torrent->metainfo != NULL)
+    torrent->info = benc_dict_get(torrent->metainfo, "info");
+
+  return torrent->metainfo;
+}
+
+/* END **********************************************************************/
@@ -0,0 +1,76 @@
+/**
+ * @file torrent.h
+ *
+ * @brief header file for load torrent metainfo files.
+ */
+
+#ifndef _TORRENT_H
+#define _TORRENT_H
+
+/* INCLUDES *****************************************************************/
+
+#include <glib.h>
+#include "bencode.h"
+#include "sha1.h"
+#include "metacache.h"
+
+/* DEFINES ******************************************************************/
+
+#define TORRENT_ARENA_MAX_CHUNK  1048576 /* max BencArena chunk for a torrent */
+
+#define TORRENT_ERROR  (torrent_error_quark())
+
+/* TYPEDEF ******************************************************************/
+
+/**
+ * @brief Error codes of the TORRENT_ERROR domain.
+ */
+typedef enum
+{
+  TORRENT_ERROR_INVALID  /**< not bencoded data or corrupted data */
+} TorrentError;
+
+/**
+ * @brief A loaded torrent metainfo file.
+ *
+ * The .torrent file is memory mapped and decoded inside of an arena,
+ * the strings of the metainfo tree point directly to the mapping, so
+ * they are NOT NULL terminated (use benc_node_length). A torrent opened
+ * from its MetaCache is decoded the first time its metainfo is asked,
+ * so use torrent_get_metainfo and torrent_get_info to read it.
+ * DON'T EDIT THE MEMBERS DIRECTLY.
+ */
+typedef struct _Torrent
+{
+  gchar       *filename;  /**< the .torrent file name.                  */
+  GMappedFile *mapping;   /**< the mapped .torrent file.                */
+  BencArena   *arena;     /**< the memory of the metainfo nodes.        */
+  BencNode    *metainfo;  /**< the decoded metainfo (inside mapping).   */
+  BencNode    *info;      /**< the "info" dictionary (can be NULL).     */
+  GOnce       decoded;    /**< the decode of metainfo, done once.       */
+  guint8      info_hash[SHA_DIGEST_LENGTH]; /**< SHA1 of info, if any.  */
+  MetaCache   *cache;     /**< summary and files list (torrent_open_cached),
+                               NULL if the torrent is too big to cache. */
+  gint        ref_count;  /**< references, @see torrent_ref.           */
+} Torrent;
+
+/* PROTOTYPES ***************************************************************/
+
+G_BEGIN_DECLS
+
+GQuark   torrent_error_quark(void);
+
+Torrent *torrent_open(const gchar *filename, GError **error);
+Torrent *torrent_open_cached(const gchar *filename, GError **error);
+Torrent *torrent_ref(Torrent *torrent);
+void     torrent_free(Torrent *torrent);
+
+BencNode *torrent_get_metainfo(Torrent *torrent);
+BencNode *torrent_get_info(Torrent *torrent);
+gboolean  torrent_has_info(Torrent *torrent);
+
+void     torrent_compute_info_hash(BencNode *info, guint8 *digest);
+
+G_END_DECLS
+
+#endif /* _TORRENT_H */
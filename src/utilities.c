@@ -117,24 +117,24 @@ util_convert_to_human(gdouble number, const gchar *suffix)
 gchar *
 util_convert_node_to_string(BencNode *list, gchar *delimiter)
 {
-  gchar *string, *tmp;
+  GString *string;
   BencNode *child;
   
   if(benc_node_type(list) != BENC_TYPE_LIST || benc_node_is_leaf(list))
     return NULL;
   
+  /* the node data could be not NULL terminated, use the length */
   child = benc_node_first_child(list);
-  string = g_strdup(benc_node_data(child));
+  string = g_string_new_len(benc_node_data(child), benc_node_length(child));
   
   for(child = benc_node_next_sibling(child); child != NULL;
       child = benc_node_next_sibling(child))
   {
-    tmp = g_strdup_printf("%s%s%s", string, delimiter, benc_node_data(child));
-    g_free(string);
-    string = tmp;
+    g_string_append(string, delimiter);
+    g_string_append_len(string, benc_node_data(child), benc_node_length(child));
   }
   
-  return string;  
+  return g_string_free(string, FALSE);  
 }
 
 /**
@@ -0,0 +1,1715 @@
+/**
+ * @file verify.c
+ *
+ * @brief Engine for check the pieces of a torrent against its files.
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* INCLUDES *****************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+/* io_uring is opt-in, configure doesn't look for it:
+ * ./configure CPPFLAGS=-DHAVE_LIBURING LIBS=-luring */
+#ifdef HAVE_LIBURING
+#  include <liburing.h>
+#endif
+
+#include "sha1.h"
+#include "verify.h"
+
+/* DEFINES ******************************************************************/
+
+#define VERIFY_NONE  G_MAXUINT  /* no file in the idle open files list */
+
+#define VERIFY_CHECKPOINT_MAGIC  "GTVCHK2\n"  /* 8 bytes */
+
+/* bit of a bitmap of pieces */
+#define VERIFY_BIT(map,n)      ((map)[(n) >> 3] & (1 << ((n) & 7)))
+#define VERIFY_SET_BIT(map,n)  ((map)[(n) >> 3] |= (guint8)(1 << ((n) & 7)))
+
+/* TYPEDEF ******************************************************************/
+
+/**
+ * @brief A file of the torrent.
+ */
+typedef struct
+{
+  gchar     *filename; /**< the file name.                              */
+  gint64    size;      /**< the expected size.                          */
+  gint64    start;     /**< offset of the file inside the torrent data. */
+  gint64    remain;    /**< bytes not verified yet.                     */
+  gint      error;     /**< errno, VERIFY_FILE_SHORT or 0 (atomic).     */
+  gint64    disk_size; /**< the size in the disk (stat), -1 if missing. */
+  gint64    mtime;     /**< the modification time in the disk (stat).   */
+  gint64    mtime_nsec; /**< the nanoseconds of mtime, 0 if unknown.    */
+  guint64   inode;     /**< the inode in the disk (stat).               */
+  gboolean  unchanged; /**< TRUE if it's as in the checkpoint.          */
+  gint      fd;        /**< the open file, or -1.                       */
+  guint     users;     /**< reads using fd.                             */
+  guint     lru_prev;  /**< previous idle open file, or VERIFY_NONE.    */
+  guint     lru_next;  /**< next idle open file, or VERIFY_NONE.        */
+} VerifyFile;
+
+/**
+ * @brief A piece of data inside a file: a piece has one extent by file
+ *        it touches (none in the empty files).
+ */
+typedef struct
+{
+  guint     file;    /**< the file index.            */
+  guint     length;  /**< bytes of the piece there.  */
+  gint64    offset;  /**< where the data is in the file. */
+} VerifyExtent;
+
+typedef struct _VerifyJob VerifyJob;
+
+/**
+ * @brief A read of a file segment into a piece.
+ */
+typedef struct
+{
+  VerifyJob *job;    /**< the piece.                   */
+  guint     file;    /**< the file index.              */
+  gint      fd;      /**< the file, while it's in use. */
+  gint64    offset;  /**< where to read in the file.   */
+  guint     start;   /**< where to put it in the piece. */
+  guint     length;  /**< bytes left to read.          */
+} VerifyRead;
+
+/**
+ * @brief A piece passed from the reader to the workers.
+ */
+struct _VerifyJob
+{
+  guint      piece;     /**< the piece index.                     */
+  guint      length;    /**< bytes of data.                       */
+  gint       broken;    /**< some of the data couldn't be readed. */
+  gint       pending;   /**< reads not done yet (atomic).         */
+  gchar      *data;     /**< the piece data (piece_size bytes).   */
+  VerifyRead *reads;    /**< the reads of the piece.              */
+  guint      n_reads;   /**< number of reads.                     */
+  guint      max_reads; /**< allocated reads.                     */
+};
+
+/**
+ * @brief A Verify engine.
+ */
+struct _Verify
+{
+  gchar    *hashes;     /**< the SHA1 of the pieces (a copy).     */
+  guint    n_pieces;    /**< number of pieces.                    */
+  gint64   piece_size;  /**< size of the pieces.                  */
+  gint64   total_size;  /**< sum of the files sizes.              */
+  GArray   *files;      /**< the files (VerifyFile).              */
+  VerifyExtent *extents;  /**< extents of all the pieces, in order. */
+  guint    *first_extent; /**< piece -> its first extent (n_pieces+1). */
+  guint    n_workers;   /**< number of hashing threads.           */
+  guint    lanes;       /**< pieces hashed together by a worker.  */
+  guint    queue_depth; /**< number of reads in flight.           */
+  gint     cancel;      /**< TRUE if it was canceled (atomic).    */
+
+  GMutex   *mutex;      /**< lock of the results and func.        */
+  guint8   *checked;    /**< bitmap of the pieces checked.        */
+  guint8   *valid;      /**< bitmap of the valid pieces.          */
+  guint8   *known;      /**< bitmap of the pieces taken from the checkpoint. */
+  guint    n_resumed;   /**< number of pieces in known.           */
+  gchar    *checkpoint; /**< the checkpoint file name, or NULL.   */
+  GTimer   *save_timer; /**< time since the last checkpoint.      */
+  gchar    *save_data;  /**< the checkpoint to write, or NULL.    */
+  gsize    save_length; /**< the length of save_data.             */
+  gint     saving;      /**< TRUE while save_data is written (atomic). */
+  gboolean incremental; /**< TRUE to resume complete checks too.  */
+  gboolean check_inode; /**< TRUE if a new inode is a change.     */
+  VerifyFunc func;      /**< function called for each piece.     */
+  gpointer user_data;   /**< data for func.                       */
+
+  GAsyncQueue *free_jobs; /**< the jobs ready to be readed.       */
+  GAsyncQueue *full_jobs; /**< the jobs ready to be hashed.       */
+  GAsyncQueue *read_jobs; /**< the jobs for the pread threads.    */
+
+  GMutex   *fd_mutex;   /**< lock of the open files cache.        */
+  guint    n_open;      /**< files open now.                      */
+  guint    max_open;    /**< files that can be open.              */
+  guint    lru_first;   /**< least recently used idle open file.  */
+  guint    lru_last;    /**< most recently used idle open file.   */
+
+#ifdef HAVE_LIBURING
+  struct io_uring ring;   /**< the ring, if use_uring.            */
+  gboolean use_uring;     /**< TRUE if reading with io_uring.     */
+  guint    in_flight;     /**< reads submitted to the ring.       */
+#endif
+};
+
+/* PRIVATE FUNCTIONS ********************************************************/
+
+static guint    verify_count_jobs(Verify *verify);
+static void     verify_read_pieces(Verify *verify);
+static void     verify_plan_job(Verify *verify, VerifyJob *job, guint piece);
+static VerifyJob *verify_get_job(Verify *verify);
+static void     verify_submit_job(Verify *verify, VerifyJob *job);
+static gpointer verify_reader(gpointer data);
+static void     verify_read_job(Verify *verify, VerifyJob *job);
+static void     verify_read_failed(Verify *verify, VerifyRead *read, gint error);
+static void     verify_stat_files(Verify *verify);
+static gint     verify_fd_acquire(Verify *verify, guint f);
+static void     verify_fd_release(Verify *verify, guint f);
+static void     verify_fd_close(Verify *verify, guint f);
+static void     verify_lru_unlink(Verify *verify, guint f);
+static void     verify_fd_close_all(Verify *verify);
+#ifdef HAVE_LIBURING
+static gboolean verify_uring_submit(Verify *verify, VerifyRead *read);
+static void     verify_uring_complete(Verify *verify, VerifyRead *read);
+static void     verify_uring_reap(Verify *verify, gboolean wait);
+#endif
+static gpointer verify_worker(gpointer data);
+static void     verify_hash_jobs(Verify *verify, VerifyJob **jobs, guint n);
+static void     verify_piece_done(Verify *verify, guint piece, gboolean valid);
+static void     verify_build_map(Verify *verify);
+static void     verify_load_checkpoint(Verify *verify);
+static void     verify_encode_checkpoint(Verify *verify);
+static void     verify_copy_checkpoint(Verify *verify, gboolean complete);
+static void     verify_write_checkpoint(Verify *verify);
+
+/* GLOBALS ******************************************************************/
+
+static VerifyJob verify_stop_job; /* tell a worker to finish */
+
+/* FUNCTIONS ****************************************************************/
+
+/**
+ * @brief Create a new Verify engine.
+ *
+ * @param hashes: the SHA1 of all the pieces (the "pieces" string).
+ * @param n_pieces: the number of pieces.
+ * @param piece_size: the "piece length".
+ * @return a new allocated Verify, or NULL if piece_size is 0 or bigger
+ *         than VERIFY_MAX_PIECE_SIZE. @see verify_free
+ */
+Verify *
+verify_new(const gchar *hashes, guint n_pieces, gint64 piece_size)
+{
+  Verify *verify;
+
+  if(piece_size <= 0 || piece_size > VERIFY_MAX_PIECE_SIZE)
+    return NULL;
+
+  verify = g_new0(Verify, 1);
+  verify->hashes = g_malloc((gsize)n_pieces*SHA_DIGEST_LENGTH);
+  memcpy(verify->hashes, hashes, (gsize)n_pieces*SHA_DIGEST_LENGTH);
+  verify->n_pieces = n_pieces;
+  verify->piece_size = piece_size;
+  verify->files = g_array_new(FALSE, TRUE, sizeof(VerifyFile));
+  verify->mutex = g_mutex_new();
+  verify->fd_mutex = g_mutex_new();
+  verify->lru_first = verify->lru_last = VERIFY_NONE;
+  verify_set_workers(verify, 0);
+  verify_set_queue_depth(verify, 0);
+
+  return verify;
+}
+
+/**
+ * @brief Free a Verify engine.
+ *
+ * @param verify: the Verify (can be NULL).
+ */
+void
+verify_free(Verify *verify)
+{
+  guint i;
+
+  if(verify == NULL)
+    return;
+
+  for(i = 0; i < verify->files->len; i++)
+    g_free(g_array_index(verify->files, VerifyFile, i).filename);
+
+  g_array_free(verify->files, TRUE);
+  g_free(verify->extents);
+  g_free(verify->first_extent);
+  g_mutex_free(verify->mutex);
+  g_mutex_free(verify->fd_mutex);
+  g_free(verify->checked);
+  g_free(verify->valid);
+  g_free(verify->known);
+  g_free(verify->checkpoint);
+  g_free(verify->hashes);
+  g_free(verify);
+  return;
+}
+
+/**
+ * @brief Append a file of the torrent, in the same order of the metainfo.
+ *
+ * @param verify: the Verify.
+ * @param filename: the file name in the disk.
+ * @param size: the size of the file in the torrent.
+ * @return the index of the file.
+ */
+guint
+verify_add_file(Verify *verify, const gchar *filename, gint64 size)
+{
+  VerifyFile file;
+
+  file.filename = g_strdup(filename);
+  file.size = MAX(size, 0);
+  file.start = verify->total_size;
+  file.remain = file.size;
+  file.error = 0;
+  file.disk_size = -1;
+  file.mtime = 0;
+  file.mtime_nsec = 0;
+  file.inode = 0;
+  file.unchanged = FALSE;
+  file.fd = -1;
+  file.users = 0;
+  file.lru_prev = file.lru_next = VERIFY_NONE;
+
+  verify->total_size += file.size;
+  g_array_append_val(verify->files, file);
+
+  g_free(verify->extents);
+  g_free(verify->first_extent);
+  verify->extents = NULL;
+  verify->first_extent = NULL;
+
+  return verify->files->len - 1;
+}
+
+/**
+ * @brief Set the number of hashing threads. verify_run starts less of
+ *        them if there are few pieces or the pieces are big.
+ *
+ * @param verify: the Verify.
+ * @param n_workers: the number of threads, 0 for one by processor.
+ */
+void
+verify_set_workers(Verify *verify, guint n_workers)
+{
+  if(n_workers == 0)
+    n_workers = g_get_num_processors();
+
+  verify->n_workers = CLAMP(n_workers, 1, VERIFY_MAX_WORKERS);
+  return;
+}
+
+/**
+ * @brief Set the number of reads kept in flight.
+ *
+ * They are io_uring requests when it's available, or pread threads.
+ *
+ * @param verify: the Verify.
+ * @param depth: the queue depth, 0 for VERIFY_DEFAULT_QUEUE_DEPTH.
+ */
+void
+verify_set_queue_depth(Verify *verify, guint depth)
+{
+  if(depth == 0)
+    depth = VERIFY_DEFAULT_QUEUE_DEPTH;
+
+  verify->queue_depth = CLAMP(depth, 1, VERIFY_MAX_QUEUE_DEPTH);
+  return;
+}
+
+/**
+ * @brief Set the checkpoint file of the check.
+ *
+ * The checked pieces and the size and time of the files are saved there
+ * every VERIFY_CHECKPOINT_INTERVAL seconds and at the end. If a check
+ * was interrupted, the next one takes the results of its pieces if
+ * their files didn't change since then.
+ *
+ * @param verify: the Verify.
+ * @param filename: the checkpoint file (NULL for none).
+ *                  @see verify_checkpoint_filename
+ */
+void
+verify_set_checkpoint(Verify *verify, const gchar *filename)
+{
+  g_free(verify->checkpoint);
+  verify->checkpoint = g_strdup(filename);
+  return;
+}
+
+/**
+ * @brief Only rehash the pieces of the files changed since the last check.
+ *
+ * With it the results of the last check in the checkpoint are taken even
+ * if it was complete, so only the pieces with data of files with a new
+ * size or modification time (or inode, if check_inode) are readed.
+ *
+ * @param verify: the Verify.
+ * @param incremental: TRUE for an incremental check.
+ * @param check_inode: TRUE if a file with a new inode was changed (it was
+ *                     replaced by other one).
+ */
+void
+verify_set_incremental(Verify *verify, gboolean incremental,
+                       gboolean check_inode)
+{
+  verify->incremental = incremental;
+  verify->check_inode = check_inode;
+  return;
+}
+
+/**
+ * @brief the checkpoint file of a torrent and its data.
+ *
+ * It's in the user cache folder, named after the info hash and the
+ * data path.
+ *
+ * @param info_hash: the info hash (SHA_DIGEST_LENGTH bytes).
+ * @param path: the file or folder with the torrent data.
+ * @return a new allocated string.
+ */
+gchar *
+verify_checkpoint_filename(const guint8 *info_hash, const gchar *path)
+{
+  guint8 path_hash[SHA_DIGEST_LENGTH];
+  gchar name[2*SHA_DIGEST_LENGTH + 1 + 8 + sizeof(".checkpoint")];
+  guint i;
+
+  SHA1((guint8*)path, strlen(path), path_hash);
+
+  for(i = 0; i < SHA_DIGEST_LENGTH; i++)
+    g_snprintf(name + 2*i, 3, "%02x", info_hash[i]);
+  g_snprintf(name + 2*SHA_DIGEST_LENGTH, sizeof(name) - 2*SHA_DIGEST_LENGTH,
+             "-%02x%02x%02x%02x.checkpoint",
+             path_hash[0], path_hash[1], path_hash[2], path_hash[3]);
+
+  return g_build_filename(g_get_user_cache_dir(), PACKAGE, name, NULL);
+}
+
+/**
+ * @brief Check all the pieces.
+ *
+ * The calling thread queues the reads of the pieces (queue_depth of them
+ * in flight), the workers hash the pieces as they are readed. It returns when all the pieces were checked or it was canceled.
+ *
+ * @param verify: the Verify.
+ * @param func: function called for each checked piece (can be NULL).
+ * @param user_data: data passed to func.
+ * @return FALSE if it was canceled, or the threads or the pieces buffers
+ *         couldn't be created.
+ */
+gboolean
+verify_run(Verify *verify, VerifyFunc func, gpointer user_data)
+{
+  GThread **workers, **readers;
+  VerifyJob *jobs;
+  gpointer buffer;
+  guint i, n_jobs, n_started, n_readers;
+
+  verify_build_map(verify);
+  verify_stat_files(verify);
+
+  g_free(verify->checked);
+  g_free(verify->valid);
+  verify->checked = g_new0(guint8, verify->n_pieces/8 + 1);
+  verify->valid = g_new0(guint8, verify->n_pieces/8 + 1);
+  verify_load_checkpoint(verify);
+  verify_encode_checkpoint(verify);
+  verify->save_timer = g_timer_new();
+
+  verify->func = func;
+  verify->user_data = user_data;
+  verify->free_jobs = g_async_queue_new();
+  verify->full_jobs = g_async_queue_new();
+  verify->read_jobs = g_async_queue_new();
+
+  n_jobs = verify_count_jobs(verify);
+  jobs = g_new0(VerifyJob, n_jobs);
+  for(i = 0; i < n_jobs; i++)
+  {
+    /* aligned for the disk and the SIMD loads */
+    if(posix_memalign(&buffer, VERIFY_BUFFER_ALIGN, (size_t)verify->piece_size) != 0)
+      break;
+    jobs[i].data = (gchar*)buffer;
+    g_async_queue_push(verify->free_jobs, &jobs[i]);
+  }
+
+  /* without memory for all, it runs if a worker and a read have a buffer */
+  if(i < n_jobs)
+  {
+    g_warning("%s: only %u of %u pieces buffers of %" G_GINT64_FORMAT " bytes were allocated",
+              G_STRLOC, i, n_jobs, verify->piece_size);
+    if(i < MIN(verify->n_workers + 1, n_jobs))
+      verify_cancel(verify);
+    n_jobs = i;
+  }
+
+  n_readers = 0;
+  n_started = 0;
+  readers = g_new0(GThread*, verify->queue_depth);
+  workers = g_new0(GThread*, verify->n_workers);
+#ifdef HAVE_LIBURING
+  verify->in_flight = 0;
+  verify->use_uring = FALSE;
+#endif
+
+  if(!g_atomic_int_get(&verify->cancel))
+  {
+    /* io_uring if it's there, else threads doing pread */
+#ifdef HAVE_LIBURING
+    verify->use_uring = (io_uring_queue_init(verify->queue_depth, &verify->ring, 0) == 0);
+    if(!verify->use_uring)
+#endif
+    for(n_readers = 0; n_readers < verify->queue_depth; n_readers++)
+    {
+      readers[n_readers] = g_thread_create(verify_reader, verify, TRUE, NULL);
+      if(readers[n_readers] == NULL)
+        break;
+    }
+
+    for(n_started = 0; n_started < verify->n_workers; n_started++)
+    {
+      workers[n_started] = g_thread_create(verify_worker, verify, TRUE, NULL);
+      if(workers[n_started] == NULL)
+        break;
+    }
+  }
+
+  if(n_started > 0 && (n_readers > 0
+#ifdef HAVE_LIBURING
+                        || verify->use_uring
+#endif
+                       ))
+    verify_read_pieces(verify);
+  else
+    verify_cancel(verify);
+
+  /* the readers push all their pieces before to stop */
+  for(i = 0; i < n_readers; i++)
+    g_async_queue_push(verify->read_jobs, &verify_stop_job);
+
+  for(i = 0; i < n_readers; i++)
+    g_thread_join(readers[i]);
+
+#ifdef HAVE_LIBURING
+  if(verify->use_uring)
+    io_uring_queue_exit(&verify->ring);
+#endif
+
+  for(i = 0; i < n_started; i++)
+    g_async_queue_push(verify->full_jobs, &verify_stop_job);
+
+  for(i = 0; i < n_started; i++)
+    g_thread_join(workers[i]);
+
+  verify_fd_close_all(verify);
+
+  /* a check that didn't start keeps the last checkpoint */
+  if(n_started > 0 && verify->save_data != NULL)
+  {
+    verify_copy_checkpoint(verify, !g_atomic_int_get(&verify->cancel));
+    verify_write_checkpoint(verify);
+  }
+  g_free(verify->save_data);
+  verify->save_data = NULL;
+  g_timer_destroy(verify->save_timer);
+  verify->save_timer = NULL;
+
+  for(i = 0; i < n_jobs; i++)
+  {
+    free(jobs[i].data);
+    g_free(jobs[i].reads);
+  }
+
+  g_free(jobs);
+  g_free(workers);
+  g_free(readers);
+  g_async_queue_unref(verify->free_jobs);
+  g_async_queue_unref(verify->full_jobs);
+  g_async_queue_unref(verify->read_jobs);
+
+  return !g_atomic_int_get(&verify->cancel);
+}
+
+/**
+ * @brief The number of pieces buffers of verify_run, they never take more
+ *        than VERIFY_MAX_BUFFERS_SIZE (but for a worker and a read when
+ *        the pieces are bigger than half of it).
+ *
+ * If there isn't room for a batch of lanes in each worker, the lanes
+ * are lowered first and then the workers. There are never more workers
+ * nor buffers than pieces.
+ *
+ * DON'T USE DIRECTLY, it's a helper of verify_run.
+ *
+ * @param verify: the Verify.
+ * @return the number of buffers.
+ */
+static guint
+verify_count_jobs(Verify *verify)
+{
+  gint64 max_jobs;
+  guint n_pieces, n_jobs;
+
+  n_pieces = MAX(verify->n_pieces, 1);
+  max_jobs = MAX(VERIFY_MAX_BUFFERS_SIZE/MAX(verify->piece_size, 1), 2);
+
+  verify->n_workers = MIN(verify->n_workers, n_pieces);
+  verify->lanes = sha1_multi_lanes();
+
+  /* a batch of lanes in each worker, and a read */
+  while(verify->n_workers*(VERIFY_BUFFERS_PER_WORKER + verify->lanes - 1) + 1 > max_jobs)
+  {
+    if(verify->lanes > 1)
+      verify->lanes--;
+    else if(verify->n_workers > 1)
+      verify->n_workers--;
+    else
+      break;
+  }
+
+  /* the others reads in flight if there is room */
+  n_jobs = verify->n_workers*(VERIFY_BUFFERS_PER_WORKER + verify->lanes - 1) +
+           verify->queue_depth;
+  n_jobs = (guint)MIN(n_jobs, max_jobs);
+
+  return MIN(n_jobs, n_pieces);
+}
+
+/**
+ * @brief Stop verify_run as soon as possible. It can be called from
+ *        any thread (and from a VerifyFunc).
+ *
+ * @param verify: the Verify.
+ */
+void
+verify_cancel(Verify *verify)
+{
+  g_atomic_int_set(&verify->cancel, TRUE);
+  return;
+}
+
+/**
+ * @brief the number of files.
+ *
+ * @param verify: the Verify.
+ * @return the number of files added.
+ */
+guint
+verify_get_n_files(Verify *verify)
+{
+  return verify->files->len;
+}
+
+/**
+ * @brief the name of a file.
+ *
+ * @param verify: the Verify.
+ * @param file: the file index.
+ * @return the file name (don't free it).
+ */
+const gchar *
+verify_file_name(Verify *verify, guint file)
+{
+  return g_array_index(verify->files, VerifyFile, file).filename;
+}
+
+/**
+ * @brief the number of pieces taken from the checkpoint (not readed).
+ *
+ * @param verify: the Verify.
+ * @return the number of pieces.
+ */
+guint
+verify_get_n_resumed(Verify *verify)
+{
+  return verify->n_resumed;
+}
+
+/**
+ * @brief the size of a file in the torrent.
+ *
+ * @param verify: the Verify.
+ * @param file: the file index.
+ * @return the size in bytes.
+ */
+gint64
+verify_file_size(Verify *verify, guint file)
+{
+  return g_array_index(verify->files, VerifyFile, file).size;
+}
+
+/**
+ * @brief the bytes of a file that aren't verified yet.
+ *
+ * @param verify: the Verify.
+ * @param file: the file index.
+ * @return the number of bytes.
+ */
+gint64
+verify_file_remain(Verify *verify, guint file)
+{
+  return g_array_index(verify->files, VerifyFile, file).remain;
+}
+
+/**
+ * @brief the error found reading a file.
+ *
+ * @param verify: the Verify.
+ * @param file: the file index.
+ * @return 0 if no error, VERIFY_FILE_SHORT if the file is smaller than
+ *         it should be, or the errno of the failed open/read.
+ */
+gint
+verify_file_error(Verify *verify, guint file)
+{
+  return g_array_index(verify->files, VerifyFile, file).error;
+}
+
+/**
+ * @brief The reader stage: queue the reads of the pieces in order.
+ *
+ * The pieces with data of a missing or short file are marked as broken.
+ *
+ * @param verify: the Verify.
+ */
+static void
+verify_read_pieces(Verify *verify)
+{
+  VerifyJob *job;
+  guint piece;
+
+  for(piece = 0; piece < verify->n_pieces; piece++)
+  {
+    if(g_atomic_int_get(&verify->cancel))
+      break;
+
+    if(verify->known != NULL && VERIFY_BIT(verify->known, piece))
+    {
+      verify_piece_done(verify, piece, VERIFY_BIT(verify->valid, piece) != 0);
+      continue;
+    }
+
+    job = verify_get_job(verify);
+    verify_plan_job(verify, job, piece);
+    verify_submit_job(verify, job);
+  }
+
+#ifdef HAVE_LIBURING
+  while(verify->use_uring && verify->in_flight > 0)
+    verify_uring_reap(verify, TRUE);
+#endif
+
+  return;
+}
+
+/**
+ * @brief Make the list of reads of a piece, one for each extent.
+ *
+ * The extents in files with errors, or after the end of the file in the
+ * disk, are not readed: the piece is broken.
+ *
+ * DON'T USE DIRECTLY, it's a helper of verify_read_pieces.
+ *
+ * @param verify: the Verify.
+ * @param job: a free job.
+ * @param piece: the piece index.
+ */
+static void
+verify_plan_job(Verify *verify, VerifyJob *job, guint piece)
+{
+  VerifyExtent *extent;
+  VerifyFile *file;
+  VerifyRead *read;
+  guint e, n_extents;
+
+  n_extents = verify->first_extent[piece+1] - verify->first_extent[piece];
+
+  job->piece = piece;
+  job->length = 0;
+  job->broken = (n_extents == 0);  /* more pieces than data */
+  job->n_reads = 0;
+
+  if(n_extents > job->max_reads)
+  {
+    job->max_reads = n_extents;
+    job->reads = g_renew(VerifyRead, job->reads, job->max_reads);
+  }
+
+  for(e = verify->first_extent[piece]; e < verify->first_extent[piece+1]; e++)
+  {
+    extent = &verify->extents[e];
+    file = &g_array_index(verify->files, VerifyFile, extent->file);
+
+    if(extent->offset + extent->length > file->disk_size)
+      g_atomic_int_compare_and_exchange(&file->error, 0, VERIFY_FILE_SHORT);
+
+    if(g_atomic_int_get(&file->error) == 0)
+    {
+      read = &job->reads[job->n_reads++];
+      read->job = job;
+      read->file = extent->file;
+      read->fd = -1;
+      read->offset = extent->offset;
+      read->start = job->length;
+      read->length = extent->length;
+    }
+    else
+      job->broken = TRUE;
+
+    job->length += extent->length;
+  }
+
+  return;
+}
+
+/**
+ * @brief Build the extents of all the pieces (once, they are kept until
+ *        a file is added).
+ *
+ * @param verify: the Verify.
+ */
+static void
+verify_build_map(Verify *verify)
+{
+  VerifyFile *file;
+  gint64 start, end, from, to;
+  guint piece, f, n;
+
+  if(verify->first_extent != NULL)
+    return;
+
+  /* a piece has an extent in each file it crosses, plus a new one for
+     each boundary, so the total is at most n_pieces + files */
+  verify->extents = g_new(VerifyExtent, (gsize)verify->n_pieces + verify->files->len);
+  verify->first_extent = g_new(guint, (gsize)verify->n_pieces + 1);
+
+  for(piece = 0, f = 0, n = 0; piece < verify->n_pieces; piece++)
+  {
+    verify->first_extent[piece] = n;
+
+    start = (gint64)piece*verify->piece_size;
+    end = MIN(start + verify->piece_size, verify->total_size);
+
+    for(; f < verify->files->len && start < end; f++)
+    {
+      file = &g_array_index(verify->files, VerifyFile, f);
+
+      from = MAX(start, file->start);
+      to = MIN(end, file->start + file->size);
+      if(from < to)
+      {
+        verify->extents[n].file = f;
+        verify->extents[n].offset = from - file->start;
+        verify->extents[n].length = (guint)(to - from);
+        n++;
+      }
+
+      /* the file goes on in the next piece */
+      if(file->start + file->size > end)
+        break;
+    }
+  }
+
+  verify->first_extent[verify->n_pieces] = n;
+  return;
+}
+
+/**
+ * @brief Get a free job, waiting for one if needed.
+ *
+ * DON'T USE DIRECTLY, it's a helper of verify_read_pieces.
+ *
+ * @param verify: the Verify.
+ * @return the job.
+ */
+static VerifyJob *
+verify_get_job(Verify *verify)
+{
+#ifdef HAVE_LIBURING
+  VerifyJob *job;
+
+  /* the buffers can be waiting in the ring, so reap while there's none */
+  while(verify->use_uring && verify->in_flight > 0)
+  {
+    if((job = (VerifyJob*)g_async_queue_try_pop(verify->free_jobs)) != NULL)
+      return job;
+
+    verify_uring_reap(verify, TRUE);
+  }
+#endif
+
+  return (VerifyJob*)g_async_queue_pop(verify->free_jobs);
+}
+
+/**
+ * @brief Start the reads of a piece, or give it to the workers if there
+ *        is nothing to read.
+ *
+ * DON'T USE DIRECTLY, it's a helper of verify_read_pieces.
+ *
+ * @param verify: the Verify.
+ * @param job: the planned job.
+ */
+static void
+verify_submit_job(Verify *verify, VerifyJob *job)
+{
+#ifdef HAVE_LIBURING
+  VerifyRead *read;
+  guint i;
+#endif
+
+  if(job->broken || job->n_reads == 0)
+  {
+    g_async_queue_push(verify->full_jobs, job);
+    return;
+  }
+
+#ifdef HAVE_LIBURING
+  if(verify->use_uring)
+  {
+    job->pending = job->n_reads;
+    for(i = 0; i < job->n_reads; i++)
+    {
+      read = &job->reads[i];
+
+      while(verify->in_flight >= verify->queue_depth)
+        verify_uring_reap(verify, TRUE);
+
+      if(job->broken || g_atomic_int_get(&verify->cancel) ||
+         (read->fd = verify_fd_acquire(verify, read->file)) < 0)
+      {
+        job->broken = TRUE;
+        verify_uring_complete(verify, read);
+        continue;
+      }
+
+      while(!verify_uring_submit(verify, read))
+        verify_uring_reap(verify, TRUE);
+    }
+    return;
+  }
+#endif
+
+  g_async_queue_push(verify->read_jobs, job);
+  return;
+}
+
+/**
+ * @brief A pread thread: read the pieces queued by verify_read_pieces.
+ *
+ * @param data: the Verify.
+ * @return NULL.
+ */
+static gpointer
+verify_reader(gpointer data)
+{
+  Verify *verify = (Verify*)data;
+  VerifyJob *job;
+
+  while((job = (VerifyJob*)g_async_queue_pop(verify->read_jobs)) != &verify_stop_job)
+    verify_read_job(verify, job);
+
+  return NULL;
+}
+
+/**
+ * @brief Read all the data of a piece with pread, and give it to the
+ *        workers.
+ *
+ * @param verify: the Verify.
+ * @param job: the job.
+ */
+static void
+verify_read_job(Verify *verify, VerifyJob *job)
+{
+  VerifyRead *read;
+  ssize_t readed;
+  guint i;
+
+  for(i = 0; i < job->n_reads; i++)
+  {
+    read = &job->reads[i];
+
+    if(g_atomic_int_get(&job->broken) || g_atomic_int_get(&verify->cancel))
+      break;
+
+    if((read->fd = verify_fd_acquire(verify, read->file)) < 0)
+    {
+      g_atomic_int_set(&job->broken, TRUE);
+      break;
+    }
+
+    while(read->length > 0)
+    {
+      readed = pread(read->fd, job->data + read->start, read->length, read->offset);
+      if(readed < 0 && errno == EINTR)
+        continue;
+
+      if(readed <= 0)
+      {
+        verify_read_failed(verify, read, (readed == 0)? VERIFY_FILE_SHORT :
+                                         ((errno != 0)? errno : EIO));
+        break;
+      }
+
+      read->offset += readed;
+      read->start += (guint)readed;
+      read->length -= (guint)readed;
+    }
+
+    verify_fd_release(verify, read->file);
+    read->fd = -1;
+  }
+
+  g_async_queue_push(verify->full_jobs, job);
+  return;
+}
+
+/**
+ * @brief Save the error of a read, its piece is broken.
+ *
+ * @param verify: the Verify.
+ * @param read: the failed read.
+ * @param error: errno or VERIFY_FILE_SHORT.
+ */
+static void
+verify_read_failed(Verify *verify, VerifyRead *read, gint error)
+{
+  VerifyFile *file;
+
+  file = &g_array_index(verify->files, VerifyFile, read->file);
+  g_atomic_int_compare_and_exchange(&file->error, 0, error);
+  g_atomic_int_set(&read->job->broken, TRUE);
+
+  return;
+}
+
+/**
+ * @brief Check that the files are in the disk, and get their size,
+ *        before any read. The empty files too: they aren't readed, but
+ *        a missing one is an error.
+ *
+ * @param verify: the Verify.
+ */
+static void
+verify_stat_files(Verify *verify)
+{
+  VerifyFile *file;
+  struct stat st;
+  struct rlimit limit;
+  guint i;
+
+  for(i = 0; i < verify->files->len; i++)
+  {
+    file = &g_array_index(verify->files, VerifyFile, i);
+    if(file->error != 0)
+      continue;
+
+    if(stat(file->filename, &st) != 0)
+      file->error = (errno != 0)? errno : EIO;
+    else if(S_ISDIR(st.st_mode))
+      file->error = EISDIR;
+    else
+    {
+      file->disk_size = st.st_size;
+      file->mtime = st.st_mtime;
+#if defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200809L /* has st_mtim */
+      file->mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+      file->inode = st.st_ino;
+    }
+  }
+
+  /* the open files cache gets half of the descriptors */
+  verify->max_open = VERIFY_MAX_OPEN_FILES;
+  if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+    verify->max_open = CLAMP(limit.rlim_cur/2, VERIFY_MIN_OPEN_FILES,
+                             VERIFY_MAX_OPEN_FILES);
+
+  return;
+}
+
+/**
+ * @brief Get the descriptor of a file from the open files cache, it's
+ *        opened if needed (closing the least recently used files when
+ *        there are too many open). @see verify_fd_release
+ *
+ * @param verify: the Verify.
+ * @param f: the file index.
+ * @return the descriptor, or -1 if the file can't be opened (the file
+ *         error is set).
+ */
+static gint
+verify_fd_acquire(Verify *verify, guint f)
+{
+  VerifyFile *file;
+  gint fd, error;
+
+  file = &g_array_index(verify->files, VerifyFile, f);
+
+  g_mutex_lock(verify->fd_mutex);
+
+  if(file->fd >= 0)
+  {
+    if(file->users++ == 0)
+      verify_lru_unlink(verify, f);  /* it isn't idle now */
+
+    fd = file->fd;
+    g_mutex_unlock(verify->fd_mutex);
+    return fd;
+  }
+
+  /* a short file can be read up to its end, the planner (ahead of the
+     readers) can mark it short before */
+  error = g_atomic_int_get(&file->error);
+  if(error != 0 && error != VERIFY_FILE_SHORT)
+  {
+    g_mutex_unlock(verify->fd_mutex);
+    return -1;
+  }
+
+  while(verify->n_open >= verify->max_open && verify->lru_first != VERIFY_NONE)
+    verify_fd_close(verify, verify->lru_first);
+
+  /* open it unlocked, the other readers go on meanwhile */
+  verify->n_open++;
+  g_mutex_unlock(verify->fd_mutex);
+
+  fd = open(file->filename, O_RDONLY);
+  if(fd < 0)
+    g_atomic_int_compare_and_exchange(&file->error, 0, (errno != 0)? errno : EIO);
+#ifdef POSIX_FADV_SEQUENTIAL
+  else
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  g_mutex_lock(verify->fd_mutex);
+
+  if(fd < 0 || file->fd >= 0)
+  {
+    /* failed, or another reader opened it first */
+    if(fd >= 0)
+      close(fd);
+    verify->n_open--;
+    fd = file->fd;
+  }
+  else
+    file->fd = fd;
+
+  if(fd >= 0)
+    file->users++;
+
+  g_mutex_unlock(verify->fd_mutex);
+  return fd;
+}
+
+/**
+ * @brief Give back a descriptor got with verify_fd_acquire, the file is
+ *        kept open (idle) while there is room in the cache.
+ *
+ * @param verify: the Verify.
+ * @param f: the file index.
+ */
+static void
+verify_fd_release(Verify *verify, guint f)
+{
+  VerifyFile *file;
+
+  file = &g_array_index(verify->files, VerifyFile, f);
+
+  g_mutex_lock(verify->fd_mutex);
+
+  if(--file->users == 0)
+  {
+    if(verify->n_open > verify->max_open)
+    {
+      close(file->fd);
+      file->fd = -1;
+      verify->n_open--;
+    }
+    else
+    {
+      /* the most recently used goes to the end */
+      file->lru_prev = verify->lru_last;
+      file->lru_next = VERIFY_NONE;
+      if(verify->lru_last != VERIFY_NONE)
+        g_array_index(verify->files, VerifyFile, verify->lru_last).lru_next = f;
+      else
+        verify->lru_first = f;
+      verify->lru_last = f;
+    }
+  }
+
+  g_mutex_unlock(verify->fd_mutex);
+  return;
+}
+
+/**
+ * @brief Close an idle file of the cache. fd_mutex must be locked.
+ *
+ * @param verify: the Verify.
+ * @param f: the file index.
+ */
+static void
+verify_fd_close(Verify *verify, guint f)
+{
+  VerifyFile *file;
+
+  file = &g_array_index(verify->files, VerifyFile, f);
+
+  verify_lru_unlink(verify, f);
+  close(file->fd);
+  file->fd = -1;
+  verify->n_open--;
+
+  return;
+}
+
+/**
+ * @brief Take an idle file out of the least recently used list.
+ *        fd_mutex must be locked.
+ *
+ * @param verify: the Verify.
+ * @param f: the file index.
+ */
+static void
+verify_lru_unlink(Verify *verify, guint f)
+{
+  VerifyFile *file;
+
+  file = &g_array_index(verify->files, VerifyFile, f);
+
+  if(file->lru_prev != VERIFY_NONE)
+    g_array_index(verify->files, VerifyFile, file->lru_prev).lru_next = file->lru_next;
+  else
+    verify->lru_first = file->lru_next;
+
+  if(file->lru_next != VERIFY_NONE)
+    g_array_index(verify->files, VerifyFile, file->lru_next).lru_prev = file->lru_prev;
+  else
+    verify->lru_last = file->lru_prev;
+
+  file->lru_prev = file->lru_next = VERIFY_NONE;
+
+  return;
+}
+
+/**
+ * @brief Close all the files of the cache (they must be idle).
+ *
+ * @param verify: the Verify.
+ */
+static void
+verify_fd_close_all(Verify *verify)
+{
+  g_mutex_lock(verify->fd_mutex);
+
+  while(verify->lru_first != VERIFY_NONE)
+    verify_fd_close(verify, verify->lru_first);
+
+  g_mutex_unlock(verify->fd_mutex);
+  return;
+}
+
+#ifdef HAVE_LIBURING
+
+/**
+ * @brief Queue the (rest of a) read in the ring.
+ *
+ * @param verify: the Verify.
+ * @param read: the read.
+ * @return FALSE if the ring is full.
+ */
+static gboolean
+verify_uring_submit(Verify *verify, VerifyRead *read)
+{
+  struct io_uring_sqe *sqe;
+
+  if((sqe = io_uring_get_sqe(&verify->ring)) == NULL)
+  {
+    io_uring_submit(&verify->ring);
+    if((sqe = io_uring_get_sqe(&verify->ring)) == NULL)
+      return FALSE;
+  }
+
+  io_uring_prep_read(sqe, read->fd, read->job->data + read->start, read->length, read->offset);
+  io_uring_sqe_set_data(sqe, read);
+  io_uring_submit(&verify->ring);
+  verify->in_flight++;
+
+  return TRUE;
+}
+
+/**
+ * @brief Handle the completed reads of the ring. A piece goes to the
+ *        workers when all its reads are done.
+ *
+ * @param verify: the Verify.
+ * @param wait: TRUE to wait for a completion if there is none.
+ */
+static void
+verify_uring_reap(Verify *verify, gboolean wait)
+{
+  struct io_uring_cqe *cqe;
+  VerifyRead *read;
+  gint res;
+
+  if(wait)
+  {
+    if(io_uring_wait_cqe(&verify->ring, &cqe) != 0)
+      cqe = NULL;
+  }
+  else if(io_uring_peek_cqe(&verify->ring, &cqe) != 0)
+    cqe = NULL;
+
+  for(; cqe != NULL; cqe = (io_uring_peek_cqe(&verify->ring, &cqe) == 0)? cqe : NULL)
+  {
+    read = (VerifyRead*)io_uring_cqe_get_data(cqe);
+    res = cqe->res;
+    io_uring_cqe_seen(&verify->ring, cqe);
+    verify->in_flight--;
+
+    if(res > 0)
+    {
+      read->offset += res;
+      read->start += (guint)res;
+      read->length -= (guint)res;
+    }
+    else if(res != -EINTR && res != -EAGAIN)  /* else try again */
+      verify_read_failed(verify, read, (res == 0)? VERIFY_FILE_SHORT : -res);
+
+    /* short reads go on with the rest */
+    if(read->length > 0 && !read->job->broken && !g_atomic_int_get(&verify->cancel))
+    {
+      if(verify_uring_submit(verify, read))
+        continue;
+      verify_read_failed(verify, read, EIO);
+    }
+
+    verify_uring_complete(verify, read);
+  }
+
+  return;
+}
+
+/**
+ * @brief A read of the ring is done (or it was not started): give back
+ *        its file, and the piece to the workers if it was the last read.
+ *
+ * @param verify: the Verify.
+ * @param read: the read.
+ */
+static void
+verify_uring_complete(Verify *verify, VerifyRead *read)
+{
+  if(read->fd >= 0)
+    verify_fd_release(verify, read->file);
+  read->fd = -1;
+
+  if(g_atomic_int_dec_and_test(&read->job->pending))
+    g_async_queue_push(verify->full_jobs, read->job);
+
+  return;
+}
+
+#endif /* HAVE_LIBURING */
+
+/**
+ * @brief Take the results of an interrupted check from the checkpoint.
+ *
+ * The checkpoint is used if it's of the same pieces and files, and it
+ * was not complete (or it's an incremental check). A piece checked there
+ * is known now if all its files have the same size and modification time
+ * (and inode, if check_inode).
+ *
+ * The checkpoint is: VERIFY_CHECKPOINT_MAGIC, the number of pieces and
+ * of files (32 bits), the piece size (64 bits), a complete flag (32 bits),
+ * for each file its size, its size, time and time nanoseconds in the
+ * disk, and its inode (64 bits each), and the checked and valid pieces
+ * bitmaps. All little endian.
+ *
+ * @param verify: the Verify.
+ */
+static void
+verify_load_checkpoint(Verify *verify)
+{
+  VerifyFile *file;
+  gchar *contents, *ptr;
+  gsize length, bitmap;
+  guint32 word[3];
+  guint64 value[5];
+  guint piece, f, e, j;
+  gboolean unchanged;
+
+  g_free(verify->known);
+  verify->known = NULL;
+  verify->n_resumed = 0;
+
+  if(verify->checkpoint == NULL ||
+     !g_file_get_contents(verify->checkpoint, &contents, &length, NULL))
+    return;
+
+  bitmap = verify->n_pieces/8 + 1;
+  ptr = contents;
+
+  if(length != 28 + verify->files->len*5*8 + 2*bitmap ||
+     memcmp(ptr, VERIFY_CHECKPOINT_MAGIC, 8) != 0)
+  {
+    g_free(contents);
+    return;
+  }
+
+  memcpy(&word[0], ptr + 8, 4);
+  memcpy(&word[1], ptr + 12, 4);
+  memcpy(&value[0], ptr + 16, 8);
+  memcpy(&word[2], ptr + 24, 4);
+  ptr += 28;
+
+  /* complete checks are only resumed by incremental checks */
+  if(GUINT32_FROM_LE(word[0]) != verify->n_pieces ||
+     GUINT32_FROM_LE(word[1]) != verify->files->len ||
+     (gint64)GUINT64_FROM_LE(value[0]) != verify->piece_size ||
+     (GUINT32_FROM_LE(word[2]) != 0 && !verify->incremental))
+  {
+    g_free(contents);
+    return;
+  }
+
+  for(f = 0; f < verify->files->len; f++, ptr += 5*8)
+  {
+    file = &g_array_index(verify->files, VerifyFile, f);
+    memcpy(value, ptr, 5*8);
+    for(j = 0; j < 5; j++)
+      value[j] = GUINT64_FROM_LE(value[j]);
+
+    file->unchanged = ((gint64)value[0] == file->size &&
+                       (gint64)value[1] == file->disk_size &&
+                       (gint64)value[2] == file->mtime &&
+                       (gint64)value[3] == file->mtime_nsec &&
+                       (!verify->check_inode || value[4] == file->inode));
+  }
+
+  verify->known = g_new0(guint8, bitmap);
+
+  for(piece = 0; piece < verify->n_pieces; piece++)
+  {
+    if(!VERIFY_BIT((guint8*)ptr, piece))
+      continue;
+
+    unchanged = TRUE;
+    for(e = verify->first_extent[piece]; unchanged && e < verify->first_extent[piece+1]; e++)
+      unchanged = g_array_index(verify->files, VerifyFile, verify->extents[e].file).unchanged;
+
+    if(unchanged)
+    {
+      VERIFY_SET_BIT(verify->known, piece);
+      if(VERIFY_BIT((guint8*)ptr + bitmap, piece))
+        VERIFY_SET_BIT(verify->valid, piece);
+      verify->n_resumed++;
+    }
+  }
+
+  g_free(contents);
+  return;
+}
+
+/**
+ * @brief Make the checkpoint to save, @see verify_load_checkpoint. The
+ *        files don't change while checking, so only the bitmaps are
+ *        copied later (verify_copy_checkpoint).
+ *
+ * @param verify: the Verify.
+ */
+static void
+verify_encode_checkpoint(Verify *verify)
+{
+  VerifyFile *file;
+  gchar *ptr;
+  guint32 word;
+  guint64 value[5];
+  guint f, j;
+
+  g_free(verify->save_data);
+  verify->save_data = NULL;
+  verify->saving = FALSE;
+
+  if(verify->checkpoint == NULL)
+    return;
+
+  verify->save_length = 28 + verify->files->len*5*8 + 2*(verify->n_pieces/8 + 1);
+  ptr = verify->save_data = g_malloc0(verify->save_length);
+
+  memcpy(ptr, VERIFY_CHECKPOINT_MAGIC, 8);
+  word = GUINT32_TO_LE(verify->n_pieces);
+  memcpy(ptr + 8, &word, 4);
+  word = GUINT32_TO_LE(verify->files->len);
+  memcpy(ptr + 12, &word, 4);
+  value[0] = GUINT64_TO_LE((guint64)verify->piece_size);
+  memcpy(ptr + 16, &value[0], 8);
+  ptr += 28;
+
+  for(f = 0; f < verify->files->len; f++, ptr += 5*8)
+  {
+    file = &g_array_index(verify->files, VerifyFile, f);
+    value[0] = (guint64)file->size;
+    value[1] = (guint64)file->disk_size;
+    value[2] = (guint64)file->mtime;
+    value[3] = (guint64)file->mtime_nsec;
+    value[4] = file->inode;
+    for(j = 0; j < 5; j++)
+      value[j] = GUINT64_TO_LE(value[j]);
+    memcpy(ptr, value, 5*8);
+  }
+
+  return;
+}
+
+/**
+ * @brief Copy the checked pieces to the checkpoint to save. It's called
+ *        with the mutex locked, or when the threads are done.
+ *
+ * @param verify: the Verify.
+ * @param complete: TRUE if all the pieces were checked.
+ */
+static void
+verify_copy_checkpoint(Verify *verify, gboolean complete)
+{
+  gsize bitmap;
+  guint32 word;
+
+  bitmap = verify->n_pieces/8 + 1;
+
+  word = GUINT32_TO_LE(complete? 1 : 0);
+  memcpy(verify->save_data + 24, &word, 4);
+  memcpy(verify->save_data + verify->save_length - 2*bitmap, verify->checked, bitmap);
+  memcpy(verify->save_data + verify->save_length - bitmap, verify->valid, bitmap);
+
+  return;
+}
+
+/**
+ * @brief Write the checkpoint copied by verify_copy_checkpoint. It's
+ *        called without the mutex (the write can wait for the disk), by
+ *        the thread that set saving, or when the threads are done.
+ *
+ * @param verify: the Verify.
+ */
+static void
+verify_write_checkpoint(Verify *verify)
+{
+  gchar *folder;
+
+  folder = g_path_get_dirname(verify->checkpoint);
+  g_mkdir_with_parents(folder, 0700);
+  g_file_set_contents(verify->checkpoint, verify->save_data, verify->save_length, NULL);
+
+  g_free(folder);
+  return;
+}
+
+/**
+ * @brief A worker thread: hash and compare the pieces readed.
+ *
+ * When several pieces are waiting, up to verify->lanes of them (see
+ * verify_count_jobs) are taken and hashed together.
+ *
+ * @param data: the Verify.
+ * @return NULL.
+ */
+static gpointer
+verify_worker(gpointer data)
+{
+  Verify *verify = (Verify*)data;
+  VerifyJob *jobs[SHA1_MULTI_LANES];
+  gboolean stop;
+  guint i, n;
+
+  for(stop = FALSE; !stop; )
+  {
+    jobs[0] = (VerifyJob*)g_async_queue_pop(verify->full_jobs);
+    if(jobs[0] == &verify_stop_job)
+      break;
+
+    for(n = 1; n < verify->lanes; n++)
+    {
+      jobs[n] = (VerifyJob*)g_async_queue_try_pop(verify->full_jobs);
+      if(jobs[n] == NULL)
+        break;
+      if(jobs[n] == &verify_stop_job)
+      {
+        stop = TRUE;
+        break;
+      }
+    }
+
+    if(!g_atomic_int_get(&verify->cancel))
+      verify_hash_jobs(verify, jobs, n);
+
+    for(i = 0; i < n; i++)
+      g_async_queue_push(verify->free_jobs, jobs[i]);
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Hash and compare some pieces, and save the results.
+ *
+ * The pieces with the length of the first good one are hashed together
+ * with sha1_multi_*, the others (the last piece, the broken) alone.
+ *
+ * @param verify: the Verify.
+ * @param jobs: the pieces.
+ * @param n: the number of pieces (up to SHA1_MULTI_LANES).
+ */
+static void
+verify_hash_jobs(Verify *verify, VerifyJob **jobs, guint n)
+{
+  sha1_multi_context ctx;
+  guint8 sha[SHA1_MULTI_LANES][SHA_DIGEST_LENGTH];
+  guint8 *input[SHA1_MULTI_LANES], *digest[SHA1_MULTI_LANES];
+  gboolean valid;
+  guint i, lanes, length;
+
+  for(i = 0, lanes = 0, length = 0; i < n; i++)
+  {
+    if(jobs[i]->broken)
+      continue;
+
+    if(lanes == 0)
+      length = jobs[i]->length;
+
+    if(jobs[i]->length == length)
+    {
+      input[lanes] = (guint8*)jobs[i]->data;
+      digest[lanes] = sha[i];
+      lanes++;
+    }
+    else
+      SHA1((guint8*)jobs[i]->data, jobs[i]->length, sha[i]);
+  }
+
+  if(lanes > 1)
+  {
+    sha1_multi_starts(&ctx, lanes);
+    sha1_multi_update(&ctx, input, length);
+    sha1_multi_finish(&ctx, digest);
+  }
+  else if(lanes == 1)
+    SHA1(input[0], length, digest[0]);
+
+  for(i = 0; i < n; i++)
+  {
+    valid = FALSE;
+    if(!jobs[i]->broken)
+      valid = (memcmp(sha[i], verify->hashes+(gsize)jobs[i]->piece*SHA_DIGEST_LENGTH,
+                      SHA_DIGEST_LENGTH) == 0);
+
+    verify_piece_done(verify, jobs[i]->piece, valid);
+  }
+
+  return;
+}
+
+/**
+ * @brief Save the result of a piece and call the VerifyFunc.
+ *
+ * A piece of a file that couldn't be read (other than short) isn't
+ * saved as checked: the error can go away (a chmod, a flaky disk)
+ * without changing the file, so it's read again the next time.
+ *
+ * @param verify: the Verify.
+ * @param piece: the piece index.
+ * @param valid: TRUE if the piece is right.
+ */
+static void
+verify_piece_done(Verify *verify, guint piece, gboolean valid)
+{
+  VerifyExtent *extent;
+  VerifyFile *file;
+  gboolean save, failed;
+  guint first, last, e;
+  gint error;
+
+  if(verify->files->len == 0)
+    return;
+
+  if(verify->first_extent[piece] < verify->first_extent[piece+1])
+  {
+    first = verify->extents[verify->first_extent[piece]].file;
+    last = verify->extents[verify->first_extent[piece+1]-1].file;
+  }
+  else  /* more pieces than data */
+    first = last = verify->files->len - 1;
+
+  failed = FALSE;
+  for(e = verify->first_extent[piece]; !valid && !failed && e < verify->first_extent[piece+1]; e++)
+  {
+    file = &g_array_index(verify->files, VerifyFile, verify->extents[e].file);
+    error = g_atomic_int_get(&file->error);
+    failed = (error != 0 && error != VERIFY_FILE_SHORT);
+  }
+
+  g_mutex_lock(verify->mutex);
+
+  if(!failed)
+    VERIFY_SET_BIT(verify->checked, piece);
+  if(valid)
+    VERIFY_SET_BIT(verify->valid, piece);
+
+  for(e = verify->first_extent[piece]; valid && e < verify->first_extent[piece+1]; e++)
+  {
+    extent = &verify->extents[e];
+    file = &g_array_index(verify->files, VerifyFile, extent->file);
+    file->remain -= extent->length;
+  }
+
+  if(verify->func != NULL)
+    verify->func(verify, piece, valid, first, last, verify->user_data);
+
+  /* the others go on while the checkpoint is written */
+  save = (verify->save_data != NULL && !g_atomic_int_get(&verify->saving) &&
+          g_timer_elapsed(verify->save_timer, NULL) >= VERIFY_CHECKPOINT_INTERVAL);
+  if(save)
+  {
+    verify_copy_checkpoint(verify, FALSE);
+    g_atomic_int_set(&verify->saving, TRUE);
+    g_timer_start(verify->save_timer);
+  }
+
+  g_mutex_unlock(verify->mutex);
+
+  if(save)
+  {
+    verify_write_checkpoint(verify);
+    g_atomic_int_set(&verify->saving, FALSE);
+  }
+
+  return;
+}
+
+/* END **********************************************************************/
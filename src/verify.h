@@ -0,0 +1,85 @@
+/**
+ * @file verify.h
+ *
+ * @brief header file for the pieces verification engine.
+ */
+
+#ifndef _VERIFY_H
+#define _VERIFY_H
+
+/* INCLUDES *****************************************************************/
+
+#include <glib.h>
+
+/* DEFINES ******************************************************************/
+
+#define VERIFY_MAX_WORKERS          64 /* max number of hashing threads */
+#define VERIFY_BUFFERS_PER_WORKER    2 /* pieces buffers for each worker */
+#define VERIFY_MAX_BUFFERS_SIZE  (256*1024*1024) /* bytes for the pieces buffers */
+#define VERIFY_DEFAULT_QUEUE_DEPTH   8 /* reads in flight */
+#define VERIFY_MAX_QUEUE_DEPTH      64
+#define VERIFY_BUFFER_ALIGN       4096 /* alignment of the pieces buffers */
+#define VERIFY_MIN_OPEN_FILES        8 /* open files cache size, it's half */
+#define VERIFY_MAX_OPEN_FILES     1024 /* of RLIMIT_NOFILE between them   */
+#define VERIFY_CHECKPOINT_INTERVAL   5 /* seconds between checkpoints */
+#define VERIFY_MAX_PIECE_SIZE  G_MAXUINT32 /* the reads and hashes are 32 bits */
+
+#define VERIFY_FILE_SHORT           -1 /* verify_file_error: file too small */
+
+/* TYPEDEF ******************************************************************/
+
+/**
+ * @brief A pieces verification engine. @see verify_new
+ *
+ * A reader stage reads the pieces from the files, in order and with
+ * several reads in flight, and a pool of worker threads hash and
+ * compare them.
+ */
+typedef struct _Verify Verify;
+
+/**
+ * @brief Function called when a piece was checked.
+ *
+ * It is called from the worker threads, but never two at the same time.
+ * Inside of it verify_file_remain can be used, any other function of
+ * the engine (except verify_cancel) can't.
+ *
+ * @param verify: the Verify engine.
+ * @param piece: the piece index.
+ * @param valid: TRUE if the piece matches its SHA1.
+ * @param first_file: the first file with data of the piece.
+ * @param last_file: the last file with data of the piece.
+ * @param user_data: the data given to verify_run.
+ */
+typedef void (*VerifyFunc) (Verify *verify, guint piece, gboolean valid,
+                            guint first_file, guint last_file,
+                            gpointer user_data);
+
+/* PROTOTYPES ***************************************************************/
+
+G_BEGIN_DECLS
+
+Verify  *verify_new(const gchar *hashes, guint n_pieces, gint64 piece_size);
+void     verify_free(Verify *verify);
+
+guint    verify_add_file(Verify *verify, const gchar *filename, gint64 size);
+void     verify_set_workers(Verify *verify, guint n_workers);
+void     verify_set_queue_depth(Verify *verify, guint depth);
+void     verify_set_checkpoint(Verify *verify, const gchar *filename);
+void     verify_set_incremental(Verify *verify, gboolean incremental,
+                               gboolean check_inode);
+gchar   *verify_checkpoint_filename(const guint8 *info_hash, const gchar *path);
+
+gboolean verify_run(Verify *verify, VerifyFunc func, gpointer user_data);
+void     verify_cancel(Verify *verify);
+
+guint    verify_get_n_files(Verify *verify);
+guint    verify_get_n_resumed(Verify *verify);
+const gchar *verify_file_name(Verify *verify, guint file);
+gint64   verify_file_size(Verify *verify, guint file);
+gint64   verify_file_remain(Verify *verify, guint file);
+gint     verify_file_error(Verify *verify, guint file);
+
+G_END_DECLS
+
+#endif /* _VERIFY_H */